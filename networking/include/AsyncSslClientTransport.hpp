@@ -10,12 +10,17 @@
 class AsyncSslClientTransport : public AsyncSslTransport {
 public:
     AsyncSslClientTransport(SSL_CTX* ssl_ctx, int fd) : AsyncSslTransport(ssl_ctx, fd) {}
+    ~AsyncSslClientTransport() override { join(); }
 
     using SharedMsgPromiseT = std::shared_ptr<std::promise<std::shared_ptr<MsgWrapper>>>;
+    using PushHandlerT      = std::function<void(std::vector<uint8_t>)>;
 
     std::future<std::shared_ptr<MsgWrapper>> send_msg(std::vector<uint8_t> message);
     std::vector<uint8_t>                     send_msg_and_wait(std::vector<uint8_t> message);
 
+    // Called on the transport thread for messages pushed by the server, must not wait for replies
+    void set_push_handler(PushHandlerT handler);
+
 protected:
     void handle_message(std::shared_ptr<MsgWrapper> msg) override;
     void handle_fail() override {
@@ -29,6 +34,7 @@ private:
     std::unordered_map<decltype(MsgWrapper::id), SharedMsgPromiseT> _promises;
     uint64_t                                                        _msg_id = 0;
     std::mutex                                                      _promises_mutex;
+    PushHandlerT                                                    _push_handler;
 };
 
 #endif // ASYNCMESSAGECLIENT_HPP
@@ -10,6 +10,7 @@
 class AsyncSslServerTransport : public AsyncSslTransport {
 public:
     AsyncSslServerTransport(SSL_CTX* ssl_ctx, int fd, int client_id) : AsyncSslTransport(ssl_ctx, fd), _client_id(client_id) {}
+    ~AsyncSslServerTransport() override { join(); }
 
     // Null if finished
     std::shared_ptr<MsgWrapper> get_msg();
@@ -28,6 +28,10 @@ public:
     bool is_stopped() const { return _stopped; }
 
     void stop();
+    // Stops and joins the thread, derived classes call it from their destructors so that
+    // handle_message doesn't run on their already destroyed members
+    // The socket must stay open until it returns, the thread still writes to it when shutting down
+    void join();
 
 protected:
     virtual void handle_message(std::shared_ptr<MsgWrapper> msg) = 0;
@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <deque>
 #include <functional>
+#include <limits>
 #include <vector>
 
 #include "Options.h"
@@ -15,6 +16,9 @@
 
 using MsgIdType = uint64_t;
 
+// Id of messages the server sends on its own, not in reply to a request
+constexpr MsgIdType push_msg_id = std::numeric_limits<MsgIdType>::max();
+
 struct MsgWrapper {
     MsgIdType            id;
     std::vector<uint8_t> data;
@@ -29,6 +33,8 @@ namespace Helpers {
 void poll_wait(int fd, bool write, int timeout = checked_cast<int>(Options::get<size_t>("timeout")) * 1000);
 bool SSL_write(SSL* ctx, int fd, const std::vector<uint8_t>& buf);
 void init_nonblock(int fd);
+// Messages are written as they are ready, waiting to fill up packets only adds latency
+void init_nodelay(int fd);
 std::vector<uint8_t> SSL_read_n(SSL* ctx, int fd, size_t n);
 MsgWrapper           SSL_read_msg(SSL* ctx, int fd);
 void                 SSL_send_msg(SSL* ctx, int fd, const MsgWrapper& buf);
@@ -0,0 +1,108 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Runs requests on a fixed pool of workers, choosing between queues with deficit round-robin,
+// so that a queue with a lot of requests doesn't starve the others
+// Costs are in bytes, a request is charged for what it sent when it is started and for what it
+// produced when it finishes, so a queue can go into debt and is then skipped until it pays it off
+// A queue also may only run a limited number of requests at once, so its slow requests can't take every worker
+// Requests that wait on something else say so with blocking(), another thread then takes their worker's place,
+// and they don't count against their queue's limit meanwhile, as they may wait for a later request of the same queue
+class Scheduler {
+public:
+    using ClockT = std::chrono::steady_clock;
+    // Returns the size of what it produced
+    using TaskT = std::function<uint64_t()>;
+
+    struct Limits {
+        uint64_t weight    = 1; // Share of the server relative to other queues
+        uint64_t iops      = 0; // Requests per second, 0 is unlimited
+        uint64_t bandwidth = 0; // Bytes per second in both directions, 0 is unlimited
+
+        bool operator==(const Limits& rhs) const = default;
+    };
+
+    using LimitsT = std::function<Limits(const std::string& queue)>;
+
+    // Added to the cost of every request, so that small requests aren't free
+    static constexpr uint64_t op_cost = 4096;
+
+    // quantum is how many bytes a queue of weight 1 may use per round,
+    // max_running is how many requests of one queue may run at once, 0 is as many as there are workers
+    Scheduler(size_t workers, uint64_t quantum, LimitsT limits, size_t max_running = 0);
+    ~Scheduler();
+
+    void submit(const std::string& queue, uint64_t cost, TaskT task);
+
+    // Runs fn, which waits for something, starting a spare worker if needed so the pool keeps serving meanwhile
+    // At most as many spares as workers are started, outside of the workers it just runs fn
+    void blocking(const std::function<void()>& fn);
+
+    // Number of requests waiting in each queue
+    std::map<std::string, size_t> depths();
+
+private:
+    struct Queue {
+        Limits                                 limits;
+        std::deque<std::pair<uint64_t, TaskT>> tasks;
+        int64_t                                deficit = 0;
+        size_t                                 running = 0;
+        size_t                                 blocked = 0; // Of the running ones
+        bool                                   active  = false;
+        // Token buckets for the caps, they hold up to a second worth of requests
+        double                                 iops_tokens      = 0;
+        double                                 bandwidth_tokens = 0;
+        ClockT::time_point                     refilled;
+    };
+
+    struct Picked {
+        std::string queue;
+        TaskT       task;
+    };
+
+    // Must be called with the mutex held
+    // Returns the next task to run, or if every queue is empty or capped, sets wake to when one won't be
+    std::optional<Picked> pick(ClockT::time_point now, ClockT::time_point& wake);
+    // When the queue may start the next request, refills its buckets
+    static ClockT::time_point ready_at(Queue& queue, ClockT::time_point now);
+    void                      finish(const std::string& name, uint64_t produced);
+    // Spares quit once there are enough workers that aren't blocked
+    void                      worker(bool spare);
+
+    const size_t   _size;
+    const uint64_t _quantum;
+    const LimitsT  _limits;
+    const size_t   _max_running;
+
+    std::mutex                             _mutex;
+    std::condition_variable                _cond;
+    bool                                   _stopped = false;
+    std::unordered_map<std::string, Queue> _queues;
+    // Queues with waiting requests, in round-robin order, the front one is being served
+    std::deque<std::string>                _active;
+
+    std::vector<std::thread> _workers;
+    // Spares are detached, the destructor waits for them to quit
+    size_t                   _spares  = 0;
+    size_t                   _blocked = 0;
+    std::condition_variable  _spares_cond;
+
+    // The scheduler the calling thread is a worker of, and the queue of the request it runs
+    static thread_local Scheduler* _current;
+    static thread_local Queue*     _current_queue;
+};
+
+#endif // SCHEDULER_HPP
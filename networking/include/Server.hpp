@@ -16,8 +16,10 @@
 
 #include "AsyncSslServerTransport.hpp"
 #include "Helpers.hpp"
+#include "Scheduler.hpp"
 
 struct ClientCtx {
+    int                        id;
     std::optional<std::string> client_name;
     AsyncSslServerTransport    transport;
     std::mutex                 ctx_mutex;
@@ -25,7 +27,10 @@ struct ClientCtx {
 
 class Server {
 public:
-    Server(uint16_t port, uint32_t ip, std::string cert_path, std::string key_path);
+    // With 0 workers every message gets its own thread and isn't scheduled
+    // queue_workers is how many of the workers a single queue may occupy, 0 is all of them
+    Server(uint16_t port, uint32_t ip, std::string cert_path, std::string key_path, size_t workers = 0,
+           uint64_t quantum = 0, size_t queue_workers = 0);
 
     void run();
 
@@ -41,12 +46,22 @@ protected:
     void process_req(int conn_fd);
 
     virtual std::vector<uint8_t> handle_message(ClientCtx& client, std::vector<uint8_t> data) = 0;
+    virtual void                 handle_disconnect(ClientCtx& client) {}
+
+    // Messages of clients in the same queue share their part of the server, by default every connection has its own
+    virtual std::string       queue_of(ClientCtx& client) { return "#" + std::to_string(client.id); }
+    virtual Scheduler::Limits limits_of(const std::string& queue) { return {}; }
+
+    // Null if messages aren't scheduled
+    Scheduler* scheduler() { return _scheduler ? &*_scheduler : nullptr; }
 
 private:
     std::atomic<int>        _total_req{0};
     std::atomic<int>        _req_in_progress{0};
     std::mutex              _req_in_progress_mutex;
     std::condition_variable _req_in_progress_cond;
+
+    std::optional<Scheduler> _scheduler;
 };
 
 
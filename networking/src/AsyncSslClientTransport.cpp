@@ -45,9 +45,22 @@ void AsyncSslClientTransport::before_entry() {
     Logger::log(Logger::RemoteFs, [&](std::ostream& os) { os << "Connected"; }, Logger::INFO);
 }
 
-void AsyncSslClientTransport::handle_message(std::shared_ptr<MsgWrapper> msg) {
+void AsyncSslClientTransport::set_push_handler(PushHandlerT handler) {
     std::lock_guard lock(_promises_mutex);
-    auto            future_it = _promises.find(msg->id);
+    _push_handler = std::move(handler);
+}
+
+void AsyncSslClientTransport::handle_message(std::shared_ptr<MsgWrapper> msg) {
+    std::unique_lock lock(_promises_mutex);
+    if (msg->id == push_msg_id) {
+        auto handler = _push_handler;
+        lock.unlock();
+        if (handler)
+            handler(std::move(msg->data));
+        return;
+    }
+
+    auto future_it = _promises.find(msg->id);
 
     if (future_it == _promises.end()) {
         Logger::log(Logger::RemoteFs, "Could not find future for msg with id " + std::to_string(msg->id),
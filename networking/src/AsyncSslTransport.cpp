@@ -16,15 +16,23 @@
 #include "Serialize.hpp"
 #include "stuff.hpp"
 
+// Messages up to this size are copied behind their header and sent in one piece, bigger ones are sent from where
+// they are to save the copy
+static constexpr size_t max_copied_msg = 64 * 1024;
+
 AsyncSslTransport::AsyncSslTransport(SSL_CTX* ssl_ctx, int fd) : _ssl(SSL_new(ssl_ctx), &SSL_free), _fd(fd) {
     SSL_set_fd(_ssl.get(), _fd);
     pipe(_to_send_notif_pipe);
     Helpers::init_nonblock(_fd);
+    Helpers::init_nodelay(_fd);
 }
 
-AsyncSslTransport::~AsyncSslTransport() {
+AsyncSslTransport::~AsyncSslTransport() { join(); }
+
+void AsyncSslTransport::join() {
     stop();
-    _thread.join();
+    if (_thread.joinable())
+        _thread.join();
 }
 
 void AsyncSslTransport::stop() {
@@ -44,9 +52,10 @@ void AsyncSslTransport::thread_entry() {
     try {
         before_entry();
 
-        bool                 sending = false;
-        std::vector<uint8_t> to_send_buf{};
-        size_t               cur_sent = 0;
+        bool                        sending = false;
+        std::vector<uint8_t>        to_send_buf{}; // Header, followed by the message if it was copied
+        std::shared_ptr<MsgWrapper> to_send_msg{}; // Sent after to_send_buf if it wasn't
+        size_t                      cur_sent = 0;
 
         bool                 reading_msg = false; // False if reading header, true if message
         std::vector<uint8_t> read_buf;
@@ -70,9 +79,13 @@ void AsyncSslTransport::thread_entry() {
                     MsgHeader header{};
                     header.id  = htobe64(to_send_now->id);
                     header.len = htobe64(to_send_now->data.size());
-                    to_send_buf.resize(sizeof(MsgHeader) + to_send_now->data.size());
+                    to_send_buf.resize(sizeof(MsgHeader));
                     memcpy(to_send_buf.data(), &header, sizeof(MsgHeader));
-                    memcpy(to_send_buf.data() + sizeof(MsgHeader), to_send_now->data.data(), to_send_now->data.size());
+                    if (to_send_now->data.size() <= max_copied_msg) {
+                        to_send_buf.insert(to_send_buf.end(), to_send_now->data.begin(), to_send_now->data.end());
+                    } else {
+                        to_send_msg = to_send_now;
+                    }
                     sending = true;
                     Logger::log(
                             Logger::RemoteFs, [&](std::ostream& os) { os << "Started sending message " << to_send_now->id; },
@@ -81,10 +94,15 @@ void AsyncSslTransport::thread_entry() {
             }
 
             while (sending) {
+                size_t         total = to_send_buf.size() + (to_send_msg ? to_send_msg->data.size() : 0);
+                const uint8_t* from  = cur_sent < to_send_buf.size()
+                                               ? to_send_buf.data() + cur_sent
+                                               : to_send_msg->data.data() + (cur_sent - to_send_buf.size());
+                size_t         len   = cur_sent < to_send_buf.size() ? to_send_buf.size() - cur_sent : total - cur_sent;
+
                 size_t written_now = 0;
                 int    ret;
-                if ((ret = SSL_write_ex(_ssl.get(), to_send_buf.data() + cur_sent, to_send_buf.size() - cur_sent,
-                                        &written_now)) <= 0) {
+                if ((ret = SSL_write_ex(_ssl.get(), from, len, &written_now)) <= 0) {
                     int err = SSL_get_error(_ssl.get(), ret);
                     if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
                         break;
@@ -99,17 +117,17 @@ void AsyncSslTransport::thread_entry() {
                             if (Logger::en_level(Logger::RemoteFs, Logger::TRACE)) {
                                 os << ": ";
                                 for (size_t i = 0; i < written_now; i++) {
-                                    os << std::setw(2) << std::setfill('0') << std::hex
-                                       << (int) to_send_buf[i + cur_sent] << " ";
+                                    os << std::setw(2) << std::setfill('0') << std::hex << (int) from[i] << " ";
                                 }
                             }
                         },
                         Logger::DEBUG);
                 cur_sent += written_now;
 
-                if (cur_sent == to_send_buf.size()) {
+                if (cur_sent == total) {
                     Logger::log(Logger::RemoteFs, [&](std::ostream& os) { os << "Finished sending"; }, Logger::DEBUG);
                     to_send_buf.resize(0);
+                    to_send_msg.reset();
                     cur_sent = 0;
                     sending  = false;
                 }
@@ -118,7 +136,7 @@ void AsyncSslTransport::thread_entry() {
             while (true) {
                 int    ret;
                 size_t read_now = 0;
-                if ((ret = SSL_read_ex(_ssl.get(), read_buf.data() + cur_read, msg_len, &read_now)) <= 0) {
+                if ((ret = SSL_read_ex(_ssl.get(), read_buf.data() + cur_read, msg_len - cur_read, &read_now)) <= 0) {
                     int err = SSL_get_error(_ssl.get(), ret);
                     if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
                         break;
@@ -5,6 +5,8 @@
 #include "Helpers.hpp"
 
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 
 #include <openssl/err.h>
@@ -36,6 +38,13 @@ void Helpers::init_nonblock(int fd) {
     }
 }
 
+void Helpers::init_nodelay(int fd) {
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        throw ErrnoException("Could not disable Nagle's algorithm");
+    }
+}
+
 bool Helpers::SSL_write(SSL* ctx, int fd, const std::vector<uint8_t>& buf) {
     for (size_t written = 0; written < buf.size();) {
         size_t written_now = 0;
@@ -61,7 +70,7 @@ std::vector<uint8_t> Helpers::SSL_read_n(SSL* ctx, int fd, size_t n) {
     int                  ret;
 
     while (nread < n) {
-        while ((ret = SSL_read_ex(ctx, buf.data() + nread, n, &read_now)) <= 0) {
+        while ((ret = SSL_read_ex(ctx, buf.data() + nread, n - nread, &read_now)) <= 0) {
             int err = SSL_get_error(ctx, ret);
             if (err == SSL_ERROR_WANT_READ) {
                 Helpers::poll_wait(fd, false);
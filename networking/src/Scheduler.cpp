@@ -0,0 +1,222 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+thread_local Scheduler*        Scheduler::_current       = nullptr;
+thread_local Scheduler::Queue* Scheduler::_current_queue = nullptr;
+
+Scheduler::Scheduler(size_t workers, uint64_t quantum, LimitsT limits, size_t max_running) :
+    _size(workers), _quantum(std::max<uint64_t>(quantum, 1)), _limits(std::move(limits)),
+    _max_running(max_running ? max_running : workers) {
+    for (size_t i = 0; i < workers; i++)
+        _workers.emplace_back([this] { worker(false); });
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopped = true;
+    }
+    _cond.notify_all();
+    for (auto& w: _workers)
+        w.join();
+
+    std::unique_lock lock(_mutex);
+    _spares_cond.wait(lock, [&] { return _spares == 0; });
+}
+
+void Scheduler::submit(const std::string& queue, uint64_t cost, TaskT task) {
+    {
+        std::lock_guard lock(_mutex);
+        auto [it, inserted] = _queues.try_emplace(queue);
+        auto& q             = it->second;
+        if (inserted) {
+            q.limits           = _limits(queue);
+            q.limits.weight    = std::max<uint64_t>(q.limits.weight, 1);
+            q.iops_tokens      = static_cast<double>(q.limits.iops);
+            q.bandwidth_tokens = static_cast<double>(q.limits.bandwidth);
+            q.refilled         = ClockT::now();
+        }
+
+        q.tasks.emplace_back(cost + op_cost, std::move(task));
+        if (!q.active) {
+            q.active = true;
+            _active.push_back(queue);
+        }
+    }
+    _cond.notify_one();
+}
+
+std::map<std::string, size_t> Scheduler::depths() {
+    std::lock_guard               lock(_mutex);
+    std::map<std::string, size_t> out;
+    for (const auto& [name, q]: _queues)
+        out.emplace(name, q.tasks.size());
+    return out;
+}
+
+Scheduler::ClockT::time_point Scheduler::ready_at(Queue& queue, ClockT::time_point now) {
+    double elapsed = std::chrono::duration<double>(now - queue.refilled).count();
+    queue.refilled = now;
+
+    auto ready = now;
+    auto after = [&](double seconds) {
+        return now + std::chrono::ceil<ClockT::duration>(std::chrono::duration<double>(seconds));
+    };
+
+    if (queue.limits.iops) {
+        auto rate         = static_cast<double>(queue.limits.iops);
+        queue.iops_tokens = std::min(rate, queue.iops_tokens + elapsed * rate);
+        if (queue.iops_tokens < 1)
+            ready = std::max(ready, after((1 - queue.iops_tokens) / rate));
+    }
+    if (queue.limits.bandwidth) {
+        auto rate              = static_cast<double>(queue.limits.bandwidth);
+        queue.bandwidth_tokens = std::min(rate, queue.bandwidth_tokens + elapsed * rate);
+        if (queue.bandwidth_tokens < 0)
+            ready = std::max(ready, after(-queue.bandwidth_tokens / rate));
+    }
+    return ready;
+}
+
+std::optional<Scheduler::Picked> Scheduler::pick(ClockT::time_point now, ClockT::time_point& wake) {
+    auto rotate = [&]() {
+        auto name = std::move(_active.front());
+        _active.pop_front();
+        _active.push_back(std::move(name));
+    };
+
+    // Stops once every queue was skipped because of its caps in a row
+    size_t capped = 0;
+    while (!_active.empty() && capped < _active.size()) {
+        auto& q = _queues.at(_active.front());
+
+        // Picked again by the worker that finishes one of its requests
+        if (q.running - q.blocked >= _max_running) {
+            capped++;
+            rotate();
+            continue;
+        }
+
+        auto ready = ready_at(q, now);
+        if (ready > now) {
+            wake = std::min(wake, ready);
+            capped++;
+            rotate();
+            continue;
+        }
+
+        // Out of its share for this round
+        if (q.deficit <= 0) {
+            q.deficit += static_cast<int64_t>(_quantum * q.limits.weight);
+            capped = 0;
+            rotate();
+            continue;
+        }
+
+        auto [cost, task] = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        q.deficit -= static_cast<int64_t>(cost);
+        q.iops_tokens -= 1;
+        q.bandwidth_tokens -= static_cast<double>(cost);
+        q.running++;
+
+        Picked picked{_active.front(), std::move(task)};
+        if (q.tasks.empty()) {
+            // An idle queue doesn't save up its share, but keeps its debt
+            q.active  = false;
+            q.deficit = std::min<int64_t>(q.deficit, 0);
+            _active.pop_front();
+        }
+        return picked;
+    }
+
+    return std::nullopt;
+}
+
+void Scheduler::finish(const std::string& name, uint64_t produced) {
+    auto found = _queues.find(name);
+    auto& q    = found->second;
+
+    q.running--;
+    q.deficit -= static_cast<int64_t>(produced);
+    q.bandwidth_tokens -= static_cast<double>(produced);
+
+    // Forgetting a queue refills its buckets, so only forget uncapped ones
+    if (!q.active && q.running == 0 && !q.limits.iops && !q.limits.bandwidth && q.deficit >= 0)
+        _queues.erase(found);
+}
+
+void Scheduler::blocking(const std::function<void()>& fn) {
+    if (_current != this) {
+        fn();
+        return;
+    }
+
+    {
+        std::lock_guard lock(_mutex);
+        _blocked++;
+        // The queue is kept while it has running requests
+        _current_queue->blocked++;
+        if (_spares < std::min(_blocked, _size) && !_stopped) {
+            _spares++;
+            std::thread([this] { worker(true); }).detach();
+        }
+    }
+    // The queue may be able to start another request now
+    _cond.notify_all();
+
+    auto unblock = [this] {
+        std::lock_guard lock(_mutex);
+        _blocked--;
+        _current_queue->blocked--;
+        // Lets a spare that is no longer needed quit
+        _cond.notify_all();
+    };
+    try {
+        fn();
+    } catch (...) {
+        unblock();
+        throw;
+    }
+    unblock();
+}
+
+void Scheduler::worker(bool spare) {
+    _current = this;
+
+    std::unique_lock lock(_mutex);
+    while (!_stopped) {
+        if (spare && _spares > _blocked)
+            break;
+
+        auto wake   = ClockT::time_point::max();
+        auto picked = pick(ClockT::now(), wake);
+        if (!picked) {
+            if (wake == ClockT::time_point::max())
+                _cond.wait(lock);
+            else
+                _cond.wait_until(lock, wake);
+            continue;
+        }
+
+        _current_queue = &_queues.at(picked->queue);
+        lock.unlock();
+        uint64_t produced = 0;
+        try {
+            produced = picked->task();
+        } catch (std::exception& e) {
+            Logger::log(Logger::RemoteFs, std::string("Error: ") + e.what(), Logger::ERROR);
+        }
+        lock.lock();
+
+        finish(picked->queue, produced);
+    }
+
+    if (spare) {
+        _spares--;
+        _spares_cond.notify_all();
+    }
+}
@@ -55,9 +55,13 @@ static void configure_context(SSL_CTX* ctx, const std::string& cert_path, const
     }
 }
 
-Server::Server(uint16_t port, uint32_t ip, std::string cert_path, std::string key_path) :
+Server::Server(uint16_t port, uint32_t ip, std::string cert_path, std::string key_path, size_t workers,
+               uint64_t quantum, size_t queue_workers) :
     _port(port), _ip(ip), _cert_path(std::move(cert_path)), _key_path(std::move(key_path)), _ssl_ctx(create_context()) {
     configure_context(_ssl_ctx.get(), _cert_path, _key_path);
+    if (workers > 0)
+        _scheduler.emplace(
+                workers, quantum, [this](const std::string& queue) { return limits_of(queue); }, queue_workers);
 }
 
 void Server::process_req(int conn_fd) {
@@ -67,7 +71,12 @@ void Server::process_req(int conn_fd) {
 
         Logger::log(Logger::RemoteFs, "Client " + std::to_string(id) + " connecting\n", Logger::INFO);
 
-        ClientCtx context{{}, {_ssl_ctx.get(), conn_fd, id}, {}};
+        ClientCtx context{id, {}, {_ssl_ctx.get(), conn_fd, id}, {}};
+
+        // Messages still being handled, the context must outlive them
+        std::mutex              pending_mutex;
+        std::condition_variable pending_cond;
+        size_t                  pending = 0;
 
         try {
             Helpers::init_nonblock(conn_fd);
@@ -80,16 +89,51 @@ void Server::process_req(int conn_fd) {
                 if (!msg)
                     break;
 
-                std::thread msg_proc([&context, msg, this] {
-                    auto ret = this->handle_message(context, std::move(msg->data));
+                {
+                    std::lock_guard lock(pending_mutex);
+                    pending++;
+                }
+
+                auto handle = [&context, &pending_mutex, &pending_cond, &pending, msg, this] {
+                    // Counted as done even if handling throws, or the disconnect would wait for it forever
+                    struct Done {
+                        std::mutex&              mutex;
+                        std::condition_variable& cond;
+                        size_t&                  count;
+
+                        ~Done() {
+                            std::lock_guard lock(mutex);
+                            count--;
+                            cond.notify_all();
+                        }
+                    } done{pending_mutex, pending_cond, pending};
+
+                    auto   ret  = this->handle_message(context, std::move(msg->data));
+                    size_t size = ret.size();
                     context.transport.send_message(std::make_shared<MsgWrapper>(msg->id, std::move(ret)));
-                });
-                msg_proc.detach();
+                    return size;
+                };
+
+                if (_scheduler) {
+                    _scheduler->submit(queue_of(context), msg->data.size(), std::move(handle));
+                } else {
+                    std::thread msg_proc(std::move(handle));
+                    msg_proc.detach();
+                }
             }
         } catch (std::exception& e) {
             Logger::log(Logger::RemoteFs, std::string("Error: ") + e.what(), Logger::ERROR);
         }
 
+        {
+            std::unique_lock lock(pending_mutex);
+            pending_cond.wait(lock, [&] { return pending == 0; });
+        }
+
+        handle_disconnect(context);
+
+        // Otherwise the fd could be reused before the transport is done with it
+        context.transport.join();
         close(conn_fd);
         _req_in_progress.fetch_sub(1);
         std::lock_guard<std::mutex> lock(_req_in_progress_mutex);
@@ -10,15 +10,23 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "Scheduler.hpp"
+
 class ACL {
 public:
     void load(std::string acl, std::string users);
     bool authorize(std::string username, std::string password);
     bool authorize_path(std::string username, std::string path);
 
+    // Lines of <username or *> <weight> <requests per second> <bytes per second>, 0 for no cap
+    void              load_limits(std::string limits);
+    // Limits of users without their own line are the ones of *
+    Scheduler::Limits limits(const std::string& username);
+
 private:
     std::unordered_map<std::string, std::string>    _users;
     std::map<std::string, std::unordered_set<std::string>> _filter;
+    std::unordered_map<std::string, Scheduler::Limits>     _limits;
 };
 
 #endif // ACL_HPP
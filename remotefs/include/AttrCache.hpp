@@ -0,0 +1,93 @@
+#ifndef ATTRCACHE_HPP
+#define ATTRCACHE_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Messages.hpp"
+
+// Client-side cache of file attributes, keyed by path
+// Attributes of paths that don't exist are kept too, as a NONE type, for their own ttl
+// Paths are kept in a radix tree, so the common prefixes of a directory's files are stored once and a whole
+// directory tree can be dropped at once
+// Once over either limit, expired entries and those not looked up since the last time are evicted
+class AttrCache {
+public:
+    using ClockT = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t negative_hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t entries;
+        uint64_t bytes;
+    };
+
+    // A ttl of 0 disables caching of that kind of entry
+    AttrCache(std::chrono::milliseconds ttl, std::chrono::milliseconds negative_ttl, size_t max_entries,
+              size_t max_bytes);
+
+    std::optional<GetattrReply> get(const std::string& path);
+    // Skipped if anything was invalidated since generation() was taken, the attributes may predate that
+    void                        put(const std::string& path, const GetattrReply& attr, uint64_t generation);
+    void                        invalidate(const std::string& path);
+    // Drops path and everything under it
+    void                        invalidate_tree(const std::string& path);
+    uint64_t                    generation();
+
+    Stats stats();
+
+private:
+    struct Entry {
+        GetattrReply       attr;
+        ClockT::time_point expires;
+        bool               referenced = false; // Looked up since the last eviction pass
+    };
+
+    struct Node {
+        std::string                        label;    // Bytes of the path between the parent and this node
+        std::vector<std::unique_ptr<Node>> children; // Sorted by the first byte of their label
+        std::unique_ptr<Entry>             entry;
+    };
+
+    using ChildIt = std::vector<std::unique_ptr<Node>>::iterator;
+
+    // Must be called with _mutex held
+    Node*   find(const std::string& path);
+    Node&   insert(const std::string& path);
+    ChildIt child(Node& node, char c);
+    // Drops the entry of path or, with tree set, everything starting with it
+    void    remove(Node& node, const std::string& path, size_t pos, bool tree);
+    // Removes or merges a child that no longer has an entry of its own
+    void    compact(Node& node, ChildIt it);
+    // Forgets the accounting of a subtree about to be freed
+    void    drop(Node& node);
+    // Drops expired and unreferenced entries below node and clears the referenced flags of the rest
+    void    evict(Node& node, ClockT::time_point now);
+    bool    over_limits() const;
+
+    static size_t node_bytes(const Node& node);
+
+    const std::chrono::milliseconds _ttl;
+    const std::chrono::milliseconds _negative_ttl;
+    const size_t                    _max_entries;
+    const size_t                    _max_bytes;
+
+    std::mutex _mutex;
+    Node       _root;
+    uint64_t   _generation = 0;
+    size_t     _entries    = 0;
+    size_t     _bytes      = 0;
+
+    uint64_t _hits          = 0;
+    uint64_t _negative_hits = 0;
+    uint64_t _misses        = 0;
+    uint64_t _evictions     = 0;
+};
+
+#endif // ATTRCACHE_HPP
@@ -0,0 +1,106 @@
+#ifndef BLOCKCACHE_HPP
+#define BLOCKCACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Size-bounded cache of file blocks shared between all clients
+// Blocks are keyed by (device, inode, block number) and validated with the file mtime,
+// concurrent misses for the same block wait for a single fill
+// The capacity is split evenly between the shards and every shard evicts on its own,
+// so a single hot file can only use its shards' part of it
+class BlockCache {
+public:
+    struct Key {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t block;
+
+        bool operator==(const Key& rhs) const = default;
+    };
+
+    struct Version {
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+
+        bool operator==(const Version& rhs) const = default;
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t shared_fills; // Misses that waited for someone else's fill instead of reading
+        uint64_t evictions;
+        uint64_t invalidations;
+        uint64_t bytes;
+    };
+
+    using BlockT = std::shared_ptr<const std::vector<uint8_t>>;
+    using FillT  = std::function<std::vector<uint8_t>()>;
+
+    BlockCache(size_t capacity, size_t block_size, size_t shards = 16);
+
+    size_t block_size() const { return _block_size; }
+    bool   enabled() const { return _capacity > 0; }
+
+    // Returns the cached block if its version matches, otherwise calls fill, which is allowed to throw
+    BlockT get(const Key& key, const Version& version, const FillT& fill);
+
+    // Drops blocks first_block..last_block (inclusive) of a file
+    void invalidate(uint64_t dev, uint64_t ino, uint64_t first_block, uint64_t last_block);
+
+    Stats stats() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<uint64_t>()(k.dev) ^ (std::hash<uint64_t>()(k.ino) * 31) ^
+                   (std::hash<uint64_t>()(k.block) * 1000003);
+        }
+    };
+
+    struct Pending {
+        std::promise<BlockT>       promise;
+        std::shared_future<BlockT> future = promise.get_future().share();
+    };
+
+    struct Entry {
+        Version                  version;
+        BlockT                   data;    // Null while the block is being filled
+        std::shared_ptr<Pending> pending; // Null once the block is filled
+        std::list<Key>::iterator lru_it;
+    };
+
+    struct Shard {
+        std::mutex                              mutex;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        std::list<Key>                          lru; // Only filled blocks
+        size_t                                  bytes = 0;
+    };
+
+    Shard& shard_for(const Key& key) { return _shards[KeyHash()(key) % _shards.size()]; }
+
+    // Must be called with the shard's mutex held
+    void erase(Shard& shard, std::unordered_map<Key, Entry, KeyHash>::iterator it);
+
+    const size_t       _capacity;
+    const size_t       _block_size;
+    std::vector<Shard> _shards;
+    const size_t       _shard_capacity; // At least one block
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _shared_fills{0};
+    std::atomic<uint64_t> _evictions{0};
+    std::atomic<uint64_t> _invalidations{0};
+    std::atomic<uint64_t> _bytes{0};
+};
+
+#endif // BLOCKCACHE_HPP
@@ -0,0 +1,56 @@
+#ifndef BLOCKSTORE_HPP
+#define BLOCKSTORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Client-side content-addressed store of file blocks, keyed by their SHA-256
+// Identical blocks of different files are kept and fetched once
+class BlockStore {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t bytes;
+    };
+
+    using BlockT = std::shared_ptr<const std::vector<uint8_t>>;
+
+    explicit BlockStore(size_t capacity) : _capacity(capacity) {}
+
+    bool enabled() const { return _capacity > 0; }
+
+    // Null if the block isn't stored
+    BlockT get(const std::string& hash);
+
+    // The caller is responsible for hash being the hash of data
+    void put(const std::string& hash, BlockT data);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        BlockT                           data;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    const size_t _capacity;
+
+    std::mutex                             _mutex;
+    std::unordered_map<std::string, Entry> _entries;
+    std::list<std::string>                 _lru; // Most recently used first
+
+    std::atomic<uint64_t> _bytes{0};
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+};
+
+#endif // BLOCKSTORE_HPP
@@ -0,0 +1,73 @@
+#ifndef CHANGEWATCHER_HPP
+#define CHANGEWATCHER_HPP
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Watches directories of the export with inotify and reports changes to the clients that looked at them
+// Paths are client paths, the least recently watched directory is dropped when there are too many
+class ChangeWatcher {
+public:
+    // Paths that changed, and directories whose whole subtree may have changed, "/" meaning everything
+    struct Changes {
+        std::set<std::string> paths;
+        std::set<std::string> trees;
+    };
+
+    // Called from the watcher thread and from watch(), without the watcher's lock held
+    using NotifyT = std::function<void(int client, const Changes& changes)>;
+    // Opens a directory of the export, returns -1 on error
+    using OpenT = std::function<int(const std::string& path)>;
+
+    ChangeWatcher(size_t max_watches, OpenT open, NotifyT notify);
+    ~ChangeWatcher();
+
+    bool enabled() const { return _inotify_fd >= 0; }
+
+    // Reports changes of dir and its entries to client from now on
+    void watch(int client, const std::string& dir);
+
+    // Drops everything watched for a disconnected client
+    void forget(int client);
+
+    size_t size();
+
+private:
+    struct Watch {
+        // The same directory can be reached through several paths
+        std::unordered_map<std::string, std::unordered_set<int>> paths;
+        std::list<int>::iterator                                 lru_it;
+    };
+
+    using ChangesT = std::unordered_map<int, Changes>;
+
+    void thread_entry();
+
+    // Must be called with the mutex held, reports the whole directory as changed to its clients
+    void drop(int wd, ChangesT& changes);
+
+    void notify(const ChangesT& changes);
+
+    const size_t  _max_watches;
+    const OpenT   _open;
+    const NotifyT _notify;
+
+    int _inotify_fd = -1;
+    int _stop_pipe[2]{-1, -1};
+
+    std::mutex                           _mutex;
+    std::unordered_map<int, Watch>       _watches; // By watch descriptor
+    std::unordered_map<std::string, int> _by_path;
+    std::list<int>                       _lru; // Most recently watched first
+
+    std::thread _thread;
+};
+
+#endif // CHANGEWATCHER_HPP
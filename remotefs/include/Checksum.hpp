@@ -0,0 +1,38 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <sys/types.h>
+
+// Hashes a range of a file a chunk at a time, the chunks are read and hashed by several threads
+// A range of at most one chunk hashes to the plain digest of its bytes, so it can be checked with sha256sum,
+// a longer one to the digest of the concatenated digests of its chunks
+class Checksum {
+public:
+    enum class Algorithm { SHA256, XXH64 };
+
+    // Like pread(2), stops early only at the end of file
+    using ReadT = std::function<ssize_t(char* buf, size_t len, uint64_t off)>;
+
+    Checksum(Algorithm algorithm, size_t chunk, size_t threads);
+
+    // Raw digest of len bytes at off, throws if they can't all be read
+    std::string compute(const ReadT& read, uint64_t off, uint64_t len) const;
+
+    // Raw digest of some bytes in memory
+    std::string digest(const char* data, size_t len) const;
+
+    size_t chunk() const { return _chunk; }
+
+    static std::string to_hex(const std::string& digest);
+
+private:
+    const Algorithm _algorithm;
+    const size_t    _chunk;
+    const size_t    _threads;
+};
+
+#endif // CHECKSUM_HPP
@@ -0,0 +1,41 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "Messages.hpp"
+
+// Rsync style delta transfer: the receiver sends signatures of the blocks of its old copy, and the sender
+// describes the new contents as runs of those blocks and literal data
+namespace Delta {
+constexpr uint64_t min_block = 1024;
+constexpr uint64_t max_block = 1024 * 1024;
+
+// Weak checksum of a window that can be moved forward by one byte in constant time
+class RollingChecksum {
+public:
+    RollingChecksum(const uint8_t* data, size_t len);
+
+    // Moves the window, dropping out from its start and adding in at its end
+    void roll(uint8_t out, uint8_t in);
+
+    uint32_t value() const { return (_b << 16) | _a; }
+
+private:
+    uint32_t _a = 0;
+    uint32_t _b = 0;
+    uint32_t _len;
+};
+
+// Power of two around the square root of the size, keeps the signature small for large files
+uint64_t block_size_for(uint64_t size);
+
+BlockSigT signature(const uint8_t* data, size_t len);
+
+// Ops that turn the file with the signatures into data, base_size is the size of that file
+std::vector<DeltaOp> compute(const std::vector<BlockSigT>& sigs, uint64_t block_size, uint64_t base_size,
+                             const uint8_t* data, size_t len);
+} // namespace Delta
+
+#endif // DELTA_HPP
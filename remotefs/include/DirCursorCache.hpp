@@ -0,0 +1,47 @@
+#ifndef DIRCURSORCACHE_HPP
+#define DIRCURSORCACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <dirent.h>
+
+// Bounded LRU cache of open directory streams, keyed by path and the readdir cookie they are positioned at
+class DirCursorCache {
+public:
+    using DirT = std::unique_ptr<DIR, int (*)(DIR*)>;
+
+    // Like open(2), lets callers open relative to something other than the working directory
+    using OpenT = std::function<int(const std::filesystem::path& path, int flags, mode_t mode)>;
+
+    explicit DirCursorCache(size_t capacity, OpenT open = {});
+
+    // Removes a cached stream positioned at cookie and returns it, otherwise opens the directory and seeks to cookie
+    // Cookie 0 is the start of the directory, an empty pointer is returned if the directory couldn't be opened
+    DirT take(const std::filesystem::path& path, uint64_t cookie);
+
+    // Caches a stream to continue from cookie later
+    void put(const std::filesystem::path& path, uint64_t cookie, DirT dir);
+
+    void invalidate(const std::filesystem::path& path);
+
+    size_t size();
+
+private:
+    using KeyT = std::pair<std::string, uint64_t>;
+    using LruT = std::list<std::pair<KeyT, DirT>>;
+
+    size_t                         _capacity;
+    OpenT                          _open;
+    std::mutex                     _mutex;
+    LruT                           _lru;
+    std::map<KeyT, LruT::iterator> _map;
+};
+
+#endif // DIRCURSORCACHE_HPP
@@ -0,0 +1,116 @@
+#ifndef DISKCACHE_HPP
+#define DISKCACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FdCache.hpp"
+
+// Client cache of file blocks in a directory, keyed by path, that is kept across mounts
+// Blocks are appended to segment files, once they take more than the capacity the oldest segment is deleted whole,
+// blocks still read from it are appended again first
+// An index of the segments is written on sync, on startup it is read and only what was appended after it is scanned
+// Each block is stored with the version of the file it was read from, blocks of another version have to be
+// revalidated before use
+class DiskCache {
+public:
+    struct Version {
+        uint64_t size;
+        int64_t  mtime_sec;
+        int64_t  mtime_nsec;
+
+        bool operator==(const Version& rhs) const = default;
+    };
+
+    struct Block {
+        std::vector<uint8_t> data;
+        bool                 current; // Stored for the version asked for
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t stale_hits;
+        uint64_t misses;
+        uint64_t evictions; // Of segments
+        uint64_t bytes;
+    };
+
+    // An empty dir or a capacity of 0 disables it, throws if the directory can't be used
+    DiskCache(const std::filesystem::path& dir, size_t capacity, size_t block_size);
+    ~DiskCache();
+
+    bool   enabled() const { return _enabled; }
+    size_t block_size() const { return _block_size; }
+
+    // A stale block is only returned if its length fits the version asked for
+    std::optional<Block> get(const std::string& path, uint64_t block, const Version& version);
+    void                 put(const std::string& path, uint64_t block, const Version& version,
+                             const std::vector<uint8_t>& data);
+    // The contents of a stale block were found to be the same in this version
+    void revalidate(const std::string& path, uint64_t block, const Version& version);
+
+    void invalidate(const std::string& path);
+    // Drops path and everything under it
+    void invalidate_tree(const std::string& path);
+
+    // Writes the index
+    void sync();
+
+    Stats stats();
+
+    DiskCache(const DiskCache& other)            = delete;
+    DiskCache& operator=(const DiskCache& other) = delete;
+
+private:
+    struct Entry {
+        uint64_t segment;
+        uint64_t offset; // Of the data
+        uint64_t len;
+        uint64_t hash;
+        Version  version;
+    };
+
+    struct Segment {
+        std::shared_ptr<FdCache::File>                file;
+        uint64_t                                      size = 0;
+        std::vector<std::pair<std::string, uint64_t>> blocks; // Paths and blocks appended, possibly since replaced
+    };
+
+    using BlocksT = std::unordered_map<uint64_t, Entry>;
+
+    // Must be called with _mutex held
+    void load();
+    // Reads the records of a segment from an offset, cutting off a torn one at the end
+    void scan(uint64_t id, Segment& segment, uint64_t from);
+    void append(const std::string& path, uint64_t block, const Version& version, const uint8_t* data, size_t len);
+    void open_segment(uint64_t id);
+    void evict();
+    void write_index();
+
+    std::string segment_path(uint64_t id) const;
+
+    const std::filesystem::path _dir;
+    const size_t                _capacity;
+    const size_t                _block_size;
+    const size_t                _segment_size;
+    bool                        _enabled;
+
+    std::mutex                     _mutex;
+    std::map<std::string, BlocksT> _files;
+    std::map<uint64_t, Segment>    _segments; // Oldest first, the last one is appended to
+    uint64_t                       _bytes = 0;
+
+    uint64_t _hits       = 0;
+    uint64_t _stale_hits = 0;
+    uint64_t _misses     = 0;
+    uint64_t _evictions  = 0;
+};
+
+#endif // DISKCACHE_HPP
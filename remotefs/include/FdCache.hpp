@@ -0,0 +1,92 @@
+#ifndef FDCACHE_HPP
+#define FDCACHE_HPP
+
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "IoEngine.hpp"
+
+// Bounded LRU cache of open regular file descriptors, keyed by resolved path
+// Files are opened read-only until someone asks to write them, and reopened if the path now names another file
+class FdCache {
+public:
+    class File {
+    public:
+        File(int fd, bool writable, IoEngine& engine = buffered_engine());
+        ~File();
+
+        int   fd() const { return _fds.fd; }
+        bool  writable() const { return _writable; }
+        dev_t dev() const { return _dev; }
+        ino_t ino() const { return _ino; }
+        // Whether reads of the file may be cached and read ahead
+        bool cached() const { return _engine.cached(); }
+
+        // Read up to len bytes at off, stops early only at the end of file
+        ssize_t read(void* buf, size_t len, off_t off) const;
+        // Write len bytes at off, returns -1 if nothing could be written
+        ssize_t write(const void* buf, size_t len, off_t off) const;
+        // Copy len bytes at off to dst_off of dst inside the kernel, reflinking where the filesystem supports it
+        // Stops early only at the end of file, returns -1 if nothing could be copied
+        ssize_t copy_to(const File& dst, off_t off, off_t dst_off, size_t len) const;
+
+        File(const File& other)            = delete;
+        File& operator=(const File& other) = delete;
+
+    private:
+        IoFds     _fds;
+        bool      _writable;
+        IoEngine& _engine;
+        dev_t     _dev = 0;
+        ino_t     _ino = 0;
+    };
+
+    static IoEngine& buffered_engine();
+
+    // Like open(2), lets callers open relative to something other than the working directory
+    using OpenT = std::function<int(const std::filesystem::path& path, int flags, mode_t mode)>;
+
+    // Chooses how the data of the file at a path is accessed
+    using EngineT = std::function<IoEngine&(const std::filesystem::path& path)>;
+
+    // Like stat(2), resolving the path the same way OpenT does
+    using StatT = std::function<int(const std::filesystem::path& path, struct stat& buf)>;
+
+    explicit FdCache(size_t capacity, OpenT open = {}, EngineT engine = {}, StatT stat = {});
+
+    // Returns nullptr if path is not a regular file or could not be opened
+    // With write, the file is opened for writing if possible, it is read-only if that isn't permitted
+    // Evicted files stay open for as long as someone holds a reference to them
+    std::shared_ptr<File> get(const std::filesystem::path& path, bool write = false);
+
+    // Creates a new file with the exact mode, returns nullptr if it already exists or couldn't be created
+    std::shared_ptr<File> create(const std::filesystem::path& path, mode_t mode);
+
+    void invalidate(const std::filesystem::path& path);
+
+    size_t size();
+
+private:
+    using LruT = std::list<std::pair<std::string, std::shared_ptr<File>>>;
+
+    // Must be called with _mutex held
+    void insert(const std::string& key, std::shared_ptr<File> file);
+
+    size_t                                          _capacity;
+    OpenT                                           _open;
+    EngineT                                         _engine;
+    StatT                                           _stat;
+    std::mutex                                      _mutex;
+    LruT                                            _lru;
+    std::unordered_map<std::string, LruT::iterator> _map;
+};
+
+#endif // FDCACHE_HPP
@@ -0,0 +1,73 @@
+#ifndef FILEBUFFER_HPP
+#define FILEBUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+// Client-side cache of an open file while it holds a lease, in blocks fetched from the server
+// Writes only go to the cache until flush, the size of the file is tracked locally
+// Buffers can share a budget, a buffer that finds the budget exceeded writes back and forgets what it holds
+// Not thread safe, the caller locks
+class FileBuffer {
+public:
+    // Reads the given blocks from the server, a block can be shorter than block_size if the file ends in it
+    using FetchT = std::function<std::vector<std::vector<uint8_t>>(const std::vector<uint64_t>& blocks)>;
+    // Writes the given blocks back to the server
+    using StoreT = std::function<void(const std::vector<std::pair<uint64_t, const std::vector<uint8_t>*>>& blocks)>;
+
+    // Bytes held by all buffers sharing it
+    using BudgetT = std::shared_ptr<std::atomic<size_t>>;
+
+    // capacity is the size of the budget, a buffer without one has its own
+    FileBuffer(size_t block_size, size_t capacity, uint64_t size, FetchT fetch, StoreT store, BudgetT budget = {});
+    ~FileBuffer();
+
+    FileBuffer(FileBuffer&& other) noexcept;
+    FileBuffer(const FileBuffer& other)            = delete;
+    FileBuffer& operator=(const FileBuffer& other) = delete;
+
+    size_t read(char* buf, size_t len, uint64_t off);
+    void   write(const char* buf, size_t len, uint64_t off);
+
+    // Cuts or extends the cached file after it was truncated on the server
+    void truncate(uint64_t size);
+
+    // Writes back the dirty blocks, they stay dirty if storing throws
+    void flush();
+
+    uint64_t size() const { return _size; }
+    bool     dirty() const { return !_dirty.empty(); }
+    size_t   cached_bytes() const { return _bytes; }
+
+private:
+    // Fetches the blocks first..last that are not cached and inside the file
+    void fetch(uint64_t first, uint64_t last);
+
+    // Length a block should have for the current size
+    size_t block_len(uint64_t block) const;
+
+    // Writes back and forgets everything once the budget is exceeded
+    void shrink();
+
+    // Keep the budget in sync with _bytes
+    void add_bytes(size_t n);
+    void sub_bytes(size_t n);
+
+    const size_t _block_size;
+    const size_t _capacity;
+    const FetchT _fetch;
+    const StoreT _store;
+    BudgetT      _budget;
+
+    uint64_t                                 _size;
+    std::map<uint64_t, std::vector<uint8_t>> _blocks;
+    std::set<uint64_t>                       _dirty;
+    size_t                                   _bytes = 0;
+};
+
+#endif // FILEBUFFER_HPP
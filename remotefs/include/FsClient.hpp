@@ -10,6 +10,30 @@
 class FsClient {
 public:
     void run();
+
+    // Prints server counters
+    void stats();
+
+    // Copies a file inside the export on the server
+    void copy();
+
+    // Uploads a local file, sending only the blocks that differ from the copy in the export
+    void sync();
+
+    // Prints totals of a directory tree in the export, counted on the server
+    void du();
+
+    // Prints the attributes of everything in a directory tree in the export
+    void tree();
+
+    // Removes a file or a directory tree in the export with a single request
+    void remove();
+
+    // Prints the lines of files in a directory tree in the export that match a pattern, searched on the server
+    void search();
+
+    // Prints the digest of a file in the export computed on the server, and compares it to a local copy if given
+    void checksum();
 };
 
 
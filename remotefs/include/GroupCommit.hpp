@@ -0,0 +1,59 @@
+#ifndef GROUPCOMMIT_HPP
+#define GROUPCOMMIT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Makes files durable for many callers at once
+// While one group of syncs runs, the syncs that come in meanwhile wait and then run together as the next group,
+// a file in a group is synced once however many callers asked for it, and a group of several files is committed
+// with a single syncfs(2) per filesystem
+class GroupCommit {
+public:
+    struct Stats {
+        uint64_t requests;
+        uint64_t groups;
+    };
+
+    // Disabled, every caller syncs its own file right away
+    explicit GroupCommit(bool enabled);
+
+    // Like fsync(2) or fdatasync(2), returns 0 or a negated errno
+    // fd has to stay open until this returns
+    int sync(int fd, bool datasync);
+
+    Stats stats() const { return {_requests.load(), _groups.load()}; }
+
+private:
+    struct Entry {
+        int      fd;
+        bool     datasync;
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+        int      result = 0;
+    };
+
+    struct Group {
+        std::vector<Entry> entries;
+        bool               done = false;
+    };
+
+    // Syncs everything in the group and sets the results
+    static void commit(Group& group);
+
+    const bool _enabled;
+
+    std::mutex              _mutex;
+    std::condition_variable _cv;
+    std::shared_ptr<Group>  _next = std::make_shared<Group>();
+    bool                    _running = false;
+
+    std::atomic<uint64_t> _requests{0};
+    std::atomic<uint64_t> _groups{0};
+};
+
+#endif // GROUPCOMMIT_HPP
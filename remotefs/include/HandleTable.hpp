@@ -0,0 +1,46 @@
+#ifndef HANDLETABLE_HPP
+#define HANDLETABLE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "FdCache.hpp"
+#include "Options.h"
+#include "Readahead.hpp"
+
+// Files opened by clients, path resolution and ACL checks happen once when the handle is created
+// Every owner may only hold a limited number of handles, so a client can't exhaust the server's descriptors
+class HandleTable {
+public:
+    struct Entry {
+        int                            owner;
+        std::string                    path; // Relative to the export root, as sent by the client
+        std::shared_ptr<FdCache::File> file;
+        Readahead                      readahead{Options::get<size_t>("readahead_min"),
+                                                 Options::get<size_t>("readahead_max")};
+    };
+
+    // A limit of 0 means no limit
+    explicit HandleTable(size_t per_owner = 0);
+
+    // Returns 0 if the owner already holds as many handles as it may
+    uint64_t add(int owner, std::string path, std::shared_ptr<FdCache::File> file);
+
+    // Returns nullptr if the handle doesn't exist or belongs to another client
+    std::shared_ptr<Entry> get(int owner, uint64_t handle);
+
+    bool release(int owner, uint64_t handle);
+    void release_all(int owner);
+
+private:
+    const size_t                                         _per_owner;
+    std::mutex                                           _mutex;
+    uint64_t                                             _next_handle = 1;
+    std::unordered_map<uint64_t, std::shared_ptr<Entry>> _handles;
+    std::unordered_map<int, size_t>                      _counts;
+};
+
+#endif // HANDLETABLE_HPP
@@ -0,0 +1,121 @@
+#ifndef IOENGINE_HPP
+#define IOENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// Descriptors of an open file, direct is the one an engine opened for itself, -1 if it didn't
+struct IoFds {
+    int fd     = -1;
+    int direct = -1;
+};
+
+// How the data of open files is read and written
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+
+    // Opens what the engine needs besides fd, the result is closed with the file
+    virtual int open_direct(int /*fd*/) { return -1; }
+    // Whether the server should read ahead and keep blocks of the file in its caches
+    virtual bool cached() const = 0;
+
+    // Read up to len bytes at off, stops early only at the end of file
+    virtual ssize_t read(const IoFds& fds, void* buf, size_t len, off_t off) = 0;
+    // Write len bytes at off, returns -1 if nothing could be written
+    virtual ssize_t write(const IoFds& fds, const void* buf, size_t len, off_t off) = 0;
+};
+
+// Goes through the page cache
+class BufferedIo : public IoEngine {
+public:
+    bool cached() const override { return true; }
+
+    ssize_t read(const IoFds& fds, void* buf, size_t len, off_t off) override;
+    ssize_t write(const IoFds& fds, const void* buf, size_t len, off_t off) override;
+
+    static ssize_t pread_all(int fd, void* buf, size_t len, off_t off);
+    static ssize_t pwrite_all(int fd, const void* buf, size_t len, off_t off);
+};
+
+// Buffers aligned for O_DIRECT, kept around to be reused
+class AlignedPool {
+public:
+    static constexpr size_t alignment = 4096;
+
+    class Buffer {
+    public:
+        Buffer(AlignedPool& pool, uint8_t* data) : _pool(pool), _data(data) {}
+        ~Buffer() { _pool.put(_data); }
+
+        uint8_t* data() const { return _data; }
+
+        Buffer(const Buffer& other)            = delete;
+        Buffer& operator=(const Buffer& other) = delete;
+
+    private:
+        AlignedPool& _pool;
+        uint8_t*     _data;
+    };
+
+    // size is rounded up to the alignment, up to keep free buffers are kept
+    AlignedPool(size_t size, size_t keep);
+    ~AlignedPool();
+
+    Buffer get();
+    size_t size() const { return _size; }
+
+    AlignedPool(const AlignedPool& other)            = delete;
+    AlignedPool& operator=(const AlignedPool& other) = delete;
+
+private:
+    void put(uint8_t* data);
+
+    const size_t          _size;
+    const size_t          _keep;
+    std::mutex            _mutex;
+    std::vector<uint8_t*> _free;
+};
+
+// Bypasses the page cache for everything but the unaligned ends of writes, so streaming big files
+// doesn't evict what other users are working with
+// Falls back to the page cache for files on filesystems without O_DIRECT
+class DirectIo : public IoEngine {
+public:
+    DirectIo(size_t buffer_size, size_t keep_buffers) : _pool(buffer_size, keep_buffers) {}
+
+    int  open_direct(int fd) override;
+    bool cached() const override { return false; }
+
+    ssize_t read(const IoFds& fds, void* buf, size_t len, off_t off) override;
+    ssize_t write(const IoFds& fds, const void* buf, size_t len, off_t off) override;
+
+private:
+    AlignedPool _pool;
+};
+
+// Engines for parts of the export, chosen by the longest matching path prefix, buffered by default
+class IoEngines {
+public:
+    IoEngines(size_t buffer_size, size_t keep_buffers);
+
+    // Lines of <path prefix> <buffered or direct>
+    // Not thread safe, files opened before keep their engine
+    void load(const std::string& config);
+
+    IoEngine& for_path(const std::string& path);
+
+private:
+    std::shared_ptr<BufferedIo>                      _buffered;
+    std::shared_ptr<DirectIo>                        _direct;
+    std::map<std::string, std::shared_ptr<IoEngine>> _prefixes;
+};
+
+#endif // IOENGINE_HPP
@@ -0,0 +1,93 @@
+#ifndef LEASEMANAGER_HPP
+#define LEASEMANAGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Messages.hpp"
+
+// Leases let a client cache a file it is the only writer of (write) or that nobody writes (read)
+// Leases are held by handles, an access through another handle recalls the conflicting ones and waits for them
+// Writes through a handle whose lease was revoked are refused until it asks for a lease again or gives it up,
+// so what its owner buffered can't overwrite what others wrote after the revocation
+class LeaseManager {
+public:
+    struct Key {
+        uint64_t dev;
+        uint64_t ino;
+
+        bool operator==(const Key& rhs) const = default;
+    };
+
+    // Asks the owner of handle to write back what it buffered and return the lease
+    using RecallT = std::function<void(int owner, uint64_t handle)>;
+    // Runs the given wait for returned leases, so the caller can let others use its thread meanwhile
+    using WaitT = std::function<void(const std::function<void()>& wait)>;
+
+    // A zero timeout disables leases
+    LeaseManager(std::chrono::milliseconds recall_timeout, RecallT recall, WaitT wait = {});
+
+    bool enabled() const { return _recall_timeout.count() > 0; }
+    // Cheap check to skip looking up the file for every access when nothing is leased
+    bool active() const { return _count.load() > 0; }
+
+    // Grants wanted if no other handle holds a conflicting lease, otherwise recalls those and grants nothing
+    LeaseType acquire(int owner, uint64_t handle, const Key& key, LeaseType wanted);
+
+    // Recalls the leases of other handles that conflict with an access through handle, 0 for path operations
+    // Waits until they are returned, leases not returned in time are revoked
+    // Returns true if there were any, so what the caller looked at before may have changed
+    bool conflict(uint64_t handle, const Key& key, bool write);
+
+    // Whether the lease of handle was revoked and writes through it must be refused
+    bool revoked(uint64_t handle);
+
+    // Called when the lease is returned or the handle is closed
+    void release(uint64_t handle);
+    void release_all(int owner);
+
+    size_t size() const { return _count.load(); }
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<uint64_t>()(k.dev) ^ (std::hash<uint64_t>()(k.ino) * 31);
+        }
+    };
+
+    struct Lease {
+        int       owner;
+        uint64_t  handle;
+        LeaseType type;
+        bool      recalled = false;
+    };
+
+    using LeasesT = std::unordered_map<Key, std::vector<Lease>, KeyHash>;
+
+    static bool conflicts(const Lease& lease, uint64_t handle, bool write) {
+        return lease.handle != handle && (write || lease.type == LeaseType::WRITE);
+    }
+
+    // Must be called with the mutex held
+    void erase(LeasesT::iterator it, uint64_t handle);
+
+    const std::chrono::milliseconds _recall_timeout;
+    const RecallT                   _recall;
+    const WaitT                     _wait;
+
+    std::mutex                        _mutex;
+    std::condition_variable           _returned;
+    LeasesT                           _leases;
+    std::unordered_map<uint64_t, Key> _by_handle;
+    std::atomic<size_t>               _count{0};
+    // Owners of handles with revoked leases
+    std::unordered_map<uint64_t, int> _revoked;
+};
+
+#endif // LEASEMANAGER_HPP
@@ -13,6 +13,10 @@
 
 enum class FileType { NONE, DIRECTORY, REG_FILE, SYMLINK, END };
 
+enum class LeaseType { NONE, READ, WRITE, END };
+
+enum class ChecksumAlgorithm { SHA256, XXH64, END };
+
 #define LOGIN_REQ(FIELD)                                                                                               \
     FIELD(std::string, username)                                                                                       \
     FIELD(std::string, password)
@@ -20,11 +24,27 @@ DECLARE_SERIALIZABLE(LoginReq, LOGIN_REQ)
 DECLARE_SERIALIZABLE_END
 #undef LOGIN_REQ
 
-#define LOGIN_REPLY(FIELD)
+// notify is 1 if the server pushes InvalidateNotify for the directories the client looked at
+#define LOGIN_REPLY(FIELD) FIELD(int, notify)
 DECLARE_SERIALIZABLE(LoginReply, LOGIN_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef LOGIN_REPLY
 
+// Sent after login, the reply has the largest reads and writes the server agrees to, up to the ones asked for
+#define IO_SIZE_REQ(FIELD)                                                                                             \
+    FIELD(uint64_t, max_read)                                                                                          \
+    FIELD(uint64_t, max_write)
+DECLARE_SERIALIZABLE(IoSizeReq, IO_SIZE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef IO_SIZE_REQ
+
+#define IO_SIZE_REPLY(FIELD)                                                                                           \
+    FIELD(uint64_t, max_read)                                                                                          \
+    FIELD(uint64_t, max_write)
+DECLARE_SERIALIZABLE(IoSizeReply, IO_SIZE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef IO_SIZE_REPLY
+
 #define GETATTR_REQ(FIELD) FIELD(std::string, path)
 DECLARE_SERIALIZABLE(GetattrReq, GETATTR_REQ)
 DECLARE_SERIALIZABLE_END
@@ -34,46 +54,103 @@ DECLARE_SERIALIZABLE_END
     FIELD(FileType, type)                                                                                              \
     FIELD(uint64_t, mode)                                                                                              \
     FIELD(uint64_t, links)                                                                                             \
-    FIELD(uint64_t, size)
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(uint64_t, ino)                                                                                               \
+    FIELD(int64_t, mtime_sec)                                                                                          \
+    FIELD(int64_t, mtime_nsec)
 DECLARE_SERIALIZABLE(GetattrReply, GETATTR_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef GETATTR_REPLY
 
-#define READDIR_REQ(FIELD) FIELD(std::string, path)
+#define FGETATTR_REQ(FIELD) FIELD(uint64_t, handle)
+DECLARE_SERIALIZABLE(FgetattrReq, FGETATTR_REQ)
+DECLARE_SERIALIZABLE_END
+#undef FGETATTR_REQ
+
+// Lists up to count entries following cookie, 0 starts from the beginning of the directory
+#define READDIR_REQ(FIELD)                                                                                             \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, cookie)                                                                                            \
+    FIELD(uint64_t, count)
 DECLARE_SERIALIZABLE(ReaddirReq, READDIR_REQ)
 DECLARE_SERIALIZABLE_END
 #undef READDIR_REQ
 
-#define READDIR_REPLY(FIELD) FIELD(std::vector<std::string>, path)
+// Entry names, cookie continues after the last one
+#define READDIR_REPLY(FIELD)                                                                                           \
+    FIELD(std::vector<std::string>, names)                                                                             \
+    FIELD(uint64_t, cookie)                                                                                            \
+    FIELD(bool, eof)
 DECLARE_SERIALIZABLE(ReaddirReply, READDIR_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef READDIR_REPLY
 
-#define OPEN_REQ(FIELD) FIELD(std::string, path)
+#define READDIR_PLUS_REQ(FIELD)                                                                                        \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, cookie)                                                                                            \
+    FIELD(uint64_t, count)
+DECLARE_SERIALIZABLE(ReaddirPlusReq, READDIR_PLUS_REQ)
+DECLARE_SERIALIZABLE_END
+#undef READDIR_PLUS_REQ
+
+// Attributes of . and .. are not filled in, cookie continues after this entry
+#define DIR_ENTRY(FIELD)                                                                                               \
+    FIELD(std::string, name)                                                                                           \
+    FIELD(uint64_t, cookie)                                                                                            \
+    FIELD(FileType, type)                                                                                              \
+    FIELD(uint64_t, mode)                                                                                              \
+    FIELD(uint64_t, links)                                                                                             \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(uint64_t, ino)                                                                                               \
+    FIELD(int64_t, mtime_sec)                                                                                          \
+    FIELD(int64_t, mtime_nsec)
+DECLARE_SERIALIZABLE(DirEntry, DIR_ENTRY)
+DECLARE_SERIALIZABLE_END
+#undef DIR_ENTRY
+
+#define READDIR_PLUS_REPLY(FIELD)                                                                                      \
+    FIELD(std::vector<DirEntry>, entries)                                                                              \
+    FIELD(uint64_t, cookie)                                                                                            \
+    FIELD(bool, eof)
+DECLARE_SERIALIZABLE(ReaddirPlusReply, READDIR_PLUS_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef READDIR_PLUS_REPLY
+
+#define OPEN_REQ(FIELD)                                                                                                \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(bool, write)
 DECLARE_SERIALIZABLE(OpenReq, OPEN_REQ)
 DECLARE_SERIALIZABLE_END
 #undef OPEN_REQ
 
-#define OPEN_REPLY(FIELD) FIELD(int, ok)
+#define OPEN_REPLY(FIELD)                                                                                              \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, handle)
 DECLARE_SERIALIZABLE(OpenReply, OPEN_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef OPEN_REPLY
 
 #define READ_REQ(FIELD)                                                                                                \
-    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, handle)                                                                                            \
     FIELD(int64_t, off)                                                                                                \
     FIELD(uint64_t, len)
 DECLARE_SERIALIZABLE(ReadReq, READ_REQ)
 DECLARE_SERIALIZABLE_END
 #undef READ_REQ
 
-#define READ_REPLY(FIELD) FIELD(std::vector<uint8_t>, data)
+// Offset relative to the start of the read and length
+using ExtentT = std::pair<uint64_t, uint64_t>;
+
+// Data has only the bytes outside of holes, holes read as zeros
+#define READ_REPLY(FIELD)                                                                                              \
+    FIELD(std::vector<uint8_t>, data)                                                                                  \
+    FIELD(std::vector<ExtentT>, holes)
 DECLARE_SERIALIZABLE(ReadReply, READ_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef READ_REPLY
 
 #define WRITE_REQ(FIELD)                                                                                               \
-    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, handle)                                                                                            \
     FIELD(int64_t, off)                                                                                                \
     FIELD(uint64_t, len)                                                                                               \
     FIELD(std::vector<uint8_t>, data)
@@ -86,6 +163,22 @@ DECLARE_SERIALIZABLE(WriteReply, WRITE_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef WRITE_REPLY
 
+// Mode takes the flags of fallocate(2)
+#define FALLOCATE_REQ(FIELD)                                                                                           \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(int, mode)                                                                                                   \
+    FIELD(int64_t, off)                                                                                                \
+    FIELD(int64_t, len)
+DECLARE_SERIALIZABLE(FallocateReq, FALLOCATE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef FALLOCATE_REQ
+
+// 0 or a negated errno, so callers can tell an unsupported mode apart
+#define FALLOCATE_REPLY(FIELD) FIELD(int, ok)
+DECLARE_SERIALIZABLE(FallocateReply, FALLOCATE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef FALLOCATE_REPLY
+
 #define CREATE_REQ(FIELD)                                                                                              \
     FIELD(std::string, path)                                                                                           \
     FIELD(int, mode)
@@ -93,7 +186,9 @@ DECLARE_SERIALIZABLE(CreateReq, CREATE_REQ)
 DECLARE_SERIALIZABLE_END
 #undef CREATE_REQ
 
-#define CREATE_REPLY(FIELD) FIELD(int, ok)
+#define CREATE_REPLY(FIELD)                                                                                            \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, handle)
 DECLARE_SERIALIZABLE(CreateReply, CREATE_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef CREATE_REPLY
@@ -154,6 +249,119 @@ DECLARE_SERIALIZABLE(TruncateReply, TRUNCATE_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef TRUNCATE_REPLY
 
+#define FTRUNCATE_REQ(FIELD)                                                                                           \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(long, size)
+DECLARE_SERIALIZABLE(FtruncateReq, FTRUNCATE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef FTRUNCATE_REQ
+
+#define RELEASE_REQ(FIELD) FIELD(uint64_t, handle)
+DECLARE_SERIALIZABLE(ReleaseReq, RELEASE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef RELEASE_REQ
+
+#define RELEASE_REPLY(FIELD) FIELD(int, ok)
+DECLARE_SERIALIZABLE(ReleaseReply, RELEASE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef RELEASE_REPLY
+
+// Makes what was written through the handle durable, only the data and the size if datasync is set
+#define FSYNC_REQ(FIELD)                                                                                               \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(bool, datasync)
+DECLARE_SERIALIZABLE(FsyncReq, FSYNC_REQ)
+DECLARE_SERIALIZABLE_END
+#undef FSYNC_REQ
+
+// 0 or a negated errno
+#define FSYNC_REPLY(FIELD) FIELD(int, ok)
+DECLARE_SERIALIZABLE(FsyncReply, FSYNC_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef FSYNC_REPLY
+
+// Copies on the server between two open files, without the data crossing the network
+#define COPY_RANGE_REQ(FIELD)                                                                                          \
+    FIELD(uint64_t, src_handle)                                                                                        \
+    FIELD(int64_t, src_off)                                                                                            \
+    FIELD(uint64_t, dst_handle)                                                                                        \
+    FIELD(int64_t, dst_off)                                                                                            \
+    FIELD(uint64_t, len)
+DECLARE_SERIALIZABLE(CopyRangeReq, COPY_RANGE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef COPY_RANGE_REQ
+
+// Bytes copied, shorter than requested only at the end of the source, -1 on error
+#define COPY_RANGE_REPLY(FIELD) FIELD(int64_t, len)
+DECLARE_SERIALIZABLE(CopyRangeReply, COPY_RANGE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef COPY_RANGE_REPLY
+
+// Weak rolling checksum and SHA-256 of a block
+using BlockSigT = std::pair<uint32_t, std::string>;
+
+// Signatures of the blocks of an open file, block size 0 lets the server pick one
+#define SIGNATURE_REQ(FIELD)                                                                                           \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(uint64_t, block_size)
+DECLARE_SERIALIZABLE(SignatureReq, SIGNATURE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef SIGNATURE_REQ
+
+#define SIGNATURE_REPLY(FIELD)                                                                                         \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, block_size)                                                                                        \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(std::vector<BlockSigT>, blocks)
+DECLARE_SERIALIZABLE(SignatureReply, SIGNATURE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef SIGNATURE_REPLY
+
+// Copies copy_count blocks starting at copy_block of the source, then appends data
+#define DELTA_OP(FIELD)                                                                                                \
+    FIELD(uint64_t, copy_block)                                                                                        \
+    FIELD(uint64_t, copy_count)                                                                                        \
+    FIELD(std::vector<uint8_t>, data)
+DECLARE_SERIALIZABLE(DeltaOp, DELTA_OP)
+DECLARE_SERIALIZABLE_END
+#undef DELTA_OP
+
+// Writes the result of the ops at dst_off of the destination, the source can be omitted if nothing is copied
+#define DELTA_REQ(FIELD)                                                                                               \
+    FIELD(uint64_t, src_handle)                                                                                        \
+    FIELD(uint64_t, dst_handle)                                                                                        \
+    FIELD(int64_t, dst_off)                                                                                            \
+    FIELD(uint64_t, block_size)                                                                                        \
+    FIELD(std::vector<DeltaOp>, ops)
+DECLARE_SERIALIZABLE(DeltaReq, DELTA_REQ)
+DECLARE_SERIALIZABLE_END
+#undef DELTA_REQ
+
+// Bytes written, -1 on error
+#define DELTA_REPLY(FIELD) FIELD(int64_t, len)
+DECLARE_SERIALIZABLE(DeltaReply, DELTA_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef DELTA_REPLY
+
+// SHA-256 of the blocks of an open file overlapping [off, off + len), blocks are aligned to the reply's block size
+#define READ_HASHES_REQ(FIELD)                                                                                         \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(int64_t, off)                                                                                                \
+    FIELD(uint64_t, len)
+DECLARE_SERIALIZABLE(ReadHashesReq, READ_HASHES_REQ)
+DECLARE_SERIALIZABLE_END
+#undef READ_HASHES_REQ
+
+// Hashes start at block off / block_size, the last block is shorter at the end of file
+#define READ_HASHES_REPLY(FIELD)                                                                                       \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, block_size)                                                                                        \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(std::vector<std::string>, hashes)
+DECLARE_SERIALIZABLE(ReadHashesReply, READ_HASHES_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef READ_HASHES_REPLY
+
 #define RENAME_REQ(FIELD)                                                                                              \
     FIELD(std::string, path)                                                                                           \
     FIELD(std::string, newPath)
@@ -211,6 +419,179 @@ DECLARE_SERIALIZABLE(KeepAliveReply, KEEPALIVE_REPLY)
 DECLARE_SERIALIZABLE_END
 #undef KEEPALIVE_REPLY
 
+#define STATS_REQ(FIELD)
+DECLARE_SERIALIZABLE(StatsReq, STATS_REQ)
+DECLARE_SERIALIZABLE_END
+#undef STATS_REQ
+
+using CounterT = std::pair<std::string, uint64_t>;
+
+#define STATS_REPLY(FIELD) FIELD(std::vector<CounterT>, counters)
+DECLARE_SERIALIZABLE(StatsReply, STATS_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef STATS_REPLY
+
+// Each op is a serialized AnyMsgT, run in order until the first one that fails
+// A handle of 0 refers to the file opened or created by an earlier op of the same compound
+#define COMPOUND_REQ(FIELD) FIELD(std::vector<std::vector<uint8_t>>, ops)
+DECLARE_SERIALIZABLE(CompoundReq, COMPOUND_REQ)
+DECLARE_SERIALIZABLE_END
+#undef COMPOUND_REQ
+
+// One serialized AnyMsgT per executed op, the last one is the reply of the failed op if any
+#define COMPOUND_REPLY(FIELD) FIELD(std::vector<std::vector<uint8_t>>, replies)
+DECLARE_SERIALIZABLE(CompoundReply, COMPOUND_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef COMPOUND_REPLY
+
+// Totals of everything below a directory, counted on the server
+#define TREE_SUMMARY_REQ(FIELD) FIELD(std::string, path)
+DECLARE_SERIALIZABLE(TreeSummaryReq, TREE_SUMMARY_REQ)
+DECLARE_SERIALIZABLE_END
+#undef TREE_SUMMARY_REQ
+
+// Denied counts entries skipped with everything below them because the ACL doesn't allow them
+#define TREE_SUMMARY_REPLY(FIELD)                                                                                      \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, files)                                                                                             \
+    FIELD(uint64_t, dirs)                                                                                              \
+    FIELD(uint64_t, bytes)                                                                                             \
+    FIELD(uint64_t, allocated)                                                                                         \
+    FIELD(uint64_t, denied)                                                                                            \
+    FIELD(uint64_t, errors)
+DECLARE_SERIALIZABLE(TreeSummaryReply, TREE_SUMMARY_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef TREE_SUMMARY_REPLY
+
+// Attributes of up to count entries below a directory, depth first with names sorted bytewise
+// after is the path of the last entry of the previous page, empty to start from the beginning
+#define TREE_STAT_REQ(FIELD)                                                                                           \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(std::string, after)                                                                                          \
+    FIELD(uint64_t, count)
+DECLARE_SERIALIZABLE(TreeStatReq, TREE_STAT_REQ)
+DECLARE_SERIALIZABLE_END
+#undef TREE_STAT_REQ
+
+#define TREE_ENTRY(FIELD)                                                                                              \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(FileType, type)                                                                                              \
+    FIELD(uint64_t, mode)                                                                                              \
+    FIELD(uint64_t, links)                                                                                             \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(uint64_t, ino)                                                                                               \
+    FIELD(int64_t, mtime_sec)                                                                                          \
+    FIELD(int64_t, mtime_nsec)
+DECLARE_SERIALIZABLE(TreeEntry, TREE_ENTRY)
+DECLARE_SERIALIZABLE_END
+#undef TREE_ENTRY
+
+// Entries the ACL doesn't allow are left out with everything below them
+#define TREE_STAT_REPLY(FIELD)                                                                                         \
+    FIELD(std::vector<TreeEntry>, entries)                                                                             \
+    FIELD(bool, eof)
+DECLARE_SERIALIZABLE(TreeStatReply, TREE_STAT_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef TREE_STAT_REPLY
+
+// Removes a file, or a directory with everything below it
+#define TREE_REMOVE_REQ(FIELD) FIELD(std::string, path)
+DECLARE_SERIALIZABLE(TreeRemoveReq, TREE_REMOVE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef TREE_REMOVE_REQ
+
+// ok is 0 if everything was removed, denied entries and the directories above them are kept
+#define TREE_REMOVE_REPLY(FIELD)                                                                                       \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, removed)                                                                                           \
+    FIELD(uint64_t, denied)                                                                                            \
+    FIELD(uint64_t, errors)
+DECLARE_SERIALIZABLE(TreeRemoveReply, TREE_REMOVE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef TREE_REMOVE_REPLY
+
+// Lines of regular files below path containing pattern, or matching it as an extended regex
+// glob filters the files by name, or by their path relative to path if it contains a slash, empty is all files
+// Continues in the file after, at lines starting from after_off, then with the files after it
+#define SEARCH_REQ(FIELD)                                                                                              \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(std::string, glob)                                                                                           \
+    FIELD(std::string, pattern)                                                                                        \
+    FIELD(bool, regex)                                                                                                 \
+    FIELD(std::string, after)                                                                                          \
+    FIELD(uint64_t, after_off)                                                                                         \
+    FIELD(uint64_t, count)
+DECLARE_SERIALIZABLE(SearchReq, SEARCH_REQ)
+DECLARE_SERIALIZABLE_END
+#undef SEARCH_REQ
+
+#define SEARCH_MATCH(FIELD)                                                                                            \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, offset)                                                                                            \
+    FIELD(uint64_t, line)                                                                                              \
+    FIELD(std::string, text)
+DECLARE_SERIALIZABLE(SearchMatch, SEARCH_MATCH)
+DECLARE_SERIALIZABLE_END
+#undef SEARCH_MATCH
+
+// eof is set if there are no more matches after these
+#define SEARCH_REPLY(FIELD)                                                                                            \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(std::vector<SearchMatch>, matches)                                                                           \
+    FIELD(bool, eof)
+DECLARE_SERIALIZABLE(SearchReply, SEARCH_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef SEARCH_REPLY
+
+// Digest of len bytes of a regular file at off, up to its end, hashed in chunk_size chunks
+// A range longer than a chunk hashes to the digest of its chunks' digests
+#define CHECKSUM_REQ(FIELD)                                                                                            \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, off)                                                                                               \
+    FIELD(uint64_t, len)                                                                                               \
+    FIELD(ChecksumAlgorithm, algorithm)
+DECLARE_SERIALIZABLE(ChecksumReq, CHECKSUM_REQ)
+DECLARE_SERIALIZABLE_END
+#undef CHECKSUM_REQ
+
+// len is the number of bytes hashed, digest is raw
+#define CHECKSUM_REPLY(FIELD)                                                                                          \
+    FIELD(int, ok)                                                                                                     \
+    FIELD(uint64_t, len)                                                                                               \
+    FIELD(uint64_t, chunk_size)                                                                                        \
+    FIELD(std::string, digest)
+DECLARE_SERIALIZABLE(ChecksumReply, CHECKSUM_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef CHECKSUM_REPLY
+
+// Asks for a lease on an open file, NONE returns the lease held
+#define LEASE_REQ(FIELD)                                                                                               \
+    FIELD(uint64_t, handle)                                                                                            \
+    FIELD(LeaseType, type)
+DECLARE_SERIALIZABLE(LeaseReq, LEASE_REQ)
+DECLARE_SERIALIZABLE_END
+#undef LEASE_REQ
+
+// The lease granted, NONE if another handle holds a conflicting one
+#define LEASE_REPLY(FIELD) FIELD(LeaseType, type)
+DECLARE_SERIALIZABLE(LeaseReply, LEASE_REPLY)
+DECLARE_SERIALIZABLE_END
+#undef LEASE_REPLY
+
+// Pushed by the server when another handle wants to access the file, the lease should be returned with a LeaseReq
+#define LEASE_RECALL_NOTIFY(FIELD) FIELD(uint64_t, handle)
+DECLARE_SERIALIZABLE(LeaseRecallNotify, LEASE_RECALL_NOTIFY)
+DECLARE_SERIALIZABLE_END
+#undef LEASE_RECALL_NOTIFY
+
+// Pushed by the server on its own: paths that changed, and directories whose whole subtree may have, "/" for all
+#define INVALIDATE_NOTIFY(FIELD)                                                                                       \
+    FIELD(std::vector<std::string>, paths)                                                                             \
+    FIELD(std::vector<std::string>, trees)
+DECLARE_SERIALIZABLE(InvalidateNotify, INVALIDATE_NOTIFY)
+DECLARE_SERIALIZABLE_END
+#undef INVALIDATE_NOTIFY
+
 #define ERROR_REPLY(FIELD) FIELD(std::string, error)
 DECLARE_SERIALIZABLE(ErrorReply, ERROR_REPLY)
 DECLARE_SERIALIZABLE_END
@@ -220,6 +601,13 @@ using AnyMsgT = std::variant<ErrorReply, KeepAliveReq, KeepAliveReply, LoginReq,
                              ReaddirReq, ReaddirReply, OpenReq, OpenReply, ReadReq, ReadReply, WriteReq, WriteReply,
                              CreateReq, CreateReply, MkdirReq, MkdirReply, RmdirReq, RmdirReply, UnlinkReq, UnlinkReply,
                              TruncateReq, TruncateReply, RenameReq, RenameReply, UTimensReq, UTimensReply, StatfsReply,
-                             StatfsReq, ChmodReq, ChmodReply>;
+                             StatfsReq, ChmodReq, ChmodReply, FgetattrReq, FtruncateReq, ReleaseReq, ReleaseReply,
+                             StatsReq, StatsReply, ReaddirPlusReq, ReaddirPlusReply, CompoundReq, CompoundReply,
+                             CopyRangeReq, CopyRangeReply, FallocateReq, FallocateReply, SignatureReq,
+                             SignatureReply, DeltaReq, DeltaReply, ReadHashesReq, ReadHashesReply,
+                             InvalidateNotify, LeaseReq, LeaseReply, LeaseRecallNotify, TreeSummaryReq,
+                             TreeSummaryReply, TreeStatReq, TreeStatReply, TreeRemoveReq, TreeRemoveReply,
+                             IoSizeReq, IoSizeReply, SearchReq, SearchReply, ChecksumReq, ChecksumReply,
+                             FsyncReq, FsyncReply>;
 
 #endif // MESSAGES_HPP
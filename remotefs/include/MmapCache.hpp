@@ -0,0 +1,90 @@
+#ifndef MMAPCACHE_HPP
+#define MMAPCACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+// Bounded LRU of read-only shared mappings of small files, keyed by (device, inode)
+// A mapping is used only while the file's mtime and size are the ones it was mapped with and it still has links,
+// writes in place show through it anyway, as it maps the page cache
+// Reads go through copy(), which fails instead of raising SIGBUS if the file shrinks meanwhile
+// Entries of files unlinked behind the server's back keep the inode alive until evicted
+class MmapCache {
+public:
+    class Mapping {
+    public:
+        Mapping(const uint8_t* data, size_t size, const struct stat& st);
+        ~Mapping();
+
+        const uint8_t* data() const { return _data; }
+        size_t         size() const { return _size; }
+
+        // Copies [from, from + len) of the mapping to out, false if the file was truncated under it
+        bool copy(size_t from, size_t len, uint8_t* out) const;
+        bool           valid(const struct stat& st) const;
+
+        Mapping(const Mapping& other)            = delete;
+        Mapping& operator=(const Mapping& other) = delete;
+
+    private:
+        const uint8_t* _data;
+        size_t         _size;
+        int64_t        _mtime_sec;
+        int64_t        _mtime_nsec;
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t entries;
+    };
+
+    using MappingT = std::shared_ptr<const Mapping>;
+
+    // Files larger than max_file_size or empty aren't mapped, a capacity of 0 disables the cache
+    MmapCache(size_t capacity, size_t max_file_size);
+
+    bool enabled() const { return _capacity > 0; }
+
+    // Returns the mapping of the open file described by st, mapping it if needed, or nullptr if it isn't mapped
+    // Unmapped once evicted and no longer used
+    MappingT get(int fd, const struct stat& st);
+
+    void invalidate(uint64_t dev, uint64_t ino);
+
+    Stats stats();
+
+private:
+    struct Key {
+        uint64_t dev;
+        uint64_t ino;
+
+        bool operator==(const Key& rhs) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<uint64_t>()(k.dev) ^ (std::hash<uint64_t>()(k.ino) * 31);
+        }
+    };
+
+    using LruT = std::list<std::pair<Key, MappingT>>;
+
+    const size_t _capacity;
+    const size_t _max_file_size;
+
+    std::mutex                                       _mutex;
+    LruT                                             _lru;
+    std::unordered_map<Key, LruT::iterator, KeyHash> _map;
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+};
+
+#endif // MMAPCACHE_HPP
@@ -0,0 +1,101 @@
+#ifndef PAGECACHE_HPP
+#define PAGECACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Client-side LRU cache of file data in blocks, keyed by path
+// The blocks of a file are kept for one version of it, its mtime and size, seeing another one drops them,
+// unless it's the version the server reported right after a local write, which the blocks were patched with
+// A file is forgotten together with its last block
+class PageCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t bytes;
+        uint64_t files;
+    };
+
+    using BlockT = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // A capacity of 0 disables it
+    PageCache(size_t capacity, size_t block_size);
+
+    bool   enabled() const { return _capacity > 0; }
+    size_t block_size() const { return _block_size; }
+
+    // Drops the blocks of the file unless they belong to this version of it
+    // Returns a token for put, which skips blocks read before the file changed locally
+    uint64_t validate(const std::string& path, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec);
+
+    // Null if the block isn't cached, blocks shorter than block_size end the file
+    BlockT get(const std::string& path, uint64_t block);
+    void   put(const std::string& path, uint64_t block, BlockT data, uint64_t token);
+
+    // Applies a local write to the cached blocks
+    void write(const std::string& path, const char* buf, size_t len, uint64_t off);
+    // The version of the file the server reported right after the last write, validate keeps the blocks for it
+    void wrote(const std::string& path, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec);
+
+    void invalidate(const std::string& path);
+    // Drops path and everything under it
+    void invalidate_tree(const std::string& path);
+
+    Stats stats();
+
+private:
+    struct Version {
+        uint64_t size;
+        int64_t  mtime_sec;
+        int64_t  mtime_nsec;
+
+        bool operator==(const Version& rhs) const = default;
+    };
+
+    struct LruEntry;
+    using LruT = std::list<LruEntry>;
+
+    struct File {
+        std::optional<Version>                       version;
+        std::optional<Version>                       written;   // Of the last local write, if the server told it
+        uint64_t                                     size  = 0; // Including local writes
+        uint64_t                                     token = 0;
+        std::unordered_map<uint64_t, LruT::iterator> blocks;
+    };
+
+    using FilesT = std::map<std::string, File>;
+
+    struct LruEntry {
+        FilesT::iterator file;
+        uint64_t         block;
+        BlockT           data;
+    };
+
+    // Must be called with _mutex held
+    void drop_blocks(File& file);
+    void erase(FilesT::iterator it);
+
+    const size_t _capacity;
+    const size_t _block_size;
+
+    std::mutex _mutex;
+    FilesT     _files;
+    LruT       _lru; // Most recently used first
+    uint64_t   _next_token = 0;
+
+    uint64_t _bytes     = 0;
+    uint64_t _hits      = 0;
+    uint64_t _misses    = 0;
+    uint64_t _evictions = 0;
+};
+
+#endif // PAGECACHE_HPP
@@ -0,0 +1,84 @@
+#ifndef PATHRESOLVER_HPP
+#define PATHRESOLVER_HPP
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Resolves client paths relative to cached open directories of the export, never leaving the export root
+// Lookups from cached directories don't follow symlinks, paths with symlinks are resolved again from the root
+// Directories renamed or replaced behind the server's back stay cached until evicted or invalidated
+class PathResolver {
+public:
+    class Dir {
+    public:
+        explicit Dir(int fd) : _fd(fd) {}
+        ~Dir();
+
+        int fd() const { return _fd; }
+
+        Dir(const Dir& other)            = delete;
+        Dir& operator=(const Dir& other) = delete;
+
+    private:
+        int _fd;
+    };
+
+    // The directory containing a path and the name of the path inside it, for use with *at calls
+    struct Entry {
+        std::shared_ptr<const Dir> dir;
+        std::string                name;
+
+        int         dir_fd() const { return dir->fd(); }
+        const char* c_name() const { return name.c_str(); }
+    };
+
+    PathResolver(const std::filesystem::path& root, size_t capacity);
+
+    // Throws if the path is malformed or its parent directory can't be opened
+    Entry resolve(const std::string& path);
+
+    // Like open(2), symlinks can't lead outside of the root, returns -1 and sets errno on error
+    int open(const std::string& path, int flags, mode_t mode = 0);
+
+    // Like stat(2) with a single statx call, returns -1 and sets errno on error
+    int stat(const std::string& path, struct stat& buf);
+
+    // Like stat, for a name inside the already opened directory at dir_path
+    int stat_at(const std::string& dir_path, int dir_fd, const char* name, struct stat& buf);
+
+    // Drops the directory at path and everything cached below it
+    void invalidate(const std::string& path);
+
+    size_t size();
+
+private:
+    using LruT = std::list<std::pair<std::string, std::shared_ptr<const Dir>>>;
+
+    // Opens the directory at a root relative path, "" is the root itself, nullptr and errno on error
+    std::shared_ptr<const Dir> get_dir(const std::string& rel);
+
+    // Opens rest relative to dir_fd if that needs no symlinks, otherwise the root relative rel from the root
+    int open_from(int dir_fd, const std::string& rest, const std::string& rel, int flags, mode_t mode);
+
+    // Stats name inside dir_fd, rel is its root relative path used to follow a symlink
+    int stat_rel(int dir_fd, const char* name, const std::string& rel, struct stat& buf);
+
+    // Sets errno on error, rel is set to the root relative path
+    std::optional<Entry> try_resolve(const std::string& path, std::string* rel = nullptr);
+
+    std::shared_ptr<const Dir>                      _root;
+    size_t                                          _capacity;
+    std::mutex                                      _mutex;
+    LruT                                            _lru;
+    std::unordered_map<std::string, LruT::iterator> _map;
+};
+
+#endif // PATHRESOLVER_HPP
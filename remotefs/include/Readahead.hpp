@@ -0,0 +1,33 @@
+#ifndef READAHEAD_HPP
+#define READAHEAD_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+#include <sys/types.h>
+
+// Tracks the access pattern of a single open file and decides what to prefetch
+// The window starts at min_window once a sequential stream is detected, doubles every time
+// the reader catches up with it, up to max_window, and is dropped on a random access
+class Readahead {
+public:
+    Readahead(size_t min_window, size_t max_window) : _min_window(min_window), _max_window(max_window) {}
+
+    // Returns the range that should be prefetched after a read of len bytes at off,
+    // length is 0 if nothing should be prefetched
+    std::pair<off_t, size_t> on_read(off_t off, size_t len);
+
+    size_t window() const { return _window; }
+
+private:
+    const size_t _min_window;
+    const size_t _max_window;
+
+    std::mutex _mutex;
+    off_t      _next_off  = 0; // Where the next read starts if the access is sequential
+    off_t      _ahead_end = 0; // End of what was already prefetched
+    size_t     _window    = 0;
+};
+
+#endif // READAHEAD_HPP
@@ -0,0 +1,61 @@
+#ifndef SEARCHER_HPP
+#define SEARCHER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+// Finds a fixed string, comparing 16 candidate positions at a time by their first and last bytes
+class LiteralMatcher {
+public:
+    explicit LiteralMatcher(std::string needle) : _needle(std::move(needle)) {}
+
+    // First occurrence in [begin, end), or nullptr
+    const char* find(const char* begin, const char* end) const;
+
+private:
+    std::string _needle;
+};
+
+// Searches files line by line for a literal or an extended regular expression, like grep
+// Files with a zero byte in their first chunk are taken to be binary and skipped
+class Searcher {
+public:
+    struct Match {
+        std::string path;
+        uint64_t    offset; // Of the start of the line
+        uint64_t    line;   // Starting from 1
+        std::string text;   // Without the newline, cut at max_text
+    };
+
+    // Opens a file for reading, returns -1 on failure
+    using OpenT = std::function<int(const std::string& path)>;
+
+    static constexpr size_t max_text = 4096;
+
+    // Throws if the pattern is empty, spans lines or isn't a valid regex
+    Searcher(const std::string& pattern, bool regex, size_t threads);
+
+    // Matching lines of the files in order, up to max of them
+    // In the first file, lines starting before first_from are skipped, to continue where a previous search stopped
+    // Files are searched by several threads
+    std::vector<Match> search(const std::vector<std::string>& paths, uint64_t first_from, size_t max,
+                              const OpenT& open) const;
+
+    // Up to max matching lines of an open file starting at or after from
+    std::vector<Match> search_fd(int fd, const std::string& path, uint64_t from, size_t max) const;
+
+private:
+    // Calls fn(line begin, line end) for matching lines in [begin, end) until it returns false
+    template<typename F>
+    void matching_lines(const char* begin, const char* end, F fn) const;
+
+    std::optional<LiteralMatcher> _literal;
+    std::optional<std::regex>     _regex;
+    const size_t                  _threads;
+};
+
+#endif // SEARCHER_HPP
@@ -0,0 +1,65 @@
+#ifndef TREEWALKER_HPP
+#define TREEWALKER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// Walks directory trees relative to an open directory, never following symlinks
+// Paths passed to the callbacks are the directory's path joined with the names below it
+class TreeWalker {
+public:
+    struct Totals {
+        uint64_t files     = 0; // Everything that isn't a directory
+        uint64_t dirs      = 0;
+        uint64_t bytes     = 0;
+        uint64_t allocated = 0;
+        uint64_t denied    = 0; // Entries skipped because allow returned false, with everything under them
+        uint64_t errors    = 0;
+    };
+
+    // Called for every entry before looking at it or below it, from several threads at once
+    using AllowT = std::function<bool(const std::string& path)>;
+    using VisitT = std::function<void(const std::string& path, const struct stat& st)>;
+
+    explicit TreeWalker(size_t threads) : _threads(std::max<size_t>(threads, 1)) {}
+
+    // Totals of everything below the directory, directories are walked by several threads
+    Totals summarize(int dir_fd, const std::string& path, const AllowT& allow);
+
+    // Removes everything below the directory, the directory itself stays, totals are of what was removed
+    // removed is called from several threads just before an entry is removed, directories after their contents
+    Totals remove(int dir_fd, const std::string& path, const AllowT& allow, const VisitT& removed);
+
+    // Calls fn for up to count entries below the directory, in depth first order with names sorted bytewise
+    // Continues after the path the previous call ended with, or from the start if after is empty
+    // Returns true if there is nothing left after the last entry
+    bool list(int dir_fd, const std::string& path, const std::string& after, size_t count, const AllowT& allow,
+              const VisitT& fn);
+
+    static std::string join(const std::string& path, const std::string& name) {
+        return path.ends_with('/') ? path + name : path + "/" + name;
+    }
+
+private:
+    struct Walk;
+    struct Node;
+
+    // Walks with several threads, removing everything as it goes if state.removed is set
+    void        walk(Walk& state, int dir_fd, const std::string& path);
+    static void list_node(Walk& walk, const std::shared_ptr<Node>& node);
+    // Marks the node done, and its parents if it was the last thing they were waiting for
+    static void finish(Walk& walk, std::shared_ptr<Node> node);
+
+    bool list_dir(int fd, const std::string& path, const std::vector<std::string>& after, size_t depth, bool resume,
+                  size_t& left, const AllowT& allow, const VisitT& fn);
+
+    const size_t _threads;
+};
+
+#endif // TREEWALKER_HPP
@@ -0,0 +1,115 @@
+#ifndef WRITEBACK_HPP
+#define WRITEBACK_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Client-side write-back of open files that aren't cached under a lease
+// Writes are kept as ranges of dirty data per file and sent by a few background threads, adjacent and overlapping
+// writes are merged first, so small writes go out as large ones
+// A range is sent once it's max_store bytes long, once the file's oldest dirty data is delay old, or right away
+// when someone waits for the file or too much is pending
+// Like with fsync(2), a failed background write is reported by the next sync of its file
+class WriteBack {
+public:
+    // Writes data at off through the handle of the file opened at path, throws if it couldn't all be written
+    using StoreT = std::function<void(uint64_t handle, const std::string& path, uint64_t off,
+                                      const std::vector<uint8_t>& data)>;
+
+    // What the server doesn't know yet about files opened at a path
+    struct Dirty {
+        uint64_t                              end;     // End of the furthest data not yet sent
+        std::chrono::system_clock::time_point written; // When it was last written to
+    };
+
+    // A capacity of 0 disables it and starts no threads, writes should then be sent directly
+    WriteBack(size_t capacity, size_t threads, std::chrono::milliseconds delay, size_t max_store, StoreT store);
+    // Sends everything still pending
+    ~WriteBack();
+
+    bool enabled() const { return _capacity > 0; }
+
+    // Copies the data into the dirty ranges of the file opened at path, blocks while more than capacity bytes
+    // are pending
+    void write(uint64_t handle, const std::string& path, const char* buf, size_t len, uint64_t off);
+
+    // Waits until what was written to the file has been sent, errors are kept for sync
+    void drain(uint64_t handle);
+    // Same for every file opened at path
+    void drain_path(const std::string& path);
+
+    // Lets attributes account for pending writes without waiting for them, nullopt if nothing is pending
+    std::optional<Dirty> dirty(const std::string& path);
+
+    // Waits like drain, then throws the first error since the last sync of the file
+    void sync(uint64_t handle);
+
+    // Syncs and forgets the file
+    void release(uint64_t handle);
+
+    void rename(const std::string& from, const std::string& to);
+
+    // Bytes written but not yet sent
+    size_t pending();
+
+    WriteBack(const WriteBack& other)            = delete;
+    WriteBack& operator=(const WriteBack& other) = delete;
+
+private:
+    // Dirty data by offset, the ranges don't overlap or touch
+    using RangesT = std::map<uint64_t, std::vector<uint8_t>>;
+
+    struct File {
+        std::string                                path;
+        RangesT                                    dirty;
+        std::vector<std::pair<uint64_t, uint64_t>> sending; // [from, to) being sent
+        std::chrono::steady_clock::time_point      since;   // When the oldest dirty data was written
+        std::chrono::system_clock::time_point      written; // When the newest dirty data was written
+        size_t                                     waiters = 0;
+        std::optional<std::string>                 error;
+    };
+
+    struct Job {
+        std::shared_ptr<File> file;
+        uint64_t              handle;
+        std::string           path;
+        uint64_t              off;
+        std::vector<uint8_t>  data;
+    };
+
+    // Puts len bytes at off into ranges, returns by how many bytes they grew
+    static size_t merge(RangesT& ranges, const char* buf, size_t len, uint64_t off);
+
+    // Must be called with _mutex held
+    std::optional<Job> next_job();
+    void               wait_locked(std::unique_lock<std::mutex>& lock, File& file);
+
+    void work();
+
+    const size_t                    _capacity;
+    const std::chrono::milliseconds _delay;
+    const size_t                    _max_store;
+    const StoreT                    _store;
+
+    std::mutex              _mutex;
+    std::condition_variable _work_cv; // Something may have become ready to send
+    std::condition_variable _done_cv; // Something was sent
+    // Shared with waiters, so releasing a file while someone waits for it is fine
+    std::unordered_map<uint64_t, std::shared_ptr<File>> _files;
+    size_t                                              _pending = 0;
+    bool                                                _stop    = false;
+
+    std::vector<std::thread> _threads;
+};
+
+#endif // WRITEBACK_HPP
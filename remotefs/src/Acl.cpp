@@ -112,3 +112,46 @@ void ACL::load(std::string acl, std::string users) {
             },
             Logger::INFO);
 }
+
+void ACL::load_limits(std::string limits) {
+    auto lines = split(limits, '\n');
+
+    for (const auto& line: lines) {
+        auto tokens = split(line, ' ');
+        if (tokens.empty())
+            continue;
+
+        if (tokens.size() != 4) {
+            throw Exception("Could not parse limits definition: " + line);
+        }
+
+        Scheduler::Limits parsed;
+        try {
+            parsed.weight    = std::stoull(tokens.at(1));
+            parsed.iops      = std::stoull(tokens.at(2));
+            parsed.bandwidth = std::stoull(tokens.at(3));
+        } catch (const std::logic_error&) {
+            throw Exception("Could not parse limits definition: " + line);
+        }
+
+        _limits.insert_or_assign(tokens.at(0), parsed);
+    }
+
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) {
+                os << "Loaded limits:\n";
+                for (const auto& [user, l]: _limits) {
+                    os << user << " " << l.weight << " " << l.iops << " " << l.bandwidth << '\n';
+                }
+            },
+            Logger::INFO);
+}
+
+Scheduler::Limits ACL::limits(const std::string& username) {
+    if (auto found = _limits.find(username); found != _limits.end())
+        return found->second;
+    if (auto found = _limits.find("*"); found != _limits.end())
+        return found->second;
+    return {};
+}
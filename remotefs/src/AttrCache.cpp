@@ -0,0 +1,213 @@
+#include "AttrCache.hpp"
+
+#include <algorithm>
+
+AttrCache::AttrCache(std::chrono::milliseconds ttl, std::chrono::milliseconds negative_ttl, size_t max_entries,
+                     size_t max_bytes) :
+    _ttl(ttl), _negative_ttl(negative_ttl), _max_entries(max_entries), _max_bytes(max_bytes) {}
+
+size_t AttrCache::node_bytes(const Node& node) {
+    return sizeof(Node) + node.label.size() + (node.entry ? sizeof(Entry) : 0);
+}
+
+AttrCache::ChildIt AttrCache::child(Node& node, char c) {
+    return std::lower_bound(node.children.begin(), node.children.end(), c,
+                            [](const std::unique_ptr<Node>& n, char value) { return n->label[0] < value; });
+}
+
+AttrCache::Node* AttrCache::find(const std::string& path) {
+    Node*  node = &_root;
+    size_t pos  = 0;
+    while (pos < path.size()) {
+        auto it = child(*node, path[pos]);
+        if (it == node->children.end() || (*it)->label[0] != path[pos])
+            return nullptr;
+        if (path.compare(pos, (*it)->label.size(), (*it)->label) != 0)
+            return nullptr;
+        pos += (*it)->label.size();
+        node = it->get();
+    }
+    return node;
+}
+
+AttrCache::Node& AttrCache::insert(const std::string& path) {
+    Node*  node = &_root;
+    size_t pos  = 0;
+    while (pos < path.size()) {
+        auto it = child(*node, path[pos]);
+        if (it == node->children.end() || (*it)->label[0] != path[pos]) {
+            auto leaf   = std::make_unique<Node>();
+            leaf->label = path.substr(pos);
+            _bytes += node_bytes(*leaf);
+            return **node->children.insert(it, std::move(leaf));
+        }
+
+        Node&  next   = **it;
+        size_t common = 0;
+        while (common < next.label.size() && pos + common < path.size() && next.label[common] == path[pos + common])
+            common++;
+
+        // Split the edge where the paths part
+        if (common < next.label.size()) {
+            auto mid   = std::make_unique<Node>();
+            mid->label = next.label.substr(0, common);
+            next.label.erase(0, common);
+            mid->children.push_back(std::move(*it));
+            *it = std::move(mid);
+            _bytes += sizeof(Node);
+        }
+        node = it->get();
+        pos += common;
+    }
+    return *node;
+}
+
+void AttrCache::drop(Node& node) {
+    for (auto& c: node.children)
+        drop(*c);
+    if (node.entry)
+        _entries--;
+    _bytes -= node_bytes(node);
+}
+
+void AttrCache::compact(Node& node, ChildIt it) {
+    Node& c = **it;
+    if (c.entry)
+        return;
+
+    if (c.children.empty()) {
+        _bytes -= node_bytes(c);
+        node.children.erase(it);
+    } else if (c.children.size() == 1) {
+        auto only   = std::move(c.children.front());
+        only->label = c.label + only->label;
+        _bytes -= sizeof(Node);
+        *it = std::move(only);
+    }
+}
+
+void AttrCache::remove(Node& node, const std::string& path, size_t pos, bool tree) {
+    if (pos == path.size()) {
+        if (tree) {
+            for (auto& c: node.children)
+                drop(*c);
+            node.children.clear();
+        }
+        if (node.entry) {
+            node.entry.reset();
+            _entries--;
+            _bytes -= sizeof(Entry);
+        }
+        return;
+    }
+
+    auto it = child(node, path[pos]);
+    if (it == node.children.end() || (*it)->label[0] != path[pos])
+        return;
+
+    Node&  next = **it;
+    size_t rest = path.size() - pos;
+    if (tree && rest < next.label.size()) {
+        // Everything below the child starts with the path
+        if (next.label.compare(0, rest, path, pos, rest) == 0) {
+            drop(next);
+            node.children.erase(it);
+        }
+    } else if (path.compare(pos, next.label.size(), next.label) == 0) {
+        remove(next, path, pos + next.label.size(), tree);
+        compact(node, it);
+    }
+}
+
+void AttrCache::evict(Node& node, ClockT::time_point now) {
+    for (size_t i = 0; i < node.children.size();) {
+        Node& c = *node.children[i];
+        evict(c, now);
+        if (c.entry) {
+            if (c.entry->expires < now || !c.entry->referenced) {
+                c.entry.reset();
+                _entries--;
+                _bytes -= sizeof(Entry);
+                _evictions++;
+            } else {
+                c.entry->referenced = false;
+            }
+        }
+
+        // Unless the child was removed, the next one has moved up
+        size_t before = node.children.size();
+        compact(node, node.children.begin() + static_cast<ptrdiff_t>(i));
+        if (node.children.size() == before)
+            i++;
+    }
+}
+
+bool AttrCache::over_limits() const { return _entries > _max_entries || _bytes > _max_bytes; }
+
+std::optional<GetattrReply> AttrCache::get(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    auto*           node = find(path);
+    if (!node || !node->entry) {
+        _misses++;
+        return std::nullopt;
+    }
+
+    if (node->entry->expires < ClockT::now()) {
+        _misses++;
+        remove(_root, path, 0, false);
+        return std::nullopt;
+    }
+
+    node->entry->referenced = true;
+    if (node->entry->attr.type == FileType::NONE)
+        _negative_hits++;
+    else
+        _hits++;
+    return node->entry->attr;
+}
+
+void AttrCache::put(const std::string& path, const GetattrReply& attr, uint64_t generation) {
+    auto ttl = attr.type == FileType::NONE ? _negative_ttl : _ttl;
+    if (ttl.count() == 0 || _max_entries == 0 || _max_bytes == 0)
+        return;
+
+    auto            now = ClockT::now();
+    std::lock_guard lock(_mutex);
+    if (generation != _generation)
+        return;
+
+    auto& node = insert(path);
+    if (!node.entry) {
+        _entries++;
+        _bytes += sizeof(Entry);
+    }
+    // Not referenced until looked up, so entries of a listing nobody looks at go first
+    node.entry = std::make_unique<Entry>(Entry{attr, now + ttl, false});
+
+    // If everything was looked up since the last pass, the first one only clears the flags
+    for (int pass = 0; pass < 2 && over_limits(); pass++)
+        evict(_root, now);
+}
+
+void AttrCache::invalidate(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    _generation++;
+    remove(_root, path, 0, false);
+}
+
+void AttrCache::invalidate_tree(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    _generation++;
+    remove(_root, path, 0, false);
+    remove(_root, path == "/" ? path : path + "/", 0, true);
+}
+
+uint64_t AttrCache::generation() {
+    std::lock_guard lock(_mutex);
+    return _generation;
+}
+
+AttrCache::Stats AttrCache::stats() {
+    std::lock_guard lock(_mutex);
+    return {_hits, _negative_hits, _misses, _evictions, _entries, _bytes};
+}
@@ -0,0 +1,128 @@
+#include "BlockCache.hpp"
+
+#include <algorithm>
+
+// Small caches get fewer shards, so that every shard still holds at least one block
+static size_t shard_count(size_t capacity, size_t block_size, size_t shards) {
+    return std::clamp<size_t>(capacity / std::max<size_t>(block_size, 1), 1, std::max<size_t>(shards, 1));
+}
+
+BlockCache::BlockCache(size_t capacity, size_t block_size, size_t shards) :
+    _capacity(capacity), _block_size(block_size), _shards(shard_count(capacity, block_size, shards)),
+    _shard_capacity(std::max(capacity / _shards.size(), block_size)) {}
+
+void BlockCache::erase(Shard& shard, std::unordered_map<Key, Entry, KeyHash>::iterator it) {
+    if (it->second.data) {
+        shard.bytes -= it->second.data->size();
+        _bytes.fetch_sub(it->second.data->size());
+        shard.lru.erase(it->second.lru_it);
+    }
+    shard.entries.erase(it);
+}
+
+BlockCache::BlockT BlockCache::get(const Key& key, const Version& version, const FillT& fill) {
+    if (!enabled()) {
+        _misses.fetch_add(1);
+        return std::make_shared<const std::vector<uint8_t>>(fill());
+    }
+
+    Shard&                   shard = shard_for(key);
+    std::shared_ptr<Pending> pending;
+    {
+        std::unique_lock lock(shard.mutex);
+        auto             found = shard.entries.find(key);
+        if (found != shard.entries.end() && found->second.version == version) {
+            if (found->second.data) {
+                _hits.fetch_add(1);
+                shard.lru.splice(shard.lru.begin(), shard.lru, found->second.lru_it);
+                return found->second.data;
+            }
+
+            // Someone is already reading this block
+            _shared_fills.fetch_add(1);
+            auto future = found->second.pending->future;
+            lock.unlock();
+            return future.get();
+        }
+
+        if (found != shard.entries.end())
+            erase(shard, found);
+
+        _misses.fetch_add(1);
+        pending = std::make_shared<Pending>();
+        shard.entries.emplace(key, Entry{version, nullptr, pending, {}});
+    }
+
+    BlockT data;
+    try {
+        data = std::make_shared<const std::vector<uint8_t>>(fill());
+    } catch (...) {
+        {
+            std::lock_guard lock(shard.mutex);
+            auto            found = shard.entries.find(key);
+            if (found != shard.entries.end() && found->second.pending == pending)
+                shard.entries.erase(found);
+        }
+        pending->promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard lock(shard.mutex);
+        auto            found = shard.entries.find(key);
+        // Only publish if the block wasn't invalidated while it was being read
+        if (found != shard.entries.end() && found->second.pending == pending) {
+            found->second.data    = data;
+            found->second.pending = nullptr;
+            shard.lru.emplace_front(key);
+            found->second.lru_it = shard.lru.begin();
+            shard.bytes += data->size();
+            _bytes.fetch_add(data->size());
+
+            while (shard.bytes > _shard_capacity && !shard.lru.empty()) {
+                _evictions.fetch_add(1);
+                erase(shard, shard.entries.find(shard.lru.back()));
+            }
+        }
+    }
+
+    pending->promise.set_value(data);
+    return data;
+}
+
+void BlockCache::invalidate(uint64_t dev, uint64_t ino, uint64_t first_block, uint64_t last_block) {
+    if (!enabled())
+        return;
+
+    // For big ranges (e.g. truncating a huge file) it's cheaper to look at everything that's cached
+    if (last_block - first_block >= _capacity / _block_size) {
+        for (auto& shard: _shards) {
+            std::lock_guard lock(shard.mutex);
+            for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                auto cur = it++;
+                if (cur->first.dev == dev && cur->first.ino == ino && cur->first.block >= first_block &&
+                    cur->first.block <= last_block) {
+                    _invalidations.fetch_add(1);
+                    erase(shard, cur);
+                }
+            }
+        }
+        return;
+    }
+
+    for (uint64_t block = first_block; block <= last_block; block++) {
+        Key             key{dev, ino, block};
+        Shard&          shard = shard_for(key);
+        std::lock_guard lock(shard.mutex);
+        auto            found = shard.entries.find(key);
+        if (found != shard.entries.end()) {
+            _invalidations.fetch_add(1);
+            erase(shard, found);
+        }
+    }
+}
+
+BlockCache::Stats BlockCache::stats() const {
+    return {_hits.load(), _misses.load(), _shared_fills.load(), _evictions.load(), _invalidations.load(),
+            _bytes.load()};
+}
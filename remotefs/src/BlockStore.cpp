@@ -0,0 +1,39 @@
+#include "BlockStore.hpp"
+
+BlockStore::BlockT BlockStore::get(const std::string& hash) {
+    std::lock_guard lock(_mutex);
+    auto            found = _entries.find(hash);
+    if (found == _entries.end()) {
+        _misses.fetch_add(1);
+        return nullptr;
+    }
+
+    _hits.fetch_add(1);
+    _lru.splice(_lru.begin(), _lru, found->second.lru_it);
+    return found->second.data;
+}
+
+void BlockStore::put(const std::string& hash, BlockT data) {
+    if (!enabled() || data->size() > _capacity)
+        return;
+
+    std::lock_guard lock(_mutex);
+    if (_entries.contains(hash))
+        return;
+
+    _lru.emplace_front(hash);
+    _bytes.fetch_add(data->size());
+    _entries.emplace(hash, Entry{std::move(data), _lru.begin()});
+
+    while (_bytes.load() > _capacity) {
+        auto victim = _entries.find(_lru.back());
+        _bytes.fetch_sub(victim->second.data->size());
+        _entries.erase(victim);
+        _lru.pop_back();
+        _evictions.fetch_add(1);
+    }
+}
+
+BlockStore::Stats BlockStore::stats() const {
+    return {_hits.load(), _misses.load(), _evictions.load(), _bytes.load()};
+}
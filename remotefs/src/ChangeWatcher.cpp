@@ -0,0 +1,204 @@
+#include "ChangeWatcher.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "Exception.h"
+#include "Logger.h"
+
+static constexpr uint32_t watch_mask = IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                       IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+static std::string join_path(const std::string& dir, const std::string& name) {
+    return dir == "/" ? "/" + name : dir + "/" + name;
+}
+
+ChangeWatcher::ChangeWatcher(size_t max_watches, OpenT open, NotifyT notify) :
+    _max_watches(max_watches), _open(std::move(open)), _notify(std::move(notify)) {
+    if (_max_watches == 0)
+        return;
+
+    _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify_fd < 0) {
+        Logger::log(Logger::RemoteFs, "Could not init inotify, change notifications are disabled", Logger::ERROR);
+        return;
+    }
+    if (pipe2(_stop_pipe, O_CLOEXEC) < 0) {
+        throw ErrnoException("Could not create pipe");
+    }
+
+    _thread = std::thread([this]() { thread_entry(); });
+}
+
+ChangeWatcher::~ChangeWatcher() {
+    if (_thread.joinable()) {
+        write(_stop_pipe[1], "1", 1);
+        _thread.join();
+    }
+    for (int fd: {_inotify_fd, _stop_pipe[0], _stop_pipe[1]}) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void ChangeWatcher::watch(int client, const std::string& dir) {
+    if (!enabled())
+        return;
+
+    ChangesT changes;
+    {
+        std::lock_guard lock(_mutex);
+        auto            found = _by_path.find(dir);
+        if (found != _by_path.end()) {
+            auto& watch = _watches.at(found->second);
+            watch.paths[dir].insert(client);
+            _lru.splice(_lru.begin(), _lru, watch.lru_it);
+            return;
+        }
+
+        int fd = _open(dir);
+        if (fd < 0)
+            return;
+        // Through the descriptor, so the watch is on the directory the resolver found
+        int wd = inotify_add_watch(_inotify_fd, ("/proc/self/fd/" + std::to_string(fd)).c_str(), watch_mask);
+        close(fd);
+        if (wd < 0)
+            return;
+
+        auto [it, inserted] = _watches.try_emplace(wd);
+        if (inserted) {
+            _lru.emplace_front(wd);
+            it->second.lru_it = _lru.begin();
+        } else {
+            _lru.splice(_lru.begin(), _lru, it->second.lru_it);
+        }
+        it->second.paths[dir].insert(client);
+        _by_path.emplace(dir, wd);
+
+        while (_watches.size() > _max_watches)
+            drop(_lru.back(), changes);
+    }
+    notify(changes);
+}
+
+void ChangeWatcher::forget(int client) {
+    if (!enabled())
+        return;
+
+    std::lock_guard lock(_mutex);
+    for (auto it = _watches.begin(); it != _watches.end();) {
+        auto& paths = it->second.paths;
+        for (auto path = paths.begin(); path != paths.end();) {
+            path->second.erase(client);
+            if (path->second.empty()) {
+                _by_path.erase(path->first);
+                path = paths.erase(path);
+            } else {
+                ++path;
+            }
+        }
+
+        if (paths.empty()) {
+            inotify_rm_watch(_inotify_fd, it->first);
+            _lru.erase(it->second.lru_it);
+            it = _watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ChangeWatcher::size() {
+    std::lock_guard lock(_mutex);
+    return _watches.size();
+}
+
+void ChangeWatcher::drop(int wd, ChangesT& changes) {
+    auto found = _watches.find(wd);
+    if (found == _watches.end())
+        return;
+
+    for (const auto& [path, clients]: found->second.paths) {
+        for (int client: clients)
+            changes[client].trees.insert(path);
+        _by_path.erase(path);
+    }
+    // Fails harmlessly if the kernel already removed the watch
+    inotify_rm_watch(_inotify_fd, wd);
+    _lru.erase(found->second.lru_it);
+    _watches.erase(found);
+}
+
+void ChangeWatcher::notify(const ChangesT& changes) {
+    for (const auto& [client, client_changes]: changes)
+        _notify(client, client_changes);
+}
+
+void ChangeWatcher::thread_entry() {
+    alignas(inotify_event) char buf[64 * 1024];
+
+    while (true) {
+        pollfd fds[2]{{_inotify_fd, POLLIN, 0}, {_stop_pipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            Logger::log(Logger::RemoteFs, "Could not poll inotify, change notifications stopped", Logger::ERROR);
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+            return;
+
+        ssize_t len = read(_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+
+        ChangesT changes;
+        {
+            std::lock_guard lock(_mutex);
+            for (char* ptr = buf; ptr < buf + len;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (const auto& [wd, watch]: _watches)
+                        for (const auto& [path, clients]: watch.paths)
+                            for (int client: clients)
+                                changes[client].trees.insert("/");
+                    continue;
+                }
+
+                if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    drop(event->wd, changes);
+                    continue;
+                }
+
+                auto found = _watches.find(event->wd);
+                if (found == _watches.end())
+                    continue;
+
+                bool listing = event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+                // Anything cached under a directory that moved or disappeared is stale
+                bool subtree = (event->mask & IN_ISDIR) && (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO));
+
+                for (const auto& [path, clients]: found->second.paths) {
+                    for (int client: clients) {
+                        auto& client_changes = changes[client];
+                        if (event->len == 0) {
+                            client_changes.paths.insert(path);
+                            continue;
+                        }
+
+                        auto child = join_path(path, event->name);
+                        (subtree ? client_changes.trees : client_changes.paths).insert(std::move(child));
+                        // Entries changing also changes the directory's mtime and link count
+                        if (listing)
+                            client_changes.paths.insert(path);
+                    }
+                }
+            }
+        }
+        notify(changes);
+    }
+}
@@ -0,0 +1,79 @@
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Exception.h"
+#include "SHA.h"
+#include "XXHash.h"
+#include "stuff.hpp"
+
+Checksum::Checksum(Algorithm algorithm, size_t chunk, size_t threads) :
+    _algorithm(algorithm), _chunk(std::max<size_t>(chunk, 1)), _threads(std::max<size_t>(threads, 1)) {}
+
+std::string Checksum::digest(const char* data, size_t len) const {
+    if (_algorithm == Algorithm::SHA256)
+        return SHA::calculate(data, len);
+
+    // Big endian, so the hex form reads like the usual one
+    uint64_t    hash = XXHash64::calculate(data, len);
+    std::string out(8, '\0');
+    for (int i = 7; i >= 0; i--, hash >>= 8)
+        out[static_cast<size_t>(i)] = static_cast<char>(hash & 0xFF);
+    return out;
+}
+
+std::string Checksum::compute(const ReadT& read, uint64_t off, uint64_t len) const {
+    size_t chunks = checked_cast<size_t>((len + _chunk - 1) / _chunk);
+    if (chunks <= 1) {
+        std::string data(checked_cast<size_t>(len), '\0');
+        if (read(data.data(), data.size(), off) != checked_cast<ssize_t>(data.size()))
+            throw Exception("Short read while hashing");
+        return digest(data.data(), data.size());
+    }
+
+    std::vector<std::string> digests(chunks);
+    std::atomic<size_t>      next{0};
+    std::atomic<bool>        failed{false};
+
+    auto work = [&]() {
+        std::string buf(_chunk, '\0');
+        for (size_t i; !failed && (i = next++) < chunks;) {
+            uint64_t from = off + i * _chunk;
+            size_t   size = checked_cast<size_t>(std::min<uint64_t>(_chunk, off + len - from));
+            if (read(buf.data(), size, from) != checked_cast<ssize_t>(size)) {
+                failed = true;
+                return;
+            }
+            digests[i] = digest(buf.data(), size);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(_threads, chunks); i++)
+        threads.emplace_back(work);
+    work();
+    for (auto& t: threads)
+        t.join();
+
+    if (failed)
+        throw Exception("Short read while hashing");
+
+    std::string all;
+    for (const auto& d: digests)
+        all += d;
+    return digest(all.data(), all.size());
+}
+
+std::string Checksum::to_hex(const std::string& digest) {
+    static constexpr char digits[] = "0123456789abcdef";
+
+    std::string out;
+    for (auto c: digest) {
+        out += digits[static_cast<uint8_t>(c) >> 4];
+        out += digits[static_cast<uint8_t>(c) & 0xF];
+    }
+    return out;
+}
@@ -0,0 +1,116 @@
+#include "Delta.hpp"
+
+#include <optional>
+#include <unordered_map>
+
+#include "Exception.h"
+#include "SHA.h"
+#include "stuff.hpp"
+
+Delta::RollingChecksum::RollingChecksum(const uint8_t* data, size_t len) : _len(checked_cast<uint32_t>(len)) {
+    for (size_t i = 0; i < len; i++) {
+        _a += data[i];
+        _b += checked_cast<uint32_t>(len - i) * data[i];
+    }
+    _a &= 0xffff;
+    _b &= 0xffff;
+}
+
+void Delta::RollingChecksum::roll(uint8_t out, uint8_t in) {
+    _a = (_a - out + in) & 0xffff;
+    _b = (_b - _len * out + _a) & 0xffff;
+}
+
+uint64_t Delta::block_size_for(uint64_t size) {
+    uint64_t block = min_block;
+    while (block * block < size && block < max_block)
+        block *= 2;
+    return block;
+}
+
+BlockSigT Delta::signature(const uint8_t* data, size_t len) {
+    return {RollingChecksum(data, len).value(), SHA::calculate(reinterpret_cast<const char*>(data), len)};
+}
+
+std::vector<DeltaOp> Delta::compute(const std::vector<BlockSigT>& sigs, uint64_t block_size, uint64_t base_size,
+                                    const uint8_t* data, size_t len) {
+    if (block_size == 0) {
+        throw Exception("Zero block size");
+    }
+
+    std::unordered_map<uint32_t, std::vector<uint64_t>> by_weak;
+    for (uint64_t i = 0; i < sigs.size(); i++)
+        by_weak[sigs[i].first].push_back(i);
+
+    // Only the last block of the base can be shorter
+    uint64_t last_len = sigs.empty() ? 0 : base_size - (sigs.size() - 1) * block_size;
+
+    // The strong hash is only computed once the weak one matches
+    auto match = [&](uint32_t weak, const uint8_t* at, size_t at_len) -> std::optional<uint64_t> {
+        auto found = by_weak.find(weak);
+        if (found == by_weak.end())
+            return std::nullopt;
+
+        std::string strong;
+        for (uint64_t block: found->second) {
+            uint64_t block_len = block + 1 == sigs.size() ? last_len : block_size;
+            if (block_len != at_len)
+                continue;
+            if (strong.empty())
+                strong = SHA::calculate(reinterpret_cast<const char*>(at), at_len);
+            if (sigs[block].second == strong)
+                return block;
+        }
+        return std::nullopt;
+    };
+
+    std::vector<DeltaOp> ops;
+
+    auto literal = [&](uint8_t byte) {
+        if (ops.empty())
+            ops.emplace_back(0, 0, std::vector<uint8_t>{});
+        ops.back().data.push_back(byte);
+    };
+    auto copy = [&](uint64_t block) {
+        if (!ops.empty() && ops.back().data.empty() && ops.back().copy_count > 0 &&
+            ops.back().copy_block + ops.back().copy_count == block) {
+            ops.back().copy_count++;
+        } else {
+            ops.emplace_back(block, 1, std::vector<uint8_t>{});
+        }
+    };
+
+    size_t                         pos = 0;
+    std::optional<RollingChecksum> sum;
+    while (pos + block_size <= len) {
+        if (!sum)
+            sum.emplace(data + pos, block_size);
+
+        if (auto block = match(sum->value(), data + pos, block_size)) {
+            copy(*block);
+            pos += block_size;
+            sum.reset();
+            continue;
+        }
+
+        literal(data[pos]);
+        if (pos + block_size < len)
+            sum->roll(data[pos], data[pos + block_size]);
+        pos++;
+    }
+
+    // The short last block of the base can only match the very end
+    if (last_len > 0 && last_len < block_size && len - pos >= last_len) {
+        while (len - pos > last_len)
+            literal(data[pos++]);
+        if (auto block = match(RollingChecksum(data + pos, last_len).value(), data + pos, last_len)) {
+            copy(*block);
+            pos = len;
+        }
+    }
+
+    while (pos < len)
+        literal(data[pos++]);
+
+    return ops;
+}
@@ -0,0 +1,76 @@
+#include "DirCursorCache.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stuff.hpp"
+
+static int default_open(const std::filesystem::path& path, int flags, mode_t mode) {
+    return open(path.c_str(), flags, mode);
+}
+
+DirCursorCache::DirCursorCache(size_t capacity, OpenT open) :
+    _capacity(capacity), _open(open ? std::move(open) : default_open) {}
+
+DirCursorCache::DirT DirCursorCache::take(const std::filesystem::path& path, uint64_t cookie) {
+    {
+        std::lock_guard lock(_mutex);
+        auto            found = _map.find({path.native(), cookie});
+        if (found != _map.end()) {
+            // Only one reader can advance a stream, so it leaves the cache until it is put back
+            DirT dir = std::move(found->second->second);
+            _lru.erase(found->second);
+            _map.erase(found);
+            return dir;
+        }
+    }
+
+    DirT dir(nullptr, &closedir);
+    int  fd = _open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return dir;
+    dir.reset(fdopendir(fd));
+    if (!dir) {
+        close(fd);
+        return dir;
+    }
+    if (cookie != 0)
+        seekdir(dir.get(), checked_cast<long>(cookie));
+    return dir;
+}
+
+void DirCursorCache::put(const std::filesystem::path& path, uint64_t cookie, DirT dir) {
+    if (_capacity == 0)
+        return;
+
+    KeyT key{path.native(), cookie};
+
+    std::lock_guard lock(_mutex);
+    if (auto found = _map.find(key); found != _map.end()) {
+        // Two readers got to the same position, one stream is enough
+        _lru.erase(found->second);
+        _map.erase(found);
+    }
+
+    _lru.emplace_front(key, std::move(dir));
+    _map.emplace(std::move(key), _lru.begin());
+
+    while (_lru.size() > _capacity) {
+        _map.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+}
+
+void DirCursorCache::invalidate(const std::filesystem::path& path) {
+    std::lock_guard lock(_mutex);
+    auto            it = _map.lower_bound({path.native(), 0});
+    while (it != _map.end() && it->first.first == path.native()) {
+        _lru.erase(it->second);
+        it = _map.erase(it);
+    }
+}
+
+size_t DirCursorCache::size() {
+    std::lock_guard lock(_mutex);
+    return _lru.size();
+}
@@ -0,0 +1,388 @@
+#include "DiskCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "Exception.h"
+#include "Logger.h"
+#include "SerializableStruct.hpp"
+#include "XXHash.h"
+#include "stuff.hpp"
+
+// Changed whenever the layout of the records or the index does
+static constexpr uint32_t record_magic = 0x52465342;
+static constexpr uint32_t index_magic  = 0x52465349;
+
+// Segments a cache is split into, the share of it evicted at once
+static constexpr size_t segments_per_cache = 16;
+
+// Each record is the length of its header, the header, then the data
+#define DISK_RECORD(FIELD)                                                                                             \
+    FIELD(uint32_t, magic)                                                                                             \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, block)                                                                                             \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(int64_t, mtime_sec)                                                                                          \
+    FIELD(int64_t, mtime_nsec)                                                                                         \
+    FIELD(uint64_t, len)                                                                                               \
+    FIELD(uint64_t, hash)
+DECLARE_SERIALIZABLE(DiskRecord, DISK_RECORD)
+DECLARE_SERIALIZABLE_END
+#undef DISK_RECORD
+
+// Bytes of a segment the index covers
+#define DISK_SEGMENT(FIELD)                                                                                            \
+    FIELD(uint64_t, id)                                                                                                \
+    FIELD(uint64_t, size)
+DECLARE_SERIALIZABLE(DiskSegment, DISK_SEGMENT)
+DECLARE_SERIALIZABLE_END
+#undef DISK_SEGMENT
+
+#define DISK_INDEX_ENTRY(FIELD)                                                                                        \
+    FIELD(std::string, path)                                                                                           \
+    FIELD(uint64_t, block)                                                                                             \
+    FIELD(uint64_t, segment)                                                                                           \
+    FIELD(uint64_t, offset)                                                                                            \
+    FIELD(uint64_t, len)                                                                                               \
+    FIELD(uint64_t, hash)                                                                                              \
+    FIELD(uint64_t, size)                                                                                              \
+    FIELD(int64_t, mtime_sec)                                                                                          \
+    FIELD(int64_t, mtime_nsec)
+DECLARE_SERIALIZABLE(DiskIndexEntry, DISK_INDEX_ENTRY)
+DECLARE_SERIALIZABLE_END
+#undef DISK_INDEX_ENTRY
+
+#define DISK_INDEX(FIELD)                                                                                              \
+    FIELD(uint32_t, magic)                                                                                             \
+    FIELD(std::vector<DiskSegment>, segments)                                                                          \
+    FIELD(std::vector<DiskIndexEntry>, entries)
+DECLARE_SERIALIZABLE(DiskIndex, DISK_INDEX)
+DECLARE_SERIALIZABLE_END
+#undef DISK_INDEX
+
+static uint64_t hash_of(const uint8_t* data, size_t len) {
+    return XXHash64::calculate(reinterpret_cast<const char*>(data), len);
+}
+
+DiskCache::DiskCache(const std::filesystem::path& dir, size_t capacity, size_t block_size) :
+    _dir(dir), _capacity(capacity), _block_size(std::max<size_t>(block_size, 1)),
+    _segment_size(std::max(capacity / segments_per_cache, _block_size)), _enabled(!dir.empty() && capacity > 0) {
+    if (!_enabled)
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(_dir, ec);
+    if (ec) {
+        throw Exception("Could not create cache directory " + _dir.string() + ": " + ec.message());
+    }
+
+    std::lock_guard lock(_mutex);
+    load();
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) {
+                os << "Disk cache " << _dir.string() << " has " << _segments.size() << " segments in " << _bytes
+                   << " bytes";
+            },
+            Logger::INFO);
+}
+
+DiskCache::~DiskCache() {
+    if (!_enabled)
+        return;
+    try {
+        sync();
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, std::string("Could not write cache index: ") + e.what(), Logger::ERROR);
+    }
+}
+
+std::string DiskCache::segment_path(uint64_t id) const { return (_dir / (std::to_string(id) + ".log")).string(); }
+
+void DiskCache::open_segment(uint64_t id) {
+    int fd = open(segment_path(id).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw Exception("Could not open cache segment " + segment_path(id));
+    }
+    _segments[id].file = std::make_shared<FdCache::File>(fd, true);
+}
+
+void DiskCache::load() {
+    for (const auto& file: std::filesystem::directory_iterator(_dir)) {
+        auto name = file.path().filename().string();
+        if (file.path().extension() != ".log" || name.size() <= 4)
+            continue;
+        auto stem = name.substr(0, name.size() - 4);
+        if (!std::all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            continue;
+        open_segment(std::stoull(stem));
+    }
+
+    // Bytes of each segment the index has the blocks of
+    std::unordered_map<uint64_t, uint64_t> indexed;
+    std::ifstream                          ifs(_dir / "index", std::ios::binary);
+    if (ifs) {
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        try {
+            auto index = Serialize::deserialize<DiskIndex>(bytes);
+            if (index.magic == index_magic) {
+                for (const auto& segment: index.segments) {
+                    auto found = _segments.find(segment.id);
+                    struct stat st;
+                    if (found != _segments.end() && fstat(found->second.file->fd(), &st) == 0 &&
+                        checked_cast<uint64_t>(st.st_size) >= segment.size)
+                        indexed.emplace(segment.id, segment.size);
+                }
+                for (const auto& e: index.entries) {
+                    auto segment = indexed.find(e.segment);
+                    if (segment == indexed.end() || e.offset + e.len > segment->second)
+                        continue;
+                    _files[e.path].insert_or_assign(
+                            e.block, Entry{e.segment, e.offset, e.len, e.hash, {e.size, e.mtime_sec, e.mtime_nsec}});
+                    _segments[e.segment].blocks.emplace_back(e.path, e.block);
+                }
+            }
+        } catch (std::exception& e) {
+            Logger::log(Logger::RemoteFs, std::string("Ignoring broken cache index: ") + e.what(), Logger::ERROR);
+        }
+    }
+
+    // Only what was appended after the index was written is read
+    for (auto& [id, segment]: _segments) {
+        auto covered = indexed.find(id);
+        scan(id, segment, covered == indexed.end() ? 0 : covered->second);
+        _bytes += segment.size;
+    }
+
+    if (_segments.empty())
+        open_segment(1);
+    evict();
+}
+
+void DiskCache::scan(uint64_t id, Segment& segment, uint64_t from) {
+    uint64_t             off = from;
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> data;
+    while (true) {
+        uint32_t header_len;
+        if (segment.file->read(&header_len, sizeof(header_len), checked_cast<off_t>(off)) !=
+                    checked_cast<ssize_t>(sizeof(header_len)) ||
+            header_len > 64 * 1024)
+            break;
+
+        header.resize(header_len);
+        if (segment.file->read(header.data(), header_len, checked_cast<off_t>(off + sizeof(header_len))) !=
+            checked_cast<ssize_t>(header_len))
+            break;
+
+        std::optional<DiskRecord> record;
+        try {
+            record.emplace(Serialize::deserialize<DiskRecord>(header));
+        } catch (std::exception&) {
+            break;
+        }
+        if (record->magic != record_magic || record->len > _block_size)
+            break;
+
+        uint64_t data_off = off + sizeof(header_len) + header_len;
+        data.resize(checked_cast<size_t>(record->len));
+        if (segment.file->read(data.data(), data.size(), checked_cast<off_t>(data_off)) !=
+                    checked_cast<ssize_t>(data.size()) ||
+            hash_of(data.data(), data.size()) != record->hash)
+            break;
+
+        _files[record->path].insert_or_assign(record->block,
+                                              Entry{id, data_off, record->len, record->hash,
+                                                    {record->size, record->mtime_sec, record->mtime_nsec}});
+        segment.blocks.emplace_back(record->path, record->block);
+        off = data_off + record->len;
+    }
+
+    // The rest was torn by a crash
+    if (ftruncate(segment.file->fd(), checked_cast<off_t>(off)) < 0) {
+        throw Exception("Could not truncate cache segment " + segment_path(id));
+    }
+    segment.size = off;
+}
+
+void DiskCache::append(const std::string& path, uint64_t block, const Version& version, const uint8_t* data,
+                       size_t len) {
+    auto hash   = hash_of(data, len);
+    auto header = Serialize::serialize(
+            DiskRecord{record_magic, path, block, version.size, version.mtime_sec, version.mtime_nsec, len, hash});
+    auto header_len = checked_cast<uint32_t>(header.size());
+
+    std::vector<uint8_t> record(sizeof(header_len) + header.size() + len);
+    std::memcpy(record.data(), &header_len, sizeof(header_len));
+    std::memcpy(record.data() + sizeof(header_len), header.data(), header.size());
+    std::memcpy(record.data() + sizeof(header_len) + header.size(), data, len);
+
+    auto last = std::prev(_segments.end());
+    if (last->second.size > 0 && last->second.size + record.size() > _segment_size) {
+        open_segment(last->first + 1);
+        last = std::prev(_segments.end());
+        // A finished segment needn't be scanned again
+        write_index();
+    }
+
+    Segment& segment = last->second;
+    if (segment.file->write(record.data(), record.size(), checked_cast<off_t>(segment.size)) !=
+        checked_cast<ssize_t>(record.size())) {
+        // Whatever made it will be overwritten by the next record
+        Logger::log(Logger::RemoteFs, "Could not write to the disk cache", Logger::ERROR);
+        return;
+    }
+
+    uint64_t data_off = segment.size + sizeof(header_len) + header.size();
+    _files[path].insert_or_assign(block, Entry{last->first, data_off, len, hash, version});
+    segment.blocks.emplace_back(path, block);
+    segment.size += record.size();
+    _bytes += record.size();
+    evict();
+}
+
+void DiskCache::evict() {
+    while (_bytes > _capacity && _segments.size() > 1) {
+        auto oldest = _segments.begin();
+        for (const auto& [path, block]: oldest->second.blocks) {
+            auto file = _files.find(path);
+            if (file == _files.end())
+                continue;
+            auto entry = file->second.find(block);
+            if (entry != file->second.end() && entry->second.segment == oldest->first)
+                file->second.erase(entry);
+            if (file->second.empty())
+                _files.erase(file);
+        }
+
+        // Readers that already have it open can still finish
+        unlink(segment_path(oldest->first).c_str());
+        _bytes -= oldest->second.size;
+        _segments.erase(oldest);
+        _evictions++;
+    }
+}
+
+void DiskCache::write_index() {
+    std::vector<DiskSegment> segments;
+    for (const auto& [id, segment]: _segments)
+        segments.emplace_back(id, segment.size);
+
+    std::vector<DiskIndexEntry> entries;
+    for (const auto& [path, blocks]: _files) {
+        for (const auto& [block, e]: blocks) {
+            entries.emplace_back(path, block, e.segment, e.offset, e.len, e.hash, e.version.size, e.version.mtime_sec,
+                                 e.version.mtime_nsec);
+        }
+    }
+
+    auto bytes = Serialize::serialize(DiskIndex{index_magic, std::move(segments), std::move(entries)});
+    // Replaced whole, a crash leaves either the old or the new one
+    auto tmp = _dir / "index.tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), checked_cast<std::streamsize>(bytes.size()));
+        if (!ofs) {
+            throw Exception("Could not write " + tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, _dir / "index");
+}
+
+std::optional<DiskCache::Block> DiskCache::get(const std::string& path, uint64_t block, const Version& version) {
+    if (!enabled())
+        return std::nullopt;
+
+    std::optional<Entry>           entry;
+    std::shared_ptr<FdCache::File> file;
+    {
+        std::lock_guard lock(_mutex);
+        if (auto found = _files.find(path); found != _files.end()) {
+            if (auto e = found->second.find(block); e != found->second.end())
+                entry = e->second;
+        }
+        if (!entry) {
+            _misses++;
+            return std::nullopt;
+        }
+        file = _segments.at(entry->segment).file;
+    }
+
+    // A block past the end of the version asked for, or ending before it, is no use
+    uint64_t start = block * _block_size;
+    bool fits = entry->len == _block_size ? start + entry->len <= version.size : start + entry->len == version.size;
+
+    Block out{std::vector<uint8_t>(checked_cast<size_t>(entry->len)), entry->version == version};
+    bool  read = fits && file->read(out.data.data(), out.data.size(), checked_cast<off_t>(entry->offset)) ==
+                                checked_cast<ssize_t>(out.data.size());
+
+    std::lock_guard lock(_mutex);
+    if (!read || hash_of(out.data.data(), out.data.size()) != entry->hash) {
+        _misses++;
+        return std::nullopt;
+    }
+    if (out.current)
+        _hits++;
+    else
+        _stale_hits++;
+
+    // Kept from being evicted with the rest of the oldest segment, unless it was replaced in the meantime
+    auto found = _files.find(path);
+    if (_segments.size() > 1 && entry->segment == _segments.begin()->first && found != _files.end()) {
+        auto e = found->second.find(block);
+        if (e != found->second.end() && e->second.segment == entry->segment && e->second.offset == entry->offset)
+            append(path, block, e->second.version, out.data.data(), out.data.size());
+    }
+    return out;
+}
+
+void DiskCache::put(const std::string& path, uint64_t block, const Version& version,
+                    const std::vector<uint8_t>& data) {
+    if (!enabled() || data.size() > _block_size)
+        return;
+    std::lock_guard lock(_mutex);
+    append(path, block, version, data.data(), data.size());
+}
+
+void DiskCache::revalidate(const std::string& path, uint64_t block, const Version& version) {
+    std::lock_guard lock(_mutex);
+    auto            found = _files.find(path);
+    if (found == _files.end())
+        return;
+    if (auto e = found->second.find(block); e != found->second.end())
+        e->second.version = version;
+}
+
+void DiskCache::invalidate(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    if (auto found = _files.find(path); found != _files.end())
+        _files.erase(found);
+}
+
+void DiskCache::invalidate_tree(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    if (auto found = _files.find(path); found != _files.end())
+        _files.erase(found);
+
+    auto prefix = path == "/" ? path : path + "/";
+    for (auto it = _files.lower_bound(prefix); it != _files.end() && it->first.starts_with(prefix);)
+        _files.erase(it++);
+}
+
+void DiskCache::sync() {
+    if (!enabled())
+        return;
+    std::lock_guard lock(_mutex);
+    write_index();
+}
+
+DiskCache::Stats DiskCache::stats() {
+    std::lock_guard lock(_mutex);
+    return {_hits, _stale_hits, _misses, _evictions, _bytes};
+}
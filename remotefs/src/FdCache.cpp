@@ -0,0 +1,200 @@
+#include "FdCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stuff.hpp"
+
+IoEngine& FdCache::buffered_engine() {
+    static BufferedIo engine;
+    return engine;
+}
+
+FdCache::File::File(int fd, bool writable, IoEngine& engine) :
+    _fds{fd, engine.open_direct(fd)}, _writable(writable), _engine(engine) {
+    struct stat buf;
+    if (fstat(fd, &buf) == 0) {
+        _dev = buf.st_dev;
+        _ino = buf.st_ino;
+    }
+}
+
+FdCache::File::~File() {
+    if (_fds.direct >= 0)
+        close(_fds.direct);
+    close(_fds.fd);
+}
+
+ssize_t FdCache::File::read(void* buf, size_t len, off_t off) const { return _engine.read(_fds, buf, len, off); }
+
+ssize_t FdCache::File::write(const void* buf, size_t len, off_t off) const {
+    return _engine.write(_fds, buf, len, off);
+}
+
+// For filesystems or file pairs copy_file_range doesn't work with
+static ssize_t copy_buffered(const FdCache::File& src, const FdCache::File& dst, off_t off, off_t dst_off, size_t len) {
+    std::vector<char> buf(std::min<size_t>(len, 1024 * 1024));
+    size_t            done = 0;
+    while (done < len) {
+        ssize_t got = src.read(buf.data(), std::min(buf.size(), len - done), off + checked_cast<off_t>(done));
+        if (got <= 0)
+            return done > 0 || got == 0 ? checked_cast<ssize_t>(done) : -1;
+
+        ssize_t put = dst.write(buf.data(), static_cast<size_t>(got), dst_off + checked_cast<off_t>(done));
+        if (put < 0)
+            return done > 0 ? checked_cast<ssize_t>(done) : -1;
+        done += static_cast<size_t>(put);
+        if (put < got)
+            break;
+    }
+    return checked_cast<ssize_t>(done);
+}
+
+ssize_t FdCache::File::copy_to(const File& dst, off_t off, off_t dst_off, size_t len) const {
+    size_t done = 0;
+    while (done < len) {
+        loff_t  in  = off + checked_cast<off_t>(done);
+        loff_t  out = dst_off + checked_cast<off_t>(done);
+        ssize_t ret = copy_file_range(fd(), &in, dst.fd(), &out, len - done, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (done == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP))
+                return copy_buffered(*this, dst, off, dst_off, len);
+            return done > 0 ? checked_cast<ssize_t>(done) : -1;
+        }
+        if (ret == 0)
+            break;
+        done += static_cast<size_t>(ret);
+    }
+    return checked_cast<ssize_t>(done);
+}
+
+static int default_open(const std::filesystem::path& path, int flags, mode_t mode) {
+    return open(path.c_str(), flags, mode);
+}
+
+static int default_stat(const std::filesystem::path& path, struct stat& buf) { return stat(path.c_str(), &buf); }
+
+FdCache::FdCache(size_t capacity, OpenT open, EngineT engine, StatT stat) :
+    _capacity(capacity), _open(open ? std::move(open) : default_open),
+    _engine(engine ? std::move(engine) : [](const std::filesystem::path&) -> IoEngine& { return buffered_engine(); }),
+    _stat(stat ? std::move(stat) : default_stat) {}
+
+static std::shared_ptr<FdCache::File> open_file(const FdCache::OpenT& open, IoEngine& engine,
+                                                const std::filesystem::path& path, bool write) {
+    // Running executables can't be opened for writing, but can still be read
+    bool writable = write;
+    int  fd       = open(path, (write ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0);
+    if (fd < 0 && write && (errno == EACCES || errno == EROFS || errno == EISDIR || errno == ETXTBSY)) {
+        writable = false;
+        fd       = open(path, O_RDONLY | O_CLOEXEC, 0);
+    }
+    if (fd < 0)
+        return nullptr;
+
+    struct stat buf;
+    if (fstat(fd, &buf) < 0 || !S_ISREG(buf.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    return std::make_shared<FdCache::File>(fd, writable, engine);
+}
+
+std::shared_ptr<FdCache::File> FdCache::get(const std::filesystem::path& path, bool write) {
+    const std::string& key = path.native();
+
+    std::shared_ptr<File> cached;
+    {
+        std::lock_guard lock(_mutex);
+        if (auto found = _map.find(key); found != _map.end())
+            cached = found->second->second;
+    }
+
+    // The path may have been renamed over or unlinked and recreated since the file was opened
+    struct stat st;
+    if (cached && (_stat(path, st) < 0 || st.st_dev != cached->dev() || st.st_ino != cached->ino()))
+        cached = nullptr;
+
+    // A file that was opened read-only is reopened once someone wants to write it
+    if (cached && (!write || cached->writable())) {
+        std::lock_guard lock(_mutex);
+        if (auto found = _map.find(key); found != _map.end() && found->second->second == cached)
+            _lru.splice(_lru.begin(), _lru, found->second);
+        return cached;
+    }
+
+    // Don't hold the lock while opening, opening files can be slow
+    auto file = open_file(_open, _engine(path), path, write);
+    if (!file || _capacity == 0)
+        return file;
+
+    std::lock_guard lock(_mutex);
+    if (auto found = _map.find(key); found != _map.end()) {
+        auto& other = found->second->second;
+        // Someone else opened the same file in the meantime
+        if (other != cached && other->dev() == file->dev() && other->ino() == file->ino() &&
+            (!write || other->writable() || !file->writable())) {
+            _lru.splice(_lru.begin(), _lru, found->second);
+            return other;
+        }
+        _lru.erase(found->second);
+        _map.erase(found);
+    }
+
+    insert(key, file);
+    return file;
+}
+
+std::shared_ptr<FdCache::File> FdCache::create(const std::filesystem::path& path, mode_t mode) {
+    int fd = _open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    if (fd < 0)
+        return nullptr;
+
+    // Not affected by umask
+    fchmod(fd, mode);
+    auto file = std::make_shared<File>(fd, true, _engine(path));
+
+    if (_capacity == 0)
+        return file;
+
+    std::lock_guard lock(_mutex);
+    // The file didn't exist, so anything cached under its path is stale
+    if (auto found = _map.find(path.native()); found != _map.end()) {
+        _lru.erase(found->second);
+        _map.erase(found);
+    }
+
+    insert(path.native(), file);
+    return file;
+}
+
+void FdCache::insert(const std::string& key, std::shared_ptr<File> file) {
+    _lru.emplace_front(key, std::move(file));
+    _map.emplace(key, _lru.begin());
+
+    while (_lru.size() > _capacity) {
+        _map.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+}
+
+void FdCache::invalidate(const std::filesystem::path& path) {
+    std::lock_guard lock(_mutex);
+    auto            found = _map.find(path.native());
+    if (found == _map.end())
+        return;
+    _lru.erase(found->second);
+    _map.erase(found);
+}
+
+size_t FdCache::size() {
+    std::lock_guard lock(_mutex);
+    return _lru.size();
+}
@@ -0,0 +1,154 @@
+#include "FileBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Exception.h"
+
+FileBuffer::FileBuffer(size_t block_size, size_t capacity, uint64_t size, FetchT fetch, StoreT store,
+                       BudgetT budget) :
+    _block_size(block_size), _capacity(capacity), _fetch(std::move(fetch)), _store(std::move(store)),
+    _budget(budget ? std::move(budget) : std::make_shared<std::atomic<size_t>>(0)), _size(size) {}
+
+FileBuffer::~FileBuffer() {
+    if (_budget)
+        _budget->fetch_sub(_bytes);
+}
+
+FileBuffer::FileBuffer(FileBuffer&& other) noexcept :
+    _block_size(other._block_size), _capacity(other._capacity), _fetch(other._fetch), _store(other._store),
+    _budget(std::move(other._budget)), _size(other._size), _blocks(std::move(other._blocks)),
+    _dirty(std::move(other._dirty)), _bytes(other._bytes) {
+    other._bytes = 0;
+}
+
+void FileBuffer::add_bytes(size_t n) {
+    _bytes += n;
+    _budget->fetch_add(n);
+}
+
+void FileBuffer::sub_bytes(size_t n) {
+    _bytes -= n;
+    _budget->fetch_sub(n);
+}
+
+size_t FileBuffer::block_len(uint64_t block) const {
+    uint64_t start = block * _block_size;
+    return start >= _size ? 0 : static_cast<size_t>(std::min<uint64_t>(_block_size, _size - start));
+}
+
+void FileBuffer::fetch(uint64_t first, uint64_t last) {
+    std::vector<uint64_t> missing;
+    for (uint64_t block = first; block <= last; block++) {
+        if (!_blocks.contains(block) && block_len(block) > 0)
+            missing.push_back(block);
+    }
+    if (missing.empty())
+        return;
+
+    auto fetched = _fetch(missing);
+    if (fetched.size() != missing.size())
+        throw Exception("Could not fetch blocks");
+
+    for (size_t i = 0; i < missing.size(); i++) {
+        fetched[i].resize(std::min(fetched[i].size(), block_len(missing[i])));
+        add_bytes(fetched[i].size());
+        _blocks.emplace(missing[i], std::move(fetched[i]));
+    }
+}
+
+size_t FileBuffer::read(char* buf, size_t len, uint64_t off) {
+    if (len == 0 || off >= _size)
+        return 0;
+
+    uint64_t end = std::min<uint64_t>(off + len, _size);
+    fetch(off / _block_size, (end - 1) / _block_size);
+
+    for (uint64_t pos = off; pos < end;) {
+        uint64_t block    = pos / _block_size;
+        size_t   in_block = pos - block * _block_size;
+        size_t   n        = static_cast<size_t>(std::min<uint64_t>(_block_size - in_block, end - pos));
+
+        auto& data = _blocks.at(block);
+        // Past what the server returned is a gap left by extending the file, it reads as zeros
+        if (data.size() < in_block + n) {
+            add_bytes(in_block + n - data.size());
+            data.resize(in_block + n);
+        }
+        std::memcpy(buf + (pos - off), data.data() + in_block, n);
+        pos += n;
+    }
+
+    size_t ret = static_cast<size_t>(end - off);
+    shrink();
+    return ret;
+}
+
+void FileBuffer::write(const char* buf, size_t len, uint64_t off) {
+    if (len == 0)
+        return;
+
+    uint64_t end = off + len;
+    for (uint64_t pos = off; pos < end;) {
+        uint64_t block    = pos / _block_size;
+        size_t   in_block = pos - block * _block_size;
+        size_t   n        = static_cast<size_t>(std::min<uint64_t>(_block_size - in_block, end - pos));
+
+        // Only fetch blocks that keep some of their old contents
+        bool overwritten = in_block == 0 && (n == _block_size || pos + n >= _size);
+        if (!overwritten)
+            fetch(block, block);
+
+        auto& data = _blocks[block];
+        if (data.size() < in_block + n) {
+            add_bytes(in_block + n - data.size());
+            data.resize(in_block + n);
+        }
+        std::memcpy(data.data() + in_block, buf + (pos - off), n);
+        _dirty.insert(block);
+        pos += n;
+    }
+
+    _size = std::max(_size, end);
+    shrink();
+}
+
+void FileBuffer::truncate(uint64_t size) {
+    _size = size;
+    for (auto it = _blocks.begin(); it != _blocks.end();) {
+        size_t len = block_len(it->first);
+        if (len == 0) {
+            sub_bytes(it->second.size());
+            _dirty.erase(it->first);
+            it = _blocks.erase(it);
+            continue;
+        }
+        if (it->second.size() > len) {
+            sub_bytes(it->second.size() - len);
+            it->second.resize(len);
+        }
+        ++it;
+    }
+}
+
+void FileBuffer::flush() {
+    if (_dirty.empty())
+        return;
+
+    std::vector<std::pair<uint64_t, const std::vector<uint8_t>*>> blocks;
+    blocks.reserve(_dirty.size());
+    for (uint64_t block: _dirty)
+        blocks.emplace_back(block, &_blocks.at(block));
+
+    _store(blocks);
+    _dirty.clear();
+}
+
+void FileBuffer::shrink() {
+    if (_budget->load() <= _capacity)
+        return;
+
+    flush();
+    _blocks.clear();
+    sub_bytes(_bytes);
+}
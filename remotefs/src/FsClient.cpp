@@ -4,36 +4,339 @@
 
 #include "FsClient.hpp"
 
+#include "AttrCache.hpp"
+#include "BlockStore.hpp"
+#include "Checksum.hpp"
 #include "Client.hpp"
+#include "Delta.hpp"
+#include "DiskCache.hpp"
+#include "FileBuffer.hpp"
+#include "IoEngine.hpp"
 #include "Options.h"
+#include "PageCache.hpp"
+#include "WriteBack.hpp"
 #include "stuff.hpp"
 
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
 #include <fuse.h>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <unordered_set>
 
 #include <sys/statvfs.h>
 #include <unistd.h>
 
 #include "Logger.h"
 #include "Messages.hpp"
+#include "SHA.h"
 #include "Serialize.hpp"
 
 static Client*         client;
 static AsyncSslClientTransport* asyncTransport;
+static AttrCache*               attr_cache;
+static BlockStore*              block_store;
+static PageCache*               page_cache;
+static DiskCache*               disk_cache;
+static WriteBack*               write_back;
 
-template<typename R, typename M>
-R call(M msg) {
-    auto ret = asyncTransport->send_msg_and_wait(Serialize::serialize(AnyMsgT{msg}));
+// Largest read and write requests, agreed with the server after logging in
+static uint64_t max_read  = 128 * 1024;
+static uint64_t max_write = 128 * 1024;
 
-    auto deserialized = Serialize::deserialize<AnyMsgT>(ret);
-    if (!std::holds_alternative<R>(deserialized)) {
-        if (std::holds_alternative<ErrorReply>(deserialized)) {
-            throw Exception("Error when reading: " + std::get<ErrorReply>(deserialized).error);
+// Write requests the background write back sends at once
+static constexpr size_t write_back_batch = 8;
+
+template<typename R>
+R expect(const AnyMsgT& reply) {
+    if (!std::holds_alternative<R>(reply)) {
+        if (std::holds_alternative<ErrorReply>(reply)) {
+            throw Exception("Error when reading: " + std::get<ErrorReply>(reply).error);
         } else {
             throw Exception("Unexpected reply from server");
         }
     }
-    return std::get<R>(deserialized);
+    return std::get<R>(reply);
+}
+
+template<typename R, typename M>
+R call(M msg) {
+    auto ret = asyncTransport->send_msg_and_wait(Serialize::serialize(AnyMsgT{msg}));
+    return expect<R>(Serialize::deserialize<AnyMsgT>(ret));
+}
+
+// Collects requests and sends them in a single CompoundReq, the server stops at the first one that fails
+class Batch {
+public:
+    template<typename M>
+    void add(M msg) {
+        _ops.push_back(Serialize::serialize(AnyMsgT{std::move(msg)}));
+    }
+
+    // Replies of the executed requests in order, shorter than the batch if one of them failed
+    std::vector<AnyMsgT> send() {
+        auto ret = call<CompoundReply>(CompoundReq{std::move(_ops)});
+        _ops.clear();
+
+        std::vector<AnyMsgT> replies;
+        replies.reserve(ret.replies.size());
+        for (const auto& reply: ret.replies)
+            replies.push_back(Serialize::deserialize<AnyMsgT>(reply));
+        return replies;
+    }
+
+private:
+    std::vector<std::vector<uint8_t>> _ops;
+};
+
+// Copies the data of a read reply into buf filling holes with zeros, returns the number of bytes read
+static size_t unpack_read(const ReadReply& ret, char* buf, size_t size) {
+    size_t out = 0;
+    size_t in  = 0;
+    for (const auto& [off, len]: ret.holes) {
+        if (off < out || off > size || off - out > ret.data.size() - in)
+            break;
+
+        size_t data_len = checked_cast<size_t>(off) - out;
+        std::memcpy(buf + out, ret.data.data() + in, data_len);
+        in += data_len;
+        out += data_len;
+
+        size_t hole_len = std::min(checked_cast<size_t>(len), size - out);
+        std::memset(buf + out, 0, hole_len);
+        out += hole_len;
+    }
+
+    size_t rest = std::min(ret.data.size() - in, size - out);
+    std::memcpy(buf + out, ret.data.data() + in, rest);
+    return out + rest;
+}
+
+// An open file the server gave us a lease on, its data is cached in buffer until the lease is returned
+struct OpenFile {
+    std::mutex                mutex;
+    std::string               path;
+    LeaseType                 lease = LeaseType::NONE;
+    std::optional<FileBuffer> buffer;
+};
+
+static std::mutex                                              open_files_mutex;
+static std::unordered_map<uint64_t, std::shared_ptr<OpenFile>> open_files;
+static std::unordered_set<uint64_t>                            early_recalls; // Recalled before open returned
+
+static std::shared_ptr<OpenFile> find_open_file(uint64_t handle) {
+    std::lock_guard lock(open_files_mutex);
+    auto            found = open_files.find(handle);
+    return found == open_files.end() ? nullptr : found->second;
+}
+
+// Shared by the buffers of all leased files, so their total size is bounded
+static FileBuffer::BudgetT lease_budget = std::make_shared<std::atomic<size_t>>(0);
+
+// Reads and writes whole blocks of the file through its handle
+// Runs of adjacent blocks go in a single request, up to the agreed size
+static FileBuffer make_buffer(uint64_t handle, uint64_t size) {
+    size_t bs = Options::get<size_t>("lease_block");
+    return {bs, Options::get<size_t>("lease_cache_size"), size,
+            [handle, bs](const std::vector<uint64_t>& blocks) {
+                size_t per_req = std::max<size_t>(max_read / bs, 1);
+
+                // First block and number of blocks of each request
+                std::vector<std::pair<uint64_t, size_t>> runs;
+                for (uint64_t block: blocks) {
+                    if (!runs.empty() && runs.back().first + runs.back().second == block &&
+                        runs.back().second < per_req)
+                        runs.back().second++;
+                    else
+                        runs.emplace_back(block, 1);
+                }
+
+                Batch batch;
+                for (const auto& [first, count]: runs)
+                    batch.add(ReadReq{handle, checked_cast<off_t>(first * bs), count * bs});
+                auto replies = batch.send();
+                if (replies.size() != runs.size())
+                    throw Exception("Could not read blocks");
+
+                std::vector<std::vector<uint8_t>> ret;
+                std::vector<uint8_t>              data;
+                for (size_t i = 0; i < runs.size(); i++) {
+                    size_t len = runs[i].second * bs;
+                    data.resize(len);
+                    data.resize(unpack_read(expect<ReadReply>(replies[i]), reinterpret_cast<char*>(data.data()), len));
+                    // Blocks past the end of the file come back empty
+                    for (size_t b = 0; b < runs[i].second; b++) {
+                        size_t from = std::min(b * bs, data.size());
+                        size_t to   = std::min(from + bs, data.size());
+                        ret.emplace_back(data.begin() + checked_cast<ptrdiff_t>(from),
+                                         data.begin() + checked_cast<ptrdiff_t>(to));
+                    }
+                }
+                return ret;
+            },
+            [handle, bs](const std::vector<std::pair<uint64_t, const std::vector<uint8_t>*>>& blocks) {
+                Batch  batch;
+                size_t sent = 0;
+                for (size_t i = 0; i < blocks.size();) {
+                    // A short block can only be the last of a run, anything after it would leave a gap
+                    std::vector<uint8_t> data = *blocks[i].second;
+                    size_t               next = i + 1;
+                    while (next < blocks.size() && blocks[next].first == blocks[next - 1].first + 1 &&
+                           blocks[next - 1].second->size() == bs &&
+                           data.size() + blocks[next].second->size() <= max_write) {
+                        data.insert(data.end(), blocks[next].second->begin(), blocks[next].second->end());
+                        next++;
+                    }
+
+                    batch.add(WriteReq{handle, checked_cast<off_t>(blocks[i].first * bs), data.size(),
+                                       std::move(data)});
+                    sent++;
+                    i = next;
+                }
+                auto replies = batch.send();
+                if (replies.size() != sent)
+                    throw Exception("Could not write back blocks");
+            },
+            lease_budget};
+}
+
+// Writes back what the lease let us buffer and gives it up, the file is then accessed through the server
+static void return_lease(uint64_t handle) {
+    auto file = find_open_file(handle);
+    if (!file) {
+        std::lock_guard lock(open_files_mutex);
+        early_recalls.insert(handle);
+        return;
+    }
+
+    std::lock_guard lock(file->mutex);
+    if (file->lease == LeaseType::NONE)
+        return;
+
+    try {
+        file->buffer->flush();
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, std::string("Could not write back before returning lease: ") + e.what(),
+                    Logger::ERROR);
+    }
+    file->buffer.reset();
+    file->lease = LeaseType::NONE;
+    call<LeaseReply>(LeaseReq{handle, LeaseType::NONE});
+}
+
+static void track_lease(uint64_t handle, const char* path, LeaseType lease, uint64_t size) {
+    if (lease == LeaseType::NONE)
+        return;
+
+    auto file   = std::make_shared<OpenFile>();
+    file->path  = path;
+    file->lease = lease;
+    file->buffer.emplace(make_buffer(handle, size));
+
+    bool recalled;
+    {
+        std::lock_guard lock(open_files_mutex);
+        recalled = early_recalls.erase(handle) > 0;
+        open_files.emplace(handle, file);
+    }
+    if (recalled)
+        return_lease(handle);
+}
+
+// Attributes of a file we hold a lease on come through its handle, so asking doesn't recall our own lease,
+// and include the size of buffered writes
+static std::optional<GetattrReply> leased_attrs(const std::string& path) {
+    std::vector<std::pair<uint64_t, std::shared_ptr<OpenFile>>> candidates;
+    {
+        std::lock_guard lock(open_files_mutex);
+        for (const auto& [handle, file]: open_files)
+            candidates.emplace_back(handle, file);
+    }
+
+    for (const auto& [handle, file]: candidates) {
+        std::lock_guard lock(file->mutex);
+        if (file->path != path || !file->buffer)
+            continue;
+
+        auto ret = call<GetattrReply>(FgetattrReq{handle});
+        ret.size = file->buffer->size();
+        return ret;
+    }
+    return std::nullopt;
+}
+
+// Attributes from the server don't include writes still being written back
+static void add_pending_writes(const std::string& path, GetattrReply& ret) {
+    auto dirty = write_back->dirty(path);
+    if (!dirty)
+        return;
+
+    ret.size     = std::max(ret.size, dirty->end);
+    auto written = std::chrono::duration_cast<std::chrono::nanoseconds>(dirty->written.time_since_epoch()).count();
+    auto mtime   = ret.mtime_sec * 1000000000LL + ret.mtime_nsec;
+    if (written > mtime) {
+        ret.mtime_sec  = written / 1000000000LL;
+        ret.mtime_nsec = written % 1000000000LL;
+    }
+}
+
+static int fill_stat(const GetattrReply& ret, struct stat* stbuf) {
+    switch (ret.type) {
+        case FileType::NONE:
+            return -ENOENT;
+            break;
+        case FileType::DIRECTORY:
+            stbuf->st_mode = S_IFDIR;
+            break;
+        case FileType::REG_FILE:
+            stbuf->st_mode = S_IFREG;
+            break;
+        case FileType::SYMLINK:
+            stbuf->st_mode = S_IFLNK;
+            break;
+        default:
+            return -ENOENT;
+    }
+
+    stbuf->st_mode |= checked_cast<mode_t>(ret.mode);
+
+    stbuf->st_size         = checked_cast<off_t>(ret.size);
+    stbuf->st_nlink        = checked_cast<nlink_t>(ret.links);
+    stbuf->st_ino          = checked_cast<ino_t>(ret.ino);
+    stbuf->st_mtim.tv_sec  = ret.mtime_sec;
+    stbuf->st_mtim.tv_nsec = ret.mtime_nsec;
+
+    return 0;
+}
+
+static std::string join_path(const char* dir, const std::string& name) {
+    if (strcmp(dir, "/") == 0)
+        return "/" + name;
+    return std::string(dir) + "/" + name;
+}
+
+// Drops cached attributes of a path that was changed locally, and of its parent directory
+static void invalidate_attrs(const char* path) {
+    std::string str(path);
+    attr_cache->invalidate(str);
+
+    auto slash = str.rfind('/');
+    if (slash != std::string::npos)
+        attr_cache->invalidate(slash == 0 ? "/" : str.substr(0, slash));
+}
+
+// Drops cached data of a file that was changed locally
+static void invalidate_data(const std::string& path) {
+    page_cache->invalidate(path);
+    disk_cache->invalidate(path);
+}
+
+static void invalidate_data_tree(const std::string& path) {
+    page_cache->invalidate_tree(path);
+    disk_cache->invalidate_tree(path);
 }
 
 static int rfsGetattr(const char* path, struct stat* stbuf) {
@@ -42,49 +345,110 @@ static int rfsGetattr(const char* path, struct stat* stbuf) {
         if (strcmp(path, "/") == 0) {
             stbuf->st_mode  = S_IFDIR | 0755;
             stbuf->st_nlink = 2;
+            stbuf->st_ino   = 1;
             return 0;
         }
 
-        auto ret = call<GetattrReply>(GetattrReq{path});
-        switch (ret.type) {
-            case FileType::NONE:
-                return -ENOENT;
-                break;
-            case FileType::DIRECTORY:
-                stbuf->st_mode = S_IFDIR;
-                break;
-            case FileType::REG_FILE:
-                stbuf->st_mode = S_IFREG;
-                break;
-            case FileType::SYMLINK:
-                stbuf->st_mode = S_IFLNK;
-                break;
-            default:
-                return -ENOENT;
-        }
-
-        stbuf->st_mode |= checked_cast<mode_t>(ret.mode);
-        stbuf->st_size  = checked_cast<off_t>(ret.size);
-        stbuf->st_nlink = checked_cast<nlink_t>(ret.links);
+        if (auto leased = leased_attrs(path)) {
+            return fill_stat(*leased, stbuf);
+        }
+        if (auto cached = attr_cache->get(path)) {
+            add_pending_writes(path, *cached);
+            return fill_stat(*cached, stbuf);
+        }
 
-        return 0;
+        auto generation = attr_cache->generation();
+        auto ret        = call<GetattrReply>(GetattrReq{path});
+        attr_cache->put(path, ret, generation);
+        add_pending_writes(path, ret);
+        return fill_stat(ret, stbuf);
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
         return -EIO;
     }
 }
 
-static int rfsReaddir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi) {
+static int rfsFgetattr(const char* path, struct stat* stbuf, struct fuse_file_info* fi) {
     try {
-        filler(buf, ".", NULL, 0);
-        filler(buf, "..", NULL, 0);
-        auto ret = call<ReaddirReply>(ReaddirReq{path});
+        memset(stbuf, 0, sizeof(struct stat));
+        auto ret = call<GetattrReply>(FgetattrReq{fi->fh});
+        add_pending_writes(path, ret);
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            if (file->buffer)
+                ret.size = file->buffer->size();
+        }
+        return fill_stat(ret, stbuf);
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
+// Position of an open directory listing and the not yet returned rest of the last fetched page
+struct DirCursor {
+    uint64_t             cookie = 0;
+    bool                 eof    = false;
+    std::deque<DirEntry> entries;
+};
 
-        for (auto const& e: ret.path) {
-            filler(buf, e.c_str(), NULL, 0);
+static int rfsOpendir(const char* path, struct fuse_file_info* fi) {
+    fi->fh = reinterpret_cast<uint64_t>(new DirCursor());
+    return 0;
+}
+
+static int rfsReleasedir(const char* path, struct fuse_file_info* fi) {
+    delete reinterpret_cast<DirCursor*>(fi->fh);
+    return 0;
+}
+
+static int rfsReaddir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi) {
+    try {
+        auto* cursor = reinterpret_cast<DirCursor*>(fi->fh);
+        if (cursor->cookie != checked_cast<uint64_t>(offset)) {
+            // Rewound or seeked, continue from where the kernel asks
+            cursor->cookie = checked_cast<uint64_t>(offset);
+            cursor->eof    = false;
+            cursor->entries.clear();
         }
 
-        return 0;
+        while (true) {
+            if (cursor->entries.empty()) {
+                if (cursor->eof)
+                    return 0;
+
+                auto generation = attr_cache->generation();
+                auto ret        = call<ReaddirPlusReply>(
+                        ReaddirPlusReq{path, cursor->cookie, Options::get<size_t>("readdir_page")});
+                cursor->eof = ret.eof;
+                for (auto& e: ret.entries) {
+                    if (e.name != "." && e.name != "..") {
+                        // Saves a getattr round trip per entry for e.g. ls -l
+                        attr_cache->put(join_path(path, e.name),
+                                        GetattrReply{e.type, e.mode, e.links, e.size, e.ino, e.mtime_sec, e.mtime_nsec},
+                                        generation);
+                    }
+                    cursor->entries.push_back(std::move(e));
+                }
+                if (cursor->entries.empty())
+                    return 0;
+            }
+
+            const auto& e = cursor->entries.front();
+
+            struct stat st{};
+            bool        dot = e.name == "." || e.name == "..";
+            if (!dot) {
+                fill_stat(GetattrReply{e.type, e.mode, e.links, e.size, e.ino, e.mtime_sec, e.mtime_nsec}, &st);
+            }
+
+            // The buffer is full, the entry is returned again on the next call
+            if (filler(buf, e.name.c_str(), dot ? nullptr : &st, checked_cast<off_t>(e.cookie)) != 0)
+                return 0;
+
+            cursor->cookie = e.cookie;
+            cursor->entries.pop_front();
+        }
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
         return -EIO;
@@ -93,12 +457,24 @@ static int rfsReaddir(const char* path, void* buf, fuse_fill_dir_t filler, off_t
 
 static int rfsOpen(const char* path, struct fuse_file_info* fi) {
     try {
-        auto ret = call<OpenReply>(OpenReq{path});
+        Batch batch;
+        batch.add(OpenReq{path, (fi->flags & O_ACCMODE) != O_RDONLY});
+        if (Options::get<size_t>("lease_cache_size") > 0) {
+            // Reading only needs nobody else to write the file
+            batch.add(LeaseReq{0, (fi->flags & O_ACCMODE) == O_RDONLY ? LeaseType::READ : LeaseType::WRITE});
+            batch.add(FgetattrReq{0});
+        }
+        auto replies = batch.send();
 
+        auto ret = expect<OpenReply>(replies.at(0));
         if (ret.ok != 1) {
             return -ENOENT;
         }
 
+        fi->fh = ret.handle;
+        if (replies.size() > 2) {
+            track_lease(ret.handle, path, expect<LeaseReply>(replies[1]).type, expect<GetattrReply>(replies[2]).size);
+        }
         return 0;
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
@@ -106,12 +482,236 @@ static int rfsOpen(const char* path, struct fuse_file_info* fi) {
     }
 }
 
+// Reads whole blocks, asking the server for their hashes first and only fetching the ones not in the block store
+static size_t read_deduped(uint64_t handle, char* buf, size_t size, off_t offset) {
+    auto hashes = call<ReadHashesReply>(ReadHashesReq{handle, offset, size});
+    if (hashes.ok < 0 || hashes.block_size == 0)
+        throw Exception("Could not get block hashes");
+
+    uint64_t bs    = hashes.block_size;
+    uint64_t first = checked_cast<uint64_t>(offset) / bs;
+
+    std::vector<BlockStore::BlockT> blocks(hashes.hashes.size());
+    std::vector<size_t>             missing;
+    Batch                           batch;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        uint64_t start = (first + i) * bs;
+        auto     block = block_store->get(hashes.hashes[i]);
+        if (block && block->size() == std::min(bs, hashes.size - start)) {
+            blocks[i] = std::move(block);
+        } else {
+            missing.push_back(i);
+            batch.add(ReadReq{handle, checked_cast<off_t>(start), bs});
+        }
+    }
+
+    if (!missing.empty()) {
+        auto replies = batch.send();
+        if (replies.size() != missing.size())
+            throw Exception("Could not read blocks");
+
+        for (size_t i = 0; i < missing.size(); i++) {
+            std::vector<uint8_t> data(bs);
+            data.resize(unpack_read(expect<ReadReply>(replies[i]), reinterpret_cast<char*>(data.data()), bs));
+            // Hashed again in case the file changed since the hashes were taken
+            auto hash  = SHA::calculate(reinterpret_cast<const char*>(data.data()), data.size());
+            auto block = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+            block_store->put(hash, block);
+            blocks[missing[i]] = std::move(block);
+        }
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < blocks.size() && out < size; i++) {
+        uint64_t start = (first + i) * bs;
+        uint64_t from  = std::max(checked_cast<uint64_t>(offset), start) - start;
+        if (blocks[i]->size() <= from)
+            break;
+
+        size_t n = std::min(checked_cast<size_t>(blocks[i]->size() - from), size - out);
+        std::memcpy(buf + out, blocks[i]->data() + from, n);
+        out += n;
+
+        if (blocks[i]->size() < bs)
+            break;
+    }
+    return out;
+}
+
+// Adds the reads of whole blocks, returns the number of requests added
+static size_t add_block_reads(Batch& batch, uint64_t handle, uint64_t first, const std::vector<size_t>& which,
+                              uint64_t bs) {
+    size_t requests = 0;
+    for (auto i: which) {
+        // Blocks can be larger than what the server reads at once
+        for (uint64_t from = 0; from < bs; from += max_read, requests++)
+            batch.add(ReadReq{handle, checked_cast<off_t>((first + i) * bs + from), std::min(max_read, bs - from)});
+    }
+    return requests;
+}
+
+// Data of a block read by add_block_reads, reply is advanced past its replies
+static std::vector<uint8_t> unpack_block(const std::vector<AnyMsgT>& replies, size_t& reply, uint64_t bs) {
+    std::vector<uint8_t> data(bs);
+    size_t               got = 0;
+    for (uint64_t from = 0; from < bs; from += max_read) {
+        auto   want = checked_cast<size_t>(std::min(max_read, bs - from));
+        auto*  into = reinterpret_cast<char*>(data.data()) + from;
+        size_t n    = unpack_read(expect<ReadReply>(replies.at(reply++)), into, want);
+        // Past the end of file, the rest of the replies are empty
+        if (got == from)
+            got += n;
+    }
+    data.resize(got);
+    return data;
+}
+
+// Whether a block still has the contents the server hashed
+static bool same_digest(const ChecksumReply& ret, const std::vector<uint8_t>& data) {
+    if (ret.ok < 0 || ret.len != data.size())
+        return false;
+
+    Checksum checksum(Checksum::Algorithm::XXH64, ret.chunk_size, 1);
+    auto     digest = checksum.compute(
+            [&](char* buf, size_t len, uint64_t off) {
+                size_t n = std::min(len, checked_cast<size_t>(data.size() - off));
+                std::memcpy(buf, data.data() + off, n);
+                return checked_cast<ssize_t>(n);
+            },
+            0, data.size());
+    return digest == ret.digest;
+}
+
+// Copies size bytes at start out of consecutive blocks, the first of which holds start
+static size_t copy_blocks(const std::vector<PageCache::BlockT>& blocks, uint64_t bs, uint64_t start, char* buf,
+                          size_t size) {
+    uint64_t first = start / bs;
+    size_t   out   = 0;
+    for (size_t i = 0; i < blocks.size() && out < size; i++) {
+        uint64_t block_start = (first + i) * bs;
+        uint64_t from        = std::max(start, block_start) - block_start;
+        if (blocks[i]->size() <= from)
+            break;
+
+        size_t n = std::min(checked_cast<size_t>(blocks[i]->size() - from), size - out);
+        std::memcpy(buf + out, blocks[i]->data() + from, n);
+        out += n;
+
+        if (blocks[i]->size() < bs)
+            break;
+    }
+    return out;
+}
+
+// Reads through the page cache and the disk cache, fetching the missing blocks in one round trip
+static size_t read_cached(uint64_t handle, const char* path, char* buf, size_t size, off_t offset) {
+    auto attrs = attr_cache->get(path);
+    if (!attrs) {
+        auto generation = attr_cache->generation();
+        attrs           = call<GetattrReply>(FgetattrReq{handle});
+        attr_cache->put(path, *attrs, generation);
+    }
+    if (attrs->type != FileType::REG_FILE) {
+        auto ret = call<ReadReply>(ReadReq{handle, offset, size});
+        return unpack_read(ret, buf, size);
+    }
+
+    auto token = page_cache->validate(path, attrs->size, attrs->mtime_sec, attrs->mtime_nsec);
+    auto start = checked_cast<uint64_t>(offset);
+    if (start >= attrs->size || size == 0)
+        return 0;
+    size = checked_cast<size_t>(std::min<uint64_t>(size, attrs->size - start));
+
+    uint64_t bs    = page_cache->block_size();
+    uint64_t first = start / bs;
+    uint64_t count = (start + size - 1) / bs - first + 1;
+
+    DiskCache::Version             version{attrs->size, attrs->mtime_sec, attrs->mtime_nsec};
+    std::vector<PageCache::BlockT> blocks(count);
+    auto                           store = [&](size_t i, std::vector<uint8_t> data) {
+        auto block = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        page_cache->put(path, first + i, block, token);
+        blocks[i] = std::move(block);
+    };
+    auto fetched = [&](size_t i, std::vector<uint8_t> data) {
+        disk_cache->put(path, first + i, version, data);
+        store(i, std::move(data));
+    };
+
+    std::vector<size_t>                                  missing;
+    std::vector<std::pair<size_t, std::vector<uint8_t>>> stale; // On disk for another version of the file
+    for (size_t i = 0; i < count; i++) {
+        blocks[i] = page_cache->get(path, first + i);
+        if (blocks[i])
+            continue;
+        if (auto cached = disk_cache->get(path, first + i, version)) {
+            if (cached->current)
+                store(i, std::move(cached->data));
+            else
+                stale.emplace_back(i, std::move(cached->data));
+            continue;
+        }
+        missing.push_back(i);
+    }
+    if (missing.empty() && stale.empty())
+        return copy_blocks(blocks, bs, start, buf, size);
+
+    // Stale blocks are compared by their hash in the same round trip the missing ones are read in
+    Batch batch;
+    for (const auto& [i, data]: stale)
+        batch.add(ChecksumReq{path, (first + i) * bs, data.size(), ChecksumAlgorithm::XXH64});
+    size_t requests = add_block_reads(batch, handle, first, missing, bs);
+
+    auto replies = batch.send();
+    if (replies.size() != stale.size() + requests)
+        throw Exception("Could not read blocks");
+
+    std::vector<size_t> changed;
+    for (size_t s = 0; s < stale.size(); s++) {
+        auto& [i, data] = stale[s];
+        if (same_digest(expect<ChecksumReply>(replies[s]), data)) {
+            disk_cache->revalidate(path, first + i, version);
+            store(i, std::move(data));
+        } else {
+            changed.push_back(i);
+        }
+    }
+    size_t reply = stale.size();
+    for (auto i: missing)
+        fetched(i, unpack_block(replies, reply, bs));
+
+    if (!changed.empty()) {
+        Batch again;
+        requests = add_block_reads(again, handle, first, changed, bs);
+        replies  = again.send();
+        if (replies.size() != requests)
+            throw Exception("Could not read blocks");
+        reply = 0;
+        for (auto i: changed)
+            fetched(i, unpack_block(replies, reply, bs));
+    }
+    return copy_blocks(blocks, bs, start, buf, size);
+}
+
 static int rfsRead(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
     try {
-        auto   ret        = call<ReadReply>(ReadReq{path, offset, size});
-        size_t reallyRead = std::min(ret.data.size(), size);
-        std::memcpy(buf, ret.data.data(), reallyRead);
-        return checked_cast<int>(reallyRead);
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            if (file->buffer)
+                return checked_cast<int>(file->buffer->read(buf, size, checked_cast<uint64_t>(offset)));
+        }
+
+        // Writes through this or another handle of the file have to be seen
+        write_back->drain(fi->fh);
+        write_back->drain_path(path);
+
+        if (block_store->enabled())
+            return checked_cast<int>(read_deduped(fi->fh, buf, size, offset));
+        if (page_cache->enabled() || disk_cache->enabled())
+            return checked_cast<int>(read_cached(fi->fh, path, buf, size, offset));
+
+        auto ret = call<ReadReply>(ReadReq{fi->fh, offset, size});
+        return checked_cast<int>(unpack_read(ret, buf, size));
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
         return -EIO;
@@ -120,7 +720,45 @@ static int rfsRead(const char* path, char* buf, size_t size, off_t offset, struc
 
 static int rfsWrite(const char* path, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
     try {
-        auto ret = call<WriteReply>(WriteReq{path, offset, size, std::vector<uint8_t>(buf, buf + size)});
+        invalidate_attrs(path);
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            if (file->buffer) {
+                file->buffer->write(buf, size, checked_cast<uint64_t>(offset));
+                // A read lease only keeps the cache valid, the write still has to reach the server
+                if (file->lease != LeaseType::WRITE)
+                    file->buffer->flush();
+                return checked_cast<int>(size);
+            }
+        }
+
+        // Blocks on disk are dropped rather than patched, they are only there for the next mount
+        disk_cache->invalidate(path);
+        if (write_back->enabled()) {
+            page_cache->write(path, buf, size, checked_cast<uint64_t>(offset));
+            write_back->write(fi->fh, path, buf, size, checked_cast<uint64_t>(offset));
+            return checked_cast<int>(size);
+        }
+
+        if (!page_cache->enabled()) {
+            auto ret = call<WriteReply>(WriteReq{fi->fh, offset, size, std::vector<uint8_t>(buf, buf + size)});
+            return ret.len;
+        }
+
+        // The attributes right after the write are the version of the file the patched blocks belong to
+        Batch batch;
+        batch.add(WriteReq{fi->fh, offset, size, std::vector<uint8_t>(buf, buf + size)});
+        batch.add(FgetattrReq{fi->fh});
+        auto replies = batch.send();
+
+        auto ret = expect<WriteReply>(replies.at(0));
+        if (ret.len == checked_cast<int>(size) && replies.size() > 1) {
+            auto attrs = expect<GetattrReply>(replies[1]);
+            page_cache->write(path, buf, size, checked_cast<uint64_t>(offset));
+            page_cache->wrote(path, attrs.size, attrs.mtime_sec, attrs.mtime_nsec);
+        } else {
+            invalidate_data(path);
+        }
         return ret.len;
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
@@ -128,9 +766,45 @@ static int rfsWrite(const char* path, const char* buf, size_t size, off_t offset
     }
 }
 
+static int rfsFallocate(const char* path, int mode, off_t offset, off_t length, struct fuse_file_info* fi) {
+    try {
+        invalidate_attrs(path);
+        invalidate_data(path);
+        // Not worth mirroring in the cache, rare enough to just go through the server
+        if (find_open_file(fi->fh))
+            return_lease(fi->fh);
+        write_back->drain(fi->fh);
+        auto ret = call<FallocateReply>(FallocateReq{fi->fh, mode, offset, length});
+        return ret.ok;
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
 static int rfsCreate(const char* path, mode_t mode, struct fuse_file_info* fi) {
     try {
-        auto ret = call<CreateReply>(CreateReq{std::string(path), static_cast<int>(mode)});
+        invalidate_attrs(path);
+        auto generation = attr_cache->generation();
+
+        Batch batch;
+        batch.add(CreateReq{std::string(path), static_cast<int>(mode)});
+        // The kernel asks for the attributes of the new file right away, get them in the same round trip
+        batch.add(FgetattrReq{0});
+        if (Options::get<size_t>("lease_cache_size") > 0) {
+            batch.add(LeaseReq{0, LeaseType::WRITE});
+        }
+        auto replies = batch.send();
+
+        auto ret = expect<CreateReply>(replies.at(0));
+        fi->fh   = ret.handle;
+        if (ret.ok == 0 && replies.size() > 1) {
+            auto attrs = expect<GetattrReply>(replies[1]);
+            attr_cache->put(path, attrs, generation);
+            if (replies.size() > 2) {
+                track_lease(ret.handle, path, expect<LeaseReply>(replies[2]).type, attrs.size);
+            }
+        }
         return ret.ok;
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
@@ -140,6 +814,7 @@ static int rfsCreate(const char* path, mode_t mode, struct fuse_file_info* fi) {
 
 static int rfsMkdir(const char* path, mode_t mode) {
     try {
+        invalidate_attrs(path);
         auto ret = call<MkdirReply>(MkdirReq{std::string(path), static_cast<int>(mode)});
         return ret.ok;
     } catch (std::exception& e) {
@@ -150,6 +825,7 @@ static int rfsMkdir(const char* path, mode_t mode) {
 
 static int rfsRmdir(const char* path) {
     try {
+        invalidate_attrs(path);
         auto ret = call<RmdirReply>(RmdirReq{std::string(path)});
         return ret.ok;
     } catch (std::exception& e) {
@@ -160,6 +836,8 @@ static int rfsRmdir(const char* path) {
 
 static int rfsUnlink(const char* path) {
     try {
+        invalidate_attrs(path);
+        invalidate_data(path);
         auto ret = call<UnlinkReply>(UnlinkReq{std::string(path)});
         return ret.ok;
     } catch (std::exception& e) {
@@ -170,6 +848,9 @@ static int rfsUnlink(const char* path) {
 
 static int rfsTruncate(const char* path, off_t size) {
     try {
+        invalidate_attrs(path);
+        invalidate_data(path);
+        write_back->drain_path(path);
         auto ret = call<TruncateReply>(TruncateReq{std::string(path), size});
         return ret.res;
     } catch (std::exception& e) {
@@ -178,9 +859,110 @@ static int rfsTruncate(const char* path, off_t size) {
     }
 }
 
+static int rfsFtruncate(const char* path, off_t size, struct fuse_file_info* fi) {
+    try {
+        invalidate_attrs(path);
+        invalidate_data(path);
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            if (file->buffer) {
+                file->buffer->flush();
+                auto ret = call<TruncateReply>(FtruncateReq{fi->fh, size});
+                if (ret.res == 0)
+                    file->buffer->truncate(checked_cast<uint64_t>(size));
+                return ret.res;
+            }
+        }
+
+        write_back->drain(fi->fh);
+        auto ret = call<TruncateReply>(FtruncateReq{fi->fh, size});
+        return ret.res;
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
+static int rfsRelease(const char* path, struct fuse_file_info* fi) {
+    try {
+        // Nobody is left to report an error to, flush already did if the file was closed normally,
+        // the handle is released on the server either way
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            try {
+                if (file->buffer)
+                    file->buffer->flush();
+            } catch (std::exception& e) {
+                Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+            }
+        }
+        {
+            std::lock_guard lock(open_files_mutex);
+            open_files.erase(fi->fh);
+            early_recalls.erase(fi->fh);
+        }
+
+        try {
+            write_back->release(fi->fh);
+        } catch (std::exception& e) {
+            Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        }
+
+        call<ReleaseReply>(ReleaseReq{fi->fh});
+        return 0;
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
+// Called on every close(2), reports errors of writes that were sent in the background
+static int rfsFlush(const char* path, struct fuse_file_info* fi) {
+    try {
+        write_back->sync(fi->fh);
+        return 0;
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
+static int rfsFsync(const char* path, int datasync, struct fuse_file_info* fi) {
+    try {
+        if (auto file = find_open_file(fi->fh)) {
+            std::lock_guard lock(file->mutex);
+            if (file->buffer)
+                file->buffer->flush();
+        }
+        write_back->sync(fi->fh);
+
+        auto ret = call<FsyncReply>(FsyncReq{fi->fh, datasync != 0});
+        return ret.ok;
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
+        return -EIO;
+    }
+}
+
 static int rfsRename(const char* path, const char* newPath) {
     try {
+        invalidate_attrs(path);
+        invalidate_attrs(newPath);
+        // Everything under a renamed directory moves with it
+        attr_cache->invalidate_tree(path);
+        attr_cache->invalidate_tree(newPath);
+        invalidate_data_tree(path);
+        invalidate_data_tree(newPath);
         auto ret = call<RenameReply>(RenameReq{std::string(path), newPath});
+        if (ret.ok == 0) {
+            std::lock_guard lock(open_files_mutex);
+            for (const auto& [handle, file]: open_files) {
+                std::lock_guard file_lock(file->mutex);
+                if (file->path == path)
+                    file->path = newPath;
+            }
+            write_back->rename(path, newPath);
+        }
         return ret.ok;
     } catch (std::exception& e) {
         Logger::log(Logger::RemoteFs, e.what(), Logger::ERROR);
@@ -190,6 +972,7 @@ static int rfsRename(const char* path, const char* newPath) {
 
 static int rfsUtimens(const char* path, const struct timespec time[2]) {
     try {
+        invalidate_attrs(path);
         auto ret =
                 call<UTimensReply>(UTimensReq{path, time[0].tv_sec, time[0].tv_nsec, time[1].tv_sec, time[1].tv_nsec});
         return ret.ok;
@@ -235,6 +1018,7 @@ static int rfsStatfs(const char* path, struct statvfs* stats) {
 
 static int rfsChmod(const char* path, mode_t mode) {
     try {
+        invalidate_attrs(path);
         auto ret = call<ChmodReply>(ChmodReq{std::string(path), static_cast<int>(mode)});
         return ret.ok;
     } catch (std::exception& e) {
@@ -247,45 +1031,122 @@ static int rfsChmod(const char* path, mode_t mode) {
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 
 static struct fuse_operations ops = {
-        .getattr  = rfsGetattr,
-        .mkdir    = rfsMkdir,
-        .unlink   = rfsUnlink,
-        .rmdir    = rfsRmdir,
-        .rename   = rfsRename,
-        .chmod    = rfsChmod,
-        .truncate = rfsTruncate,
-        .utime    = rfsUtime,
-        .open     = rfsOpen,
-        .read     = rfsRead,
-        .write    = rfsWrite,
-        .statfs   = rfsStatfs,
-        .readdir  = rfsReaddir,
-        .create   = rfsCreate,
-        .utimens  = rfsUtimens,
+        .getattr    = rfsGetattr,
+        .mkdir      = rfsMkdir,
+        .unlink     = rfsUnlink,
+        .rmdir      = rfsRmdir,
+        .rename     = rfsRename,
+        .chmod      = rfsChmod,
+        .truncate   = rfsTruncate,
+        .utime      = rfsUtime,
+        .open       = rfsOpen,
+        .read       = rfsRead,
+        .write      = rfsWrite,
+        .statfs     = rfsStatfs,
+        .flush      = rfsFlush,
+        .release    = rfsRelease,
+        .fsync      = rfsFsync,
+        .opendir    = rfsOpendir,
+        .readdir    = rfsReaddir,
+        .releasedir = rfsReleasedir,
+        .create     = rfsCreate,
+        .ftruncate  = rfsFtruncate,
+        .fgetattr   = rfsFgetattr,
+        .utimens    = rfsUtimens,
+        .fallocate  = rfsFallocate,
 };
 
 #pragma GCC diagnostic pop
 
 std::thread keep_alive_thread;
 
+// Logged every this many keepalives
+static constexpr size_t stats_interval = 60;
+
+static void log_cache_stats() {
+    auto stats = attr_cache->stats();
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) {
+                os << "Attribute cache: " << stats.hits << " hits, " << stats.negative_hits << " negative hits, "
+                   << stats.misses << " misses, " << stats.evictions << " evictions, " << stats.entries
+                   << " entries in " << stats.bytes << " bytes";
+            },
+            Logger::INFO);
+
+    if (disk_cache->enabled()) {
+        auto disk = disk_cache->stats();
+        Logger::log(
+                Logger::RemoteFs,
+                [&](std::ostream& os) {
+                    os << "Disk cache: " << disk.hits << " hits, " << disk.stale_hits << " stale hits, " << disk.misses
+                       << " misses, " << disk.evictions << " evicted segments, " << disk.bytes << " bytes";
+                },
+                Logger::INFO);
+    }
+
+    if (!page_cache->enabled())
+        return;
+    auto pages = page_cache->stats();
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) {
+                os << "Page cache: " << pages.hits << " hits, " << pages.misses << " misses, " << pages.evictions
+                   << " evictions, " << pages.bytes << " bytes in " << pages.files << " files";
+            },
+            Logger::INFO);
+}
+
 static void keep_alive() {
-    while (!asyncTransport->is_stopped()) {
+    for (size_t i = 1; !asyncTransport->is_stopped(); i++) {
         try {
             std::this_thread::sleep_for(std::chrono::seconds(1));
             call<KeepAliveReply>(KeepAliveReq{});
+            if (i % stats_interval == 0) {
+                log_cache_stats();
+                disk_cache->sync();
+            }
         } catch (std::exception& e) {
             Logger::log(Logger::RemoteFs, std::string("Keepalive error: ") + e.what(), Logger::ERROR);
         }
     }
 }
 
-void FsClient::run() {
+// Drops whatever the server says changed, runs on the transport thread
+static void handle_push(std::vector<uint8_t> data) {
+    try {
+        auto msg = Serialize::deserialize<AnyMsgT>(data);
+        if (auto* changes = std::get_if<InvalidateNotify>(&msg)) {
+            // Cached data isn't trusted to the mtime alone, as attributes are kept longer when pushes arrive
+            for (const auto& path: changes->paths) {
+                attr_cache->invalidate(path);
+                invalidate_data(path);
+            }
+            for (const auto& tree: changes->trees) {
+                attr_cache->invalidate_tree(tree);
+                invalidate_data_tree(tree);
+            }
+        } else if (auto* recall = std::get_if<LeaseRecallNotify>(&msg)) {
+            // Returning needs replies from the server, which this thread delivers
+            std::thread([handle = recall->handle]() {
+                try {
+                    return_lease(handle);
+                } catch (std::exception& e) {
+                    Logger::log(Logger::RemoteFs, std::string("Could not return lease: ") + e.what(), Logger::ERROR);
+                }
+            }).detach();
+        }
+    } catch (std::exception& e) {
+        Logger::log(Logger::RemoteFs, std::string("Push error: ") + e.what(), Logger::ERROR);
+    }
+}
+
+static LoginReply connect() {
     client = new Client(checked_cast<uint16_t>(Options::get<size_t>("port")), Options::get<std::string>("ip"),
                            Options::get<std::string>("ca_path"), Options::get<std::string>("pk_path"));
 
     client->run();
-    asyncTransport  = &client->transport();
-    keep_alive_thread = std::thread(keep_alive);
+    asyncTransport = &client->transport();
 
     Logger::log(
             Logger::RemoteFs,
@@ -295,7 +1156,59 @@ void FsClient::run() {
             },
             Logger::INFO);
 
-    call<LoginReply>(LoginReq{Options::get<std::string>("username"), Options::get<std::string>("password")});
+    auto login =
+            call<LoginReply>(LoginReq{Options::get<std::string>("username"), Options::get<std::string>("password")});
+
+    auto io_size = Options::get<size_t>("max_io_size");
+    auto agreed  = call<IoSizeReply>(IoSizeReq{io_size, io_size});
+    max_read     = agreed.max_read;
+    max_write    = agreed.max_write;
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) { os << "Reading up to " << max_read << " and writing up to " << max_write; },
+            Logger::INFO);
+
+    return login;
+}
+
+void FsClient::run() {
+    auto login = connect();
+    // Attributes can be kept for longer when the server tells us about changes
+    auto attr_ttl = Options::get<size_t>(login.notify ? "notify_attr_ttl" : "attr_ttl");
+    attr_cache    = new AttrCache(std::chrono::milliseconds(attr_ttl),
+                                  std::chrono::milliseconds(Options::get<size_t>("negative_attr_ttl")),
+                                  Options::get<size_t>("attr_cache_size"), Options::get<size_t>("attr_cache_bytes"));
+    block_store   = new BlockStore(Options::get<size_t>("block_store_size"));
+    page_cache    = new PageCache(Options::get<size_t>("page_cache_size"), Options::get<size_t>("page_cache_block"));
+    disk_cache    = new DiskCache(Options::get<std::string>("disk_cache_dir"), Options::get<size_t>("disk_cache_size"),
+                                  Options::get<size_t>("page_cache_block"));
+    write_back    = new WriteBack(
+            Options::get<size_t>("write_back_size"), Options::get<size_t>("write_back_threads"),
+            std::chrono::milliseconds(Options::get<size_t>("write_back_delay")),
+            max_write * write_back_batch,
+            [](uint64_t handle, const std::string& path, uint64_t off, const std::vector<uint8_t>& data) {
+                // In requests of the agreed size, all in one round trip
+                Batch               batch;
+                std::vector<size_t> lens;
+                for (size_t from = 0; from < data.size(); from += max_write) {
+                    size_t len = std::min<size_t>(max_write, data.size() - from);
+                    batch.add(WriteReq{handle, checked_cast<off_t>(off + from), len,
+                                       std::vector<uint8_t>(data.begin() + checked_cast<ptrdiff_t>(from),
+                                                            data.begin() + checked_cast<ptrdiff_t>(from + len))});
+                    lens.push_back(len);
+                }
+                auto replies = batch.send();
+                if (replies.size() != lens.size())
+                    throw Exception("Could not write back");
+                for (size_t i = 0; i < lens.size(); i++) {
+                    if (expect<WriteReply>(replies[i]).len != checked_cast<int>(lens[i]))
+                        throw Exception("Short write back");
+                }
+                // Attributes fetched while the data was on its way are stale
+                invalidate_attrs(path.c_str());
+            });
+    asyncTransport->set_push_handler(handle_push);
+    keep_alive_thread = std::thread(keep_alive);
 
     char        arg1[] = "";
     char        arg2[] = "-o";
@@ -304,8 +1217,313 @@ void FsClient::run() {
     std::string arg5   = "gid=" + std::to_string(getgid());
     auto        arg6   = Options::get<std::string>("path");
     char        arg8[] = "-f";
+    // Inode numbers come from the server
+    char arg9[]  = "-o";
+    char arg10[] = "use_ino";
+    // The kernel splits reads and writes at these sizes, by default they are much smaller than what we agreed on
+    char        arg11[] = "-o";
+    std::string arg12   = "big_writes,max_write=" + std::to_string(max_write) +
+                        ",max_read=" + std::to_string(max_read) + ",max_readahead=" + std::to_string(max_read);
 
-    int   argc   = 7;
-    char* argv[] = {arg1, arg2, arg3.data(), arg4, arg5.data(), arg6.data(), arg8};
+    int   argc   = 11;
+    char* argv[] = {arg1, arg2, arg3.data(), arg4, arg5.data(), arg6.data(), arg8, arg9, arg10, arg11, arg12.data()};
     std::cout << static_cast<int>(fuse_main(argc, argv, &ops, nullptr));
+    log_cache_stats();
+    disk_cache->sync();
+}
+
+void FsClient::stats() {
+    connect();
+
+    auto ret = call<StatsReply>(StatsReq{});
+    for (const auto& [name, value]: ret.counters) {
+        std::cout << name << " " << value << std::endl;
+    }
+}
+
+void FsClient::copy() {
+    auto from = Options::get<std::string>("from");
+    auto to   = Options::get<std::string>("to");
+    if (from.empty() || to.empty()) {
+        throw Exception("Please specify the files to copy inside the export: --from:<path> --to:<path>");
+    }
+
+    connect();
+
+    auto attr = call<GetattrReply>(GetattrReq{from});
+    if (attr.type != FileType::REG_FILE) {
+        throw Exception("Not a regular file: " + from);
+    }
+
+    auto src = call<OpenReply>(OpenReq{from, false});
+    if (src.ok != 1) {
+        throw Exception("Could not open " + from);
+    }
+    auto dst = call<CreateReply>(CreateReq{to, static_cast<int>(attr.mode & 07777)});
+    if (dst.ok != 0) {
+        throw Exception("Could not create " + to);
+    }
+
+    // Bounds how long a single request keeps a server thread busy
+    const uint64_t chunk = 64 * 1024 * 1024;
+
+    int64_t off = 0;
+    while (true) {
+        auto ret = call<CopyRangeReply>(CopyRangeReq{src.handle, off, dst.handle, off, chunk});
+        if (ret.len < 0) {
+            throw Exception("Copy failed after " + std::to_string(off) + " bytes");
+        }
+        if (ret.len == 0)
+            break;
+        off += ret.len;
+    }
+
+    call<ReleaseReply>(ReleaseReq{src.handle});
+    call<ReleaseReply>(ReleaseReq{dst.handle});
+    std::cout << "Copied " << off << " bytes" << std::endl;
+}
+
+void FsClient::sync() {
+    auto from = Options::get<std::string>("from");
+    auto to   = Options::get<std::string>("to");
+    if (from.empty() || to.empty()) {
+        throw Exception("Please specify a local file and where to put it in the export: --from:<file> --to:<path>");
+    }
+
+    std::ifstream ifs(from, std::ios::binary);
+    if (!ifs.is_open()) {
+        throw Exception("Unable to open file " + from);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    connect();
+
+    // Signatures of the current remote copy, if there is one
+    auto                   base       = call<GetattrReply>(GetattrReq{to});
+    uint64_t               src        = 0;
+    uint64_t               block_size = Delta::block_size_for(data.size());
+    uint64_t               base_size  = 0;
+    std::vector<BlockSigT> sigs;
+    if (base.type == FileType::REG_FILE) {
+        auto opened = call<OpenReply>(OpenReq{to, false});
+        if (opened.ok != 1) {
+            throw Exception("Could not open " + to);
+        }
+        src = opened.handle;
+
+        auto ret = call<SignatureReply>(SignatureReq{src, 0});
+        if (ret.ok != 0) {
+            throw Exception("Could not get signatures of " + to);
+        }
+        block_size = ret.block_size;
+        base_size  = ret.size;
+        sigs       = std::move(ret.blocks);
+    } else if (base.type != FileType::NONE) {
+        throw Exception("Not a regular file: " + to);
+    }
+
+    auto delta = Delta::compute(sigs, block_size, base_size, data.data(), data.size());
+
+    // Written next to the target and renamed over it once complete
+    auto        slash = to.rfind('/');
+    std::string tmp   = to.substr(0, slash + 1) + "." + to.substr(slash + 1) + ".rfs-" +
+                      std::to_string(std::random_device()());
+    auto        dst   = call<CreateReply>(CreateReq{tmp, static_cast<int>(src ? base.mode & 07777 : 0644)});
+    if (dst.ok != 0) {
+        throw Exception("Could not create " + tmp);
+    }
+
+    try {
+        // Bounds the size of a single message
+        const uint64_t max_literal = max_write;
+
+        int64_t  off  = 0;
+        uint64_t sent = 0;
+        auto     it   = delta.begin();
+        while (it != delta.end()) {
+            std::vector<DeltaOp> batch;
+            uint64_t             literal = 0;
+            while (it != delta.end() && (batch.empty() || literal + it->data.size() <= max_literal)) {
+                literal += it->data.size();
+                batch.push_back(std::move(*it++));
+            }
+
+            auto ret = call<DeltaReply>(DeltaReq{src, dst.handle, off, block_size, std::move(batch)});
+            if (ret.len < 0) {
+                throw Exception("Applying the delta failed after " + std::to_string(off) + " bytes");
+            }
+            off += ret.len;
+            sent += literal;
+        }
+
+        if (checked_cast<uint64_t>(off) != data.size()) {
+            throw Exception("Wrote " + std::to_string(off) + " bytes instead of " + std::to_string(data.size()));
+        }
+
+        if (src) {
+            // Blocks were copied from the file as it was when its signatures were taken
+            auto now = call<GetattrReply>(FgetattrReq{src});
+            if (now.size != base.size || now.mtime_sec != base.mtime_sec || now.mtime_nsec != base.mtime_nsec) {
+                throw Exception(to + " changed during the transfer");
+            }
+            call<ReleaseReply>(ReleaseReq{src});
+        }
+        call<ReleaseReply>(ReleaseReq{dst.handle});
+
+        if (call<RenameReply>(RenameReq{tmp, to}).ok != 0) {
+            throw Exception("Could not rename " + tmp + " to " + to);
+        }
+
+        std::cout << "Sent " << sent << " of " << data.size() << " bytes" << std::endl;
+    } catch (...) {
+        call<UnlinkReply>(UnlinkReq{tmp});
+        throw;
+    }
+}
+
+void FsClient::du() {
+    auto from = Options::get<std::string>("from");
+    if (from.empty()) {
+        throw Exception("Please specify a directory inside the export: --from:<path>");
+    }
+
+    connect();
+
+    auto ret = call<TreeSummaryReply>(TreeSummaryReq{from});
+    if (ret.ok != 0) {
+        throw Exception("Could not open " + from);
+    }
+    std::cout << "files " << ret.files << std::endl;
+    std::cout << "dirs " << ret.dirs << std::endl;
+    std::cout << "bytes " << ret.bytes << std::endl;
+    std::cout << "allocated " << ret.allocated << std::endl;
+    std::cout << "denied " << ret.denied << std::endl;
+    std::cout << "errors " << ret.errors << std::endl;
+}
+
+void FsClient::tree() {
+    auto from = Options::get<std::string>("from");
+    if (from.empty()) {
+        throw Exception("Please specify a directory inside the export: --from:<path>");
+    }
+
+    connect();
+
+    std::string after;
+    for (;;) {
+        auto ret = call<TreeStatReply>(TreeStatReq{from, after, Options::get<size_t>("readdir_page")});
+        for (const auto& e: ret.entries) {
+            char type = e.type == FileType::DIRECTORY ? 'd' : e.type == FileType::REG_FILE ? 'f' : '?';
+            std::cout << type << " " << std::oct << (e.mode & 07777) << std::dec << " " << e.size << " "
+                      << e.mtime_sec << " " << e.path << "\n";
+        }
+        if (ret.eof || ret.entries.empty())
+            break;
+        after = ret.entries.back().path;
+    }
+    std::cout.flush();
+}
+
+void FsClient::remove() {
+    auto from = Options::get<std::string>("from");
+    if (from.empty()) {
+        throw Exception("Please specify what to remove inside the export: --from:<path>");
+    }
+
+    connect();
+
+    auto ret = call<TreeRemoveReply>(TreeRemoveReq{from});
+    std::cout << "Removed " << ret.removed << " entries" << std::endl;
+    if (ret.ok != 0) {
+        throw Exception("Could not remove everything, " + std::to_string(ret.denied) + " entries not allowed, " +
+                        std::to_string(ret.errors) + " errors");
+    }
+}
+
+void FsClient::search() {
+    auto from    = Options::get<std::string>("from");
+    auto pattern = Options::get<std::string>("pattern");
+    if (from.empty() || pattern.empty()) {
+        throw Exception("Please specify where and what to search for: --from:<path> --pattern:<text>");
+    }
+
+    connect();
+
+    std::string after;
+    uint64_t    after_off = 0;
+    for (;;) {
+        auto ret = call<SearchReply>(SearchReq{from, Options::get<std::string>("glob"), pattern,
+                                               Options::get<size_t>("regex") != 0, after, after_off,
+                                               Options::get<size_t>("readdir_page")});
+        if (ret.ok != 0) {
+            throw Exception("Could not search " + from);
+        }
+        for (const auto& m: ret.matches)
+            std::cout << m.path << ":" << m.line << ":" << m.text << "\n";
+        if (ret.eof || ret.matches.empty())
+            break;
+        after     = ret.matches.back().path;
+        after_off = ret.matches.back().offset + 1;
+    }
+    std::cout.flush();
+}
+
+void FsClient::checksum() {
+    auto from = Options::get<std::string>("from");
+    if (from.empty()) {
+        throw Exception("Please specify a file inside the export: --from:<path>");
+    }
+
+    auto              name = Options::get<std::string>("algorithm");
+    ChecksumAlgorithm algorithm;
+    if (name == "sha256")
+        algorithm = ChecksumAlgorithm::SHA256;
+    else if (name == "xxh64")
+        algorithm = ChecksumAlgorithm::XXH64;
+    else
+        throw Exception("Unknown checksum algorithm " + name + ", use sha256 or xxh64");
+
+    connect();
+
+    auto ret = call<ChecksumReply>(ChecksumReq{from, 0, std::numeric_limits<uint64_t>::max(), algorithm});
+    if (ret.ok != 0) {
+        throw Exception("Could not hash " + from);
+    }
+    std::cout << Checksum::to_hex(ret.digest) << "  " << from << " (" << ret.len << " bytes)" << std::endl;
+
+    // Compared against a local copy hashed the same way
+    auto to = Options::get<std::string>("to");
+    if (to.empty())
+        return;
+
+    int fd = open(to.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw Exception("Unable to open file " + to);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || checked_cast<uint64_t>(st.st_size) != ret.len) {
+        close(fd);
+        throw Exception("Sizes differ: " + to + " is not " + std::to_string(ret.len) + " bytes long");
+    }
+
+    Checksum    local(algorithm == ChecksumAlgorithm::SHA256 ? Checksum::Algorithm::SHA256 : Checksum::Algorithm::XXH64,
+                      ret.chunk_size, Options::get<size_t>("tree_threads"));
+    std::string digest;
+    try {
+        digest = local.compute(
+                [fd](char* buf, size_t len, uint64_t off) {
+                    return BufferedIo::pread_all(fd, buf, len, checked_cast<off_t>(off));
+                },
+                0, ret.len);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    std::cout << Checksum::to_hex(digest) << "  " << to << std::endl;
+    if (digest != ret.digest) {
+        throw Exception("Checksums differ");
+    }
+    std::cout << "Checksums match" << std::endl;
 }
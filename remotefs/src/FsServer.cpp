@@ -4,21 +4,38 @@
 
 #include "FsServer.hpp"
 
+#include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
+#include <fnmatch.h>
 #include <fstream>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 
 #include "Acl.hpp"
+#include "BlockCache.hpp"
+#include "ChangeWatcher.hpp"
+#include "Checksum.hpp"
+#include "Delta.hpp"
+#include "DirCursorCache.hpp"
 #include "Exception.h"
+#include "FdCache.hpp"
+#include "GroupCommit.hpp"
+#include "HandleTable.hpp"
+#include "IoEngine.hpp"
+#include "LeaseManager.hpp"
 #include "Logger.h"
 #include "Messages.hpp"
+#include "MmapCache.hpp"
 #include "Options.h"
+#include "PathResolver.hpp"
 #include "Serialize.hpp"
+#include "SHA.h"
+#include "Searcher.hpp"
 #include "Server.hpp"
 #include "stuff.hpp"
+#include "TreeWalker.hpp"
 
 static uint32_t parse_ip(const std::string& ip_str) {
     std::istringstream iss(ip_str);
@@ -42,9 +59,304 @@ static uint32_t parse_ip(const std::string& ip_str) {
 
 static ACL acl;
 
+// Smallest read and write size agreed to, a page
+static constexpr uint64_t min_io_size = 4096;
+
+static GetattrReply stat_to_reply(const struct stat& buf) {
+    FileType type = FileType::NONE;
+    if (S_ISDIR(buf.st_mode))
+        type = FileType::DIRECTORY;
+    else if (S_ISREG(buf.st_mode))
+        type = FileType::REG_FILE;
+    else
+        return GetattrReply{FileType::NONE, 0, 0, 0, 0, 0, 0};
+
+    return GetattrReply{type,       buf.st_mode,         buf.st_nlink, checked_cast<uint64_t>(buf.st_size),
+                        buf.st_ino, buf.st_mtim.tv_sec, buf.st_mtim.tv_nsec};
+}
+
+// Whether a reply reports a failed operation, which ends a compound request
+static bool is_failure(const AnyMsgT& reply) {
+    return std::visit(
+            [](const auto& arg) {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, ErrorReply>)
+                    return true;
+                else if constexpr (std::is_same_v<T, OpenReply>)
+                    return arg.ok == 0;
+                else if constexpr (std::is_same_v<T, WriteReply> || std::is_same_v<T, CopyRangeReply> ||
+                                   std::is_same_v<T, DeltaReply>)
+                    return arg.len < 0;
+                else if constexpr (std::is_same_v<T, TruncateReply>)
+                    return arg.res < 0;
+                else if constexpr (requires { arg.ok; })
+                    return arg.ok < 0;
+                else
+                    return false;
+            },
+            reply);
+}
+
+// Holes in [off, off + len) as extents relative to off, empty if the filesystem doesn't report them
+static std::vector<ExtentT> find_holes(int fd, off_t off, size_t len, off_t size) {
+    std::vector<ExtentT> holes;
+
+    off_t end = std::min(off + checked_cast<off_t>(len), size);
+    off_t pos = off;
+    while (pos < end) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data < 0) {
+            // No more data until the end of file
+            if (errno != ENXIO)
+                return {};
+            data = end;
+        }
+        data = std::min(data, end);
+        if (data > pos)
+            holes.emplace_back(checked_cast<uint64_t>(pos - off), checked_cast<uint64_t>(data - pos));
+        if (data >= end)
+            break;
+
+        pos = lseek(fd, data, SEEK_HOLE);
+        if (pos < 0)
+            return {};
+    }
+
+    return holes;
+}
+
+// Drops the hole ranges out of data read at the start of the extents
+static void remove_holes(std::vector<uint8_t>& data, std::vector<ExtentT>& holes) {
+    size_t out = 0;
+    size_t in  = 0;
+    for (auto it = holes.begin(); it != holes.end(); it++) {
+        // The file may have shrunk since the holes were found
+        if (it->first >= data.size()) {
+            holes.erase(it, holes.end());
+            break;
+        }
+        it->second = std::min(it->second, data.size() - it->first);
+
+        std::copy(data.begin() + checked_cast<ssize_t>(in), data.begin() + checked_cast<ssize_t>(it->first),
+                  data.begin() + checked_cast<ssize_t>(out));
+        out += it->first - in;
+        in = it->first + it->second;
+    }
+    std::copy(data.begin() + checked_cast<ssize_t>(in), data.end(), data.begin() + checked_cast<ssize_t>(out));
+    data.resize(out + data.size() - in);
+}
+
+// Files searched at a time by a SearchReq
+static constexpr size_t search_batch = 256;
+
+// Matches the name, or the path relative to root if the glob has a slash in it
+static bool glob_matches(const std::string& glob, const std::string& root, const std::string& path) {
+    if (glob.empty())
+        return true;
+    if (glob.find('/') == std::string::npos)
+        return fnmatch(glob.c_str(), path.substr(path.rfind('/') + 1).c_str(), 0) == 0;
+
+    auto prefix = TreeWalker::join(root, "");
+    return fnmatch(glob.c_str(), path.substr(prefix.size()).c_str(), FNM_PATHNAME) == 0;
+}
+
+// Directory containing a client path
+static std::string parent_path(const std::string& path) {
+    auto slash = path.rfind('/');
+    if (slash == std::string::npos || slash == 0)
+        return "/";
+    return path.substr(0, slash);
+}
+
 class RemoteFsServer : public Server {
 
 private:
+    PathResolver   _resolver{Options::get<std::string>("path"), Options::get<size_t>("dir_fd_cache_size")};
+    IoEngines      _io_engines{Options::get<size_t>("max_io_size"), Options::get<size_t>("direct_io_buffers")};
+    FdCache        _fd_cache{Options::get<size_t>("fd_cache_size"), resolver_open(),
+                      [this](const std::filesystem::path& path) -> IoEngine& {
+                          return _io_engines.for_path(path.native());
+                      },
+                      [this](const std::filesystem::path& path, struct stat& buf) {
+                          return _resolver.stat(path.native(), buf);
+                      }};
+    HandleTable    _handles{Options::get<size_t>("max_handles")};
+    BlockCache     _block_cache{Options::get<size_t>("block_cache_size"), Options::get<size_t>("block_cache_block")};
+    // Hashes of the same blocks as the block cache, so both are invalidated together
+    BlockCache     _hash_cache{Options::get<size_t>("hash_cache_size"), Options::get<size_t>("block_cache_block")};
+    MmapCache      _mmap_cache{Options::get<size_t>("mmap_cache_size"), Options::get<size_t>("mmap_max_file")};
+    DirCursorCache _dir_cursors{Options::get<size_t>("dir_cursor_cache_size"), resolver_open()};
+    GroupCommit    _group_commit{Options::get<size_t>("fsync_group") != 0};
+
+    // Logged in clients, to push notifications to
+    std::mutex                          _clients_mutex;
+    std::unordered_map<int, ClientCtx*> _clients;
+
+    ChangeWatcher _watcher{
+            Options::get<size_t>("watch_limit"),
+            [this](const std::string& path) { return _resolver.open(path, O_PATH | O_DIRECTORY); },
+            [this](int client, const ChangeWatcher::Changes& changes) {
+                push(client, InvalidateNotify{{changes.paths.begin(), changes.paths.end()},
+                                              {changes.trees.begin(), changes.trees.end()}});
+            }};
+
+    TreeWalker _tree_walker{Options::get<size_t>("tree_threads")};
+
+    // Waiting for a recalled lease doesn't hold up a scheduler worker
+    LeaseManager _leases{std::chrono::milliseconds(Options::get<size_t>("lease_recall_timeout")),
+                         [this](int owner, uint64_t handle) { push(owner, LeaseRecallNotify{handle}); },
+                         [this](const std::function<void()>& wait) {
+                             if (auto s = scheduler())
+                                 s->blocking(wait);
+                             else
+                                 wait();
+                         }};
+
+    // Recalls leases of other handles on the file before it is accessed, handle is 0 for path operations
+    // Throws for writes made under a revoked lease, they would overwrite what was written since
+    void break_leases(uint64_t handle, const FdCache::File& file, bool write) {
+        if (write && handle != 0 && _leases.revoked(handle)) {
+            throw Exception("Lease of handle " + std::to_string(handle) + " was revoked");
+        }
+
+        struct stat st;
+        if (_leases.active() && fstat(file.fd(), &st) == 0)
+            _leases.conflict(handle, {st.st_dev, st.st_ino}, write);
+    }
+
+    // Tree operations skip what the client's user may not access
+    static TreeWalker::AllowT tree_allow(ClientCtx& context) {
+        return [&context](const std::string& path) { return acl.authorize_path(*context.client_name, path); };
+    }
+
+    // Drops what the caches hold of an entry about to be removed
+    void forget_entry(const std::string& path, const struct stat& st) {
+        if (S_ISDIR(st.st_mode)) {
+            _resolver.invalidate(path);
+            _dir_cursors.invalidate(path);
+        } else if (S_ISREG(st.st_mode)) {
+            invalidate_blocks(st, 0, checked_cast<uint64_t>(st.st_size));
+            _fd_cache.invalidate(path);
+        }
+    }
+
+    // Sends a message the client didn't ask for, does nothing if it has disconnected
+    void push(int client, const AnyMsgT& msg) {
+        auto            data = Serialize::serialize(msg);
+        std::lock_guard lock(_clients_mutex);
+        auto            found = _clients.find(client);
+        if (found != _clients.end())
+            found->second->transport.send_message(std::make_shared<MsgWrapper>(push_msg_id, std::move(data)));
+    }
+
+    // Makes the caches open files through the resolver, so they stay inside the root
+    FdCache::OpenT resolver_open() {
+        return [this](const std::filesystem::path& path, int flags, mode_t mode) {
+            return _resolver.open(path.native(), flags, mode);
+        };
+    }
+
+    // Reads through the shared block cache, the result is shorter than len only at the end of file
+    std::vector<uint8_t> read_cached(const FdCache::File& file, off_t off, size_t len) {
+        std::vector<uint8_t> out;
+
+        // Files read without the page cache aren't kept in ours either
+        if (!_block_cache.enabled() || !file.cached()) {
+            out.resize(len);
+            ssize_t ret = file.read(out.data(), len, off);
+            out.resize(ret > 0 ? static_cast<size_t>(ret) : 0);
+            return out;
+        }
+
+        struct stat st;
+        if (fstat(file.fd(), &st) < 0) {
+            throw ErrnoException("Could not stat file");
+        }
+
+        BlockCache::Version version{st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+        uint64_t            bs   = _block_cache.block_size();
+        uint64_t            pos  = checked_cast<uint64_t>(off);
+        uint64_t            size = checked_cast<uint64_t>(st.st_size);
+        uint64_t            end  = std::min(pos + len, size);
+
+        out.reserve(end > pos ? end - pos : 0);
+
+        while (pos < end) {
+            uint64_t        block = pos / bs;
+            BlockCache::Key key{st.st_dev, st.st_ino, block};
+
+            auto fill = [&]() {
+                std::vector<uint8_t> buf(bs);
+                ssize_t              ret = file.read(buf.data(), bs, checked_cast<off_t>(block * bs));
+                if (ret < 0) {
+                    throw ErrnoException("Could not read file");
+                }
+                buf.resize(static_cast<size_t>(ret));
+                return buf;
+            };
+
+            auto data = _block_cache.get(key, version, fill);
+            // A short block must end at the end of file, otherwise the file grew without its mtime changing
+            if (data->size() < bs && block * bs + data->size() < size) {
+                _block_cache.invalidate(st.st_dev, st.st_ino, block, block);
+                data = _block_cache.get(key, version, fill);
+            }
+
+            uint64_t in_block = pos - block * bs;
+            if (data->size() <= in_block)
+                break;
+
+            uint64_t n = std::min(data->size() - in_block, end - pos);
+            out.insert(out.end(), data->begin() + checked_cast<ssize_t>(in_block),
+                       data->begin() + checked_cast<ssize_t>(in_block + n));
+            pos += n;
+
+            if (data->size() < bs)
+                break;
+        }
+
+        return out;
+    }
+
+    // Drops cached blocks of the file that overlap the [from, to) byte range
+    void invalidate_blocks(const struct stat& st, uint64_t from, uint64_t to) {
+        if (to <= from)
+            return;
+        uint64_t bs = _block_cache.block_size();
+        _block_cache.invalidate(st.st_dev, st.st_ino, from / bs, (to - 1) / bs);
+        _hash_cache.invalidate(st.st_dev, st.st_ino, from / bs, (to - 1) / bs);
+        _mmap_cache.invalidate(st.st_dev, st.st_ino);
+    }
+
+    // Calls fn(dir_fd, entry, cookie) for up to count entries following cookie
+    // Returns the cookie to continue from and whether the end of the directory was reached
+    template<typename F>
+    std::pair<uint64_t, bool> read_dir_page(const std::string& path, uint64_t cookie, uint64_t count, F fn) {
+        auto dir = _dir_cursors.take(path, cookie);
+        if (!dir) {
+            throw ErrnoException("Could not open directory");
+        }
+
+        count = std::clamp<uint64_t>(count, 1, Options::get<size_t>("readdir_page"));
+        for (uint64_t i = 0; i < count; i++) {
+            errno         = 0;
+            dirent* entry = readdir(dir.get());
+            if (!entry) {
+                if (errno != 0) {
+                    throw ErrnoException("Could not read directory");
+                }
+                return {cookie, true};
+            }
+
+            cookie = checked_cast<uint64_t>(telldir(dir.get()));
+            fn(dirfd(dir.get()), *entry, cookie);
+        }
+
+        // Keep the stream open for the next page
+        _dir_cursors.put(path, cookie, std::move(dir));
+        return {cookie, false};
+    }
+
     std::vector<uint8_t> handle_auth(ClientCtx& context, AnyMsgT msg) {
         return Serialize::serialize(std::visit(
                 [&](auto&& arg) -> AnyMsgT {
@@ -53,7 +365,11 @@ private:
                         Logger::log(Logger::RemoteFs, "Authenticating " + arg.username, Logger::INFO);
                         if (acl.authorize(arg.username, arg.password)) {
                             context.client_name = arg.username;
-                            return LoginReply{};
+                            {
+                                std::lock_guard lock(_clients_mutex);
+                                _clients.emplace(context.id, &context);
+                            }
+                            return LoginReply{_watcher.enabled() ? 1 : 0};
                         } else {
                             throw Exception("Invalid username or password");
                         }
@@ -63,231 +379,775 @@ private:
                 msg));
     }
 
-public:
-    RemoteFsServer(uint16_t port, uint32_t ip, const std::string& cert_path, const std::string& key_path) :
-        Server(port, ip, cert_path, key_path) {}
-
-    std::vector<uint8_t> handle_message(ClientCtx& context, std::vector<uint8_t> data) override {
+    // Runs one op of a compound request, current is the handle that ops with handle 0 refer to
+    AnyMsgT handle_compound_op(ClientCtx& context, const std::vector<uint8_t>& op, uint64_t& current) {
         try {
-            auto msg = Serialize::deserialize<AnyMsgT>(data);
-            if (!context.client_name) {
-                std::lock_guard lock(context.ctx_mutex);
-                if (!context.client_name) {
-                    return handle_auth(context, msg);
-                }
+            auto msg = Serialize::deserialize<AnyMsgT>(op);
+            if (std::holds_alternative<CompoundReq>(msg)) {
+                return ErrorReply("Nested compound requests are not supported");
             }
-            return Serialize::serialize(std::visit(
-                    [&](auto&& arg) -> AnyMsgT {
-                        auto root = std::filesystem::path(Options::get<std::string>("path"));
-                        using T   = std::decay_t<decltype(arg)>;
-                        if constexpr (std::is_same_v<T, GetattrReq>) {
-                            auto path = root.concat(arg.path);
-
-                            if (!std::filesystem::exists(path)) {
-                                return GetattrReply{FileType::NONE, 0, 0, 0};
-                            } else if (std::filesystem::is_directory(path)) {
-                                struct stat buf;
-                                stat(path.c_str(), &buf);
-                                return GetattrReply{FileType::DIRECTORY, buf.st_mode, buf.st_nlink,
-                                                    checked_cast<uint64_t>(buf.st_size)};
-                            } else if (std::filesystem::is_regular_file(path)) {
-                                struct stat buf;
-                                stat(path.c_str(), &buf);
-                                return GetattrReply{FileType::REG_FILE, buf.st_mode, buf.st_nlink,
-                                                    checked_cast<uint64_t>(buf.st_size)};
-                            } else {
-                                return GetattrReply{FileType::NONE, 0, 0, 0};
-                            }
-                        } else if constexpr (std::is_same_v<T, ReaddirReq>) {
-                            auto path = root.concat(arg.path);
 
-                            std::vector<std::string> results;
-                            for (const auto& entry: std::filesystem::directory_iterator(path)) {
-                                results.push_back(entry.path().lexically_relative(root).string());
-                            }
-                            return ReaddirReply{results};
-                        } else if constexpr (std::is_same_v<T, OpenReq>) {
-                            auto path = root.concat(arg.path);
+            std::visit(
+                    [&](auto& arg) {
+                        using T = std::decay_t<decltype(arg)>;
+                        if constexpr (std::is_same_v<T, FgetattrReq> || std::is_same_v<T, ReadReq> ||
+                                      std::is_same_v<T, WriteReq> || std::is_same_v<T, FtruncateReq> ||
+                                      std::is_same_v<T, ReleaseReq> || std::is_same_v<T, FallocateReq> ||
+                                      std::is_same_v<T, LeaseReq> || std::is_same_v<T, FsyncReq>) {
+                            if (arg.handle == 0)
+                                arg.handle = current;
+                        }
+                    },
+                    msg);
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+            auto reply = handle_request(context, msg);
+            if (auto open = std::get_if<OpenReply>(&reply); open && open->handle != 0) {
+                current = open->handle;
+            } else if (auto create = std::get_if<CreateReply>(&reply); create && create->handle != 0) {
+                current = create->handle;
+            }
+            return reply;
+        } catch (const std::exception& e) {
+            return ErrorReply(std::string("Error: ") + e.what());
+        }
+    }
 
-                            if (std::filesystem::exists(path)) {
-                                return OpenReply{1};
-                            }
-                            return OpenReply{0};
-                        } else if constexpr (std::is_same_v<T, ReadReq>) {
-                            auto path = root.concat(arg.path);
+    // Runs a single request of an authenticated client, compound sub-requests come through here too
+    AnyMsgT handle_request(ClientCtx& context, const AnyMsgT& msg) {
+        return std::visit(
+                [&](auto&& arg) -> AnyMsgT {
+                    using T = std::decay_t<decltype(arg)>;
+                    if constexpr (std::is_same_v<T, GetattrReq>) {
+                        // Watched before looking, so a change right after the stat is still reported
+                        _watcher.watch(context.id, parent_path(arg.path));
+                        struct stat buf;
+                        if (_resolver.stat(arg.path, buf) < 0) {
+                            return GetattrReply{FileType::NONE, 0, 0, 0, 0, 0, 0};
+                        }
+                        // The size can change once a lease holder writes back
+                        if (_leases.conflict(0, {buf.st_dev, buf.st_ino}, false) &&
+                            _resolver.stat(arg.path, buf) < 0) {
+                            return GetattrReply{FileType::NONE, 0, 0, 0, 0, 0, 0};
+                        }
+                        return stat_to_reply(buf);
+                    } else if constexpr (std::is_same_v<T, FgetattrReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, false);
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+                        struct stat buf;
+                        if (fstat(handle->file->fd(), &buf) < 0) {
+                            return GetattrReply{FileType::NONE, 0, 0, 0, 0, 0, 0};
+                        }
+                        return stat_to_reply(buf);
+                    } else if constexpr (std::is_same_v<T, ReaddirReq>) {
+                        _watcher.watch(context.id, arg.path);
+                        std::vector<std::string> names;
+                        auto [cookie, eof] = read_dir_page(arg.path, arg.cookie, arg.count,
+                                                           [&](int, const dirent& entry, uint64_t) {
+                                                               names.emplace_back(entry.d_name);
+                                                           });
+                        return ReaddirReply{std::move(names), cookie, eof};
+                    } else if constexpr (std::is_same_v<T, ReaddirPlusReq>) {
+                        _watcher.watch(context.id, arg.path);
+                        std::vector<DirEntry> results;
+                        auto [cookie, eof] = read_dir_page(
+                                arg.path, arg.cookie, arg.count, [&](int dir_fd, const dirent& entry, uint64_t next) {
+                                    GetattrReply attr{FileType::NONE, 0, 0, 0, 0, 0, 0};
+                                    struct stat  buf;
+                                    if (strcmp(entry.d_name, ".") == 0 || strcmp(entry.d_name, "..") == 0) {
+                                        // .. of the root is outside of the export
+                                        attr.type = FileType::DIRECTORY;
+                                    } else if (_resolver.stat_at(arg.path, dir_fd, entry.d_name, buf) == 0) {
+                                        // Relative to the already open directory, so no full path walk per entry,
+                                        // symlinks are only followed while they stay inside the export
+                                        attr = stat_to_reply(buf);
+                                    }
+                                    results.emplace_back(entry.d_name, next, attr.type, attr.mode, attr.links,
+                                                         attr.size, attr.ino, attr.mtime_sec, attr.mtime_nsec);
+                                });
+                        return ReaddirPlusReply{std::move(results), cookie, eof};
+                    } else if constexpr (std::is_same_v<T, OpenReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+                        _watcher.watch(context.id, parent_path(arg.path));
 
-                            if (std::filesystem::is_regular_file(path)) {
-                                std::ifstream        ifs(path, std::ios::binary);
-                                std::vector<uint8_t> buf(arg.len);
+                        auto file = _fd_cache.get(arg.path, arg.write);
+                        if (!file) {
+                            return OpenReply{0, 0};
+                        }
+                        uint64_t handle = _handles.add(context.id, arg.path, std::move(file));
+                        if (handle == 0) {
+                            return ErrorReply("Too many open handles");
+                        }
+                        return OpenReply{1, handle};
+                    } else if constexpr (std::is_same_v<T, ReadReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, false);
 
-                                ifs.seekg(arg.off, std::ios::beg);
-                                ifs.read(reinterpret_cast<char*>(buf.data()), checked_cast<ssize_t>(arg.len));
-                                buf.resize(checked_cast<size_t>(ifs.tellg() - arg.off));
+                        struct stat st;
+                        bool        have_st = fstat(handle->file->fd(), &st) == 0;
 
-                                return ReadReply{buf};
-                            } else {
-                                return ReadReply{{}};
+                        // Small files are copied straight out of their mapping, holes and all
+                        if (have_st && handle->file->cached() && arg.off >= 0) {
+                            if (auto mapping = _mmap_cache.get(handle->file->fd(), st)) {
+                                size_t from = std::min(checked_cast<size_t>(arg.off), mapping->size());
+                                size_t len  = std::min(checked_cast<size_t>(arg.len), mapping->size() - from);
+                                std::vector<uint8_t> data(len);
+                                if (mapping->copy(from, len, data.data())) {
+                                    return ReadReply{std::move(data), {}};
+                                }
+                                // Truncated meanwhile, read it the usual way
+                                _mmap_cache.invalidate(st.st_dev, st.st_ino);
+                                have_st = fstat(handle->file->fd(), &st) == 0;
                             }
-                        } else if constexpr (std::is_same_v<T, WriteReq>) {
-                            auto path = root.concat(arg.path);
+                        }
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+                        // Start prefetching before blocking on the read itself
+                        auto [ahead_off, ahead_len] = handle->readahead.on_read(arg.off, arg.len);
+                        if (ahead_len > 0 && handle->file->cached()) {
+                            posix_fadvise(handle->file->fd(), ahead_off, checked_cast<off_t>(ahead_len),
+                                          POSIX_FADV_WILLNEED);
+                        }
 
-                            if (std::filesystem::is_regular_file(path)) {
-                                std::fstream ofs(path, std::ios::binary | std::ios::out | std::ios::in);
+                        std::vector<ExtentT> holes;
+                        // Only sparse files have fewer blocks allocated than their size
+                        if (have_st && st.st_blocks * 512 < st.st_size) {
+                            holes = find_holes(handle->file->fd(), arg.off, arg.len, st.st_size);
+                        }
 
-                                size_t real_write = std::min(checked_cast<size_t>(arg.len), arg.data.size());
+                        auto data = read_cached(*handle->file, arg.off, arg.len);
+                        if (!holes.empty()) {
+                            remove_holes(data, holes);
+                        }
+                        return ReadReply{std::move(data), std::move(holes)};
+                    } else if constexpr (std::is_same_v<T, WriteReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, true);
 
-                                ofs.seekg(arg.off, std::ios::beg);
-                                ofs.write(reinterpret_cast<char*>(arg.data.data()), checked_cast<ssize_t>(real_write));
+                        if (!handle->file->writable()) {
+                            return WriteReply{-1};
+                        }
 
-                                return WriteReply{checked_cast<int>(ofs.tellg() - arg.off)};
-                            } else {
-                                return WriteReply{-1};
-                            }
-                        } else if constexpr (std::is_same_v<T, CreateReq>) {
-                            auto path = root.concat(arg.path);
+                        size_t real_write = std::min(checked_cast<size_t>(arg.len), arg.data.size());
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
+                        ssize_t written = handle->file->write(arg.data.data(), real_write, arg.off);
+
+                        struct stat st;
+                        if (written > 0 && fstat(handle->file->fd(), &st) == 0) {
+                            invalidate_blocks(st, checked_cast<uint64_t>(arg.off),
+                                              checked_cast<uint64_t>(arg.off + written));
+                        }
+
+                        return WriteReply{checked_cast<int>(written)};
+                    } else if constexpr (std::is_same_v<T, FallocateReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, true);
+
+                        if (!handle->file->writable()) {
+                            return FallocateReply{-EBADF};
+                        }
+
+                        if (fallocate(handle->file->fd(), arg.mode, arg.off, arg.len) < 0) {
+                            return FallocateReply{-errno};
+                        }
+
+                        // Punching holes or zeroing changes the contents
+                        struct stat st;
+                        if (fstat(handle->file->fd(), &st) == 0) {
+                            invalidate_blocks(st, checked_cast<uint64_t>(arg.off),
+                                              checked_cast<uint64_t>(arg.off + arg.len));
+                        }
+                        return FallocateReply{0};
+                    } else if constexpr (std::is_same_v<T, CopyRangeReq>) {
+                        auto src = _handles.get(context.id, arg.src_handle);
+                        auto dst = _handles.get(context.id, arg.dst_handle);
+                        if (!src || !dst) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.src_handle, *src->file, false);
+                        break_leases(arg.dst_handle, *dst->file, true);
+
+                        if (!dst->file->writable()) {
+                            return CopyRangeReply{-1};
+                        }
+
+                        ssize_t copied = src->file->copy_to(*dst->file, arg.src_off, arg.dst_off, arg.len);
+
+                        struct stat st;
+                        if (copied > 0 && fstat(dst->file->fd(), &st) == 0) {
+                            invalidate_blocks(st, checked_cast<uint64_t>(arg.dst_off),
+                                              checked_cast<uint64_t>(arg.dst_off + copied));
+                        }
+
+                        return CopyRangeReply{copied};
+                    } else if constexpr (std::is_same_v<T, SignatureReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, false);
+
+                        struct stat st;
+                        if (fstat(handle->file->fd(), &st) < 0) {
+                            return SignatureReply{-1, 0, 0, {}};
+                        }
+
+                        uint64_t size  = checked_cast<uint64_t>(st.st_size);
+                        uint64_t block = arg.block_size != 0 ? arg.block_size : Delta::block_size_for(size);
+                        block          = std::clamp(block, Delta::min_block, Delta::max_block);
+
+                        // Straight from the file, a one-off full scan would only churn the block cache
+                        std::vector<BlockSigT> blocks;
+                        std::vector<uint8_t>   buf(block);
+                        uint64_t               read = 0;
+                        while (read < size) {
+                            ssize_t got = handle->file->read(buf.data(), block, checked_cast<off_t>(read));
+                            if (got < 0) {
+                                return SignatureReply{-1, 0, 0, {}};
                             }
+                            if (got == 0)
+                                break;
+                            blocks.push_back(Delta::signature(buf.data(), static_cast<size_t>(got)));
+                            read += static_cast<uint64_t>(got);
+                        }
 
-                            if (std::filesystem::exists(path)) {
-                                return CreateReply{-1};
-                            } else {
-                                {
-                                    std::ofstream output(path);
+                        // Matches the signatures even if the file changed while reading
+                        return SignatureReply{0, block, read, std::move(blocks)};
+                    } else if constexpr (std::is_same_v<T, ReadHashesReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, false);
+
+                        struct stat st;
+                        if (arg.off < 0 || fstat(handle->file->fd(), &st) < 0) {
+                            return ReadHashesReply{-1, 0, 0, {}};
+                        }
+
+                        BlockCache::Version version{st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+                        uint64_t            bs   = _hash_cache.block_size();
+                        uint64_t            size = checked_cast<uint64_t>(st.st_size);
+                        uint64_t            end  = std::min(checked_cast<uint64_t>(arg.off) + arg.len, size);
+
+                        std::vector<std::string> hashes;
+                        for (uint64_t block = checked_cast<uint64_t>(arg.off) / bs; block * bs < end; block++) {
+                            auto hash = _hash_cache.get({st.st_dev, st.st_ino, block}, version, [&]() {
+                                // Through the block cache, the client is likely to read the block right after
+                                auto data = read_cached(*handle->file, checked_cast<off_t>(block * bs), bs);
+                                auto sha  = SHA::calculate(reinterpret_cast<const char*>(data.data()), data.size());
+                                return std::vector<uint8_t>(sha.begin(), sha.end());
+                            });
+                            hashes.emplace_back(hash->begin(), hash->end());
+                        }
+
+                        return ReadHashesReply{0, bs, size, std::move(hashes)};
+                    } else if constexpr (std::is_same_v<T, DeltaReq>) {
+                        auto dst = _handles.get(context.id, arg.dst_handle);
+                        if (!dst) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        auto src = _handles.get(context.id, arg.src_handle);
+                        if (src) {
+                            break_leases(arg.src_handle, *src->file, false);
+                        }
+                        break_leases(arg.dst_handle, *dst->file, true);
+
+                        if (!dst->file->writable() || arg.block_size == 0) {
+                            return DeltaReply{-1};
+                        }
+
+                        off_t pos = arg.dst_off;
+                        for (const auto& op: arg.ops) {
+                            if (op.copy_count > 0) {
+                                if (!src) {
+                                    return ErrorReply("Invalid handle");
                                 }
-                                chmod(path.c_str(), checked_cast<mode_t>(arg.mode));
-                                return CreateReply{0};
+                                ssize_t copied = src->file->copy_to(
+                                        *dst->file, checked_cast<off_t>(op.copy_block * arg.block_size), pos,
+                                        op.copy_count * arg.block_size);
+                                if (copied < 0) {
+                                    return DeltaReply{-1};
+                                }
+                                pos += copied;
                             }
-                        } else if constexpr (std::is_same_v<T, ChmodReq>) {
-                            auto path = root.concat(arg.path);
-
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
+                            if (!op.data.empty()) {
+                                ssize_t written = dst->file->write(op.data.data(), op.data.size(), pos);
+                                if (written != checked_cast<ssize_t>(op.data.size())) {
+                                    return DeltaReply{-1};
+                                }
+                                pos += written;
                             }
+                        }
 
-                            if (std::filesystem::exists(path)) {
-                                return ChmodReply{-1};
-                            } else {
-                                int ret = chmod(path.c_str(), checked_cast<mode_t>(arg.mode));
-                                return ChmodReply{ret};
-                            }
-                        } else if constexpr (std::is_same_v<T, MkdirReq>) {
-                            auto path = root.concat(arg.path);
+                        struct stat st;
+                        if (fstat(dst->file->fd(), &st) == 0) {
+                            invalidate_blocks(st, checked_cast<uint64_t>(arg.dst_off), checked_cast<uint64_t>(pos));
+                        }
+                        return DeltaReply{pos - arg.dst_off};
+                    } else if constexpr (std::is_same_v<T, CreateReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+                        _watcher.watch(context.id, parent_path(arg.path));
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+                        auto file = _fd_cache.create(arg.path, checked_cast<mode_t>(arg.mode));
+                        if (!file) {
+                            return CreateReply{-1, 0};
+                        }
+                        // The file stays created, like with open(2) failing with EMFILE after O_CREAT
+                        uint64_t handle = _handles.add(context.id, arg.path, std::move(file));
+                        if (handle == 0) {
+                            return ErrorReply("Too many open handles");
+                        }
+                        return CreateReply{0, handle};
+                    } else if constexpr (std::is_same_v<T, ChmodReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
 
-                            if (std::filesystem::exists(path)) {
-                                return MkdirReply{-1};
-                            } else {
-                                std::filesystem::create_directory(path);
-                                return MkdirReply{0};
-                            }
-                        } else if constexpr (std::is_same_v<T, RmdirReq>) {
-                            auto path = root.concat(arg.path);
+                        auto        entry = _resolver.resolve(arg.path);
+                        struct stat st;
+                        // fchmodat always follows symlinks, which could lead outside of the root
+                        if (fstatat(entry.dir_fd(), entry.c_name(), &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+                            S_ISLNK(st.st_mode)) {
+                            return ChmodReply{-1};
+                        }
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+                        int ret = fchmodat(entry.dir_fd(), entry.c_name(), checked_cast<mode_t>(arg.mode), 0);
+                        return ChmodReply{ret};
+                    } else if constexpr (std::is_same_v<T, MkdirReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
 
-                            if (!std::filesystem::is_directory(path)) {
-                                return RmdirReply{-1};
-                            } else {
-                                std::filesystem::remove(path);
-                                return RmdirReply{0};
-                            }
-                        } else if constexpr (std::is_same_v<T, UnlinkReq>) {
-                            auto path = root.concat(arg.path);
+                        auto entry = _resolver.resolve(arg.path);
+                        int  ret   = mkdirat(entry.dir_fd(), entry.c_name(), checked_cast<mode_t>(arg.mode));
+                        return MkdirReply{ret};
+                    } else if constexpr (std::is_same_v<T, RmdirReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
-                            }
+                        auto entry = _resolver.resolve(arg.path);
+                        int  ret   = unlinkat(entry.dir_fd(), entry.c_name(), AT_REMOVEDIR);
+                        if (ret == 0) {
+                            _resolver.invalidate(arg.path);
+                            _dir_cursors.invalidate(arg.path);
+                        }
+                        return RmdirReply{ret};
+                    } else if constexpr (std::is_same_v<T, UnlinkReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
 
-                            if (!std::filesystem::is_regular_file(path)) {
-                                return UnlinkReply{-1};
-                            } else {
-                                std::filesystem::remove(path);
-                                return UnlinkReply{0};
-                            }
-                        } else if constexpr (std::is_same_v<T, TruncateReq>) {
-                            auto path = root.concat(arg.path);
+                        auto        entry = _resolver.resolve(arg.path);
+                        struct stat st;
+                        if (fstatat(entry.dir_fd(), entry.c_name(), &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+                            !S_ISREG(st.st_mode)) {
+                            return UnlinkReply{-1};
+                        }
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
+                        // The inode number can be reused by a new file
+                        invalidate_blocks(st, 0, checked_cast<uint64_t>(st.st_size));
+                        _fd_cache.invalidate(arg.path);
+                        return UnlinkReply{unlinkat(entry.dir_fd(), entry.c_name(), 0)};
+                    } else if constexpr (std::is_same_v<T, TruncateReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        // Through the cached descriptor, so there is no separate path walk for it
+                        auto file = _fd_cache.get(arg.path, true);
+                        if (!file || !file->writable()) {
+                            return TruncateReply{-1};
+                        }
+                        break_leases(0, *file, true);
+
+                        struct stat st;
+                        if (fstat(file->fd(), &st) < 0) {
+                            return TruncateReply{-1};
+                        }
+
+                        int ret = ftruncate(file->fd(), arg.size);
+                        invalidate_blocks(st, checked_cast<uint64_t>(std::min<off_t>(st.st_size, arg.size)),
+                                          checked_cast<uint64_t>(std::max<off_t>(st.st_size, arg.size)));
+                        return TruncateReply{ret};
+                    } else if constexpr (std::is_same_v<T, FtruncateReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        break_leases(arg.handle, *handle->file, true);
+
+                        struct stat st;
+                        if (fstat(handle->file->fd(), &st) < 0) {
+                            return TruncateReply{-1};
+                        }
+
+                        int ret = ftruncate(handle->file->fd(), arg.size);
+                        invalidate_blocks(st, checked_cast<uint64_t>(std::min<off_t>(st.st_size, arg.size)),
+                                          checked_cast<uint64_t>(std::max<off_t>(st.st_size, arg.size)));
+                        return TruncateReply{ret};
+                    } else if constexpr (std::is_same_v<T, ReleaseReq>) {
+                        if (!_handles.release(context.id, arg.handle)) {
+                            return ReleaseReply{-1};
+                        }
+                        _leases.release(arg.handle);
+                        return ReleaseReply{0};
+                    } else if constexpr (std::is_same_v<T, FsyncReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+                        return FsyncReply{_group_commit.sync(handle->file->fd(), arg.datasync)};
+                    } else if constexpr (std::is_same_v<T, LeaseReq>) {
+                        auto handle = _handles.get(context.id, arg.handle);
+                        if (!handle) {
+                            return ErrorReply("Invalid handle");
+                        }
+
+                        if (arg.type == LeaseType::NONE) {
+                            _leases.release(arg.handle);
+                            return LeaseReply{LeaseType::NONE};
+                        }
+
+                        struct stat st;
+                        if (fstat(handle->file->fd(), &st) < 0) {
+                            return LeaseReply{LeaseType::NONE};
+                        }
+                        // Writes through a read-only handle go nowhere, there is nothing to buffer
+                        auto wanted = handle->file->writable() ? arg.type : LeaseType::READ;
+                        return LeaseReply{_leases.acquire(context.id, arg.handle, {st.st_dev, st.st_ino}, wanted)};
+                    } else if constexpr (std::is_same_v<T, RenameReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path) ||
+                            !acl.authorize_path(*context.client_name, arg.newPath)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        auto        from = _resolver.resolve(arg.path);
+                        auto        to   = _resolver.resolve(arg.newPath);
+                        struct stat st;
+                        if (fstatat(from.dir_fd(), from.c_name(), &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+                            !S_ISREG(st.st_mode)) {
+                            return RenameReply{-1};
+                        }
+
+                        // A file renamed over may be unlinked by it, don't keep it alive in the caches
+                        struct stat replaced;
+                        if (fstatat(to.dir_fd(), to.c_name(), &replaced, AT_SYMLINK_NOFOLLOW) == 0 &&
+                            S_ISREG(replaced.st_mode)) {
+                            invalidate_blocks(replaced, 0, checked_cast<uint64_t>(replaced.st_size));
+                        }
+
+                        _fd_cache.invalidate(arg.path);
+                        _fd_cache.invalidate(arg.newPath);
+                        return RenameReply{renameat(from.dir_fd(), from.c_name(), to.dir_fd(), to.c_name())};
+                    } else if constexpr (std::is_same_v<T, UTimensReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        timespec time[2] = {
+                                {
+                                        arg.asecs,
+                                        arg.ans,
+                                },
+                                {
+                                        arg.msecs,
+                                        arg.mns,
+                                },
+                        };
+                        auto entry = _resolver.resolve(arg.path);
+                        int  ret   = utimensat(entry.dir_fd(), entry.c_name(), time, AT_SYMLINK_NOFOLLOW);
+                        return UTimensReply{ret};
+                    } else if constexpr (std::is_same_v<T, StatfsReq>) {
+                        struct statvfs res{};
+                        int            ret = -1;
+                        if (int fd = _resolver.open(arg.path, O_PATH); fd >= 0) {
+                            ret = fstatvfs(fd, &res);
+                            close(fd);
+                        }
+
+                        return StatfsReply{ret,          res.f_frsize, res.f_bsize, res.f_blocks, res.f_bfree,
+                                           res.f_bavail, res.f_files,  res.f_ffree, res.f_favail, res.f_namemax};
+                    } else if constexpr (std::is_same_v<T, TreeSummaryReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        int fd = _resolver.open(arg.path, O_RDONLY | O_DIRECTORY);
+                        if (fd < 0) {
+                            return TreeSummaryReply{-1, 0, 0, 0, 0, 0, 0};
+                        }
+                        PathResolver::Dir dir(fd);
+
+                        auto t = _tree_walker.summarize(dir.fd(), arg.path, tree_allow(context));
+                        return TreeSummaryReply{0, t.files, t.dirs, t.bytes, t.allocated, t.denied, t.errors};
+                    } else if constexpr (std::is_same_v<T, TreeStatReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        int fd = _resolver.open(arg.path, O_RDONLY | O_DIRECTORY);
+                        if (fd < 0) {
+                            throw ErrnoException("Could not open directory");
+                        }
+                        PathResolver::Dir dir(fd);
+
+                        std::vector<TreeEntry> entries;
+                        auto count = std::clamp<uint64_t>(arg.count, 1, Options::get<size_t>("readdir_page"));
+                        bool eof   = _tree_walker.list(dir.fd(), arg.path, arg.after, count, tree_allow(context),
+                                                       [&](const std::string& path, const struct stat& st) {
+                                                           auto attr = stat_to_reply(st);
+                                                           entries.emplace_back(path, attr.type, attr.mode,
+                                                                                attr.links, attr.size, attr.ino,
+                                                                                attr.mtime_sec, attr.mtime_nsec);
+                                                       });
+                        return TreeStatReply{std::move(entries), eof};
+                    } else if constexpr (std::is_same_v<T, TreeRemoveReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+
+                        auto        entry = _resolver.resolve(arg.path);
+                        struct stat st;
+                        if (fstatat(entry.dir_fd(), entry.c_name(), &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                            return TreeRemoveReply{-1, 0, 0, 1};
+                        }
+
+                        if (!S_ISDIR(st.st_mode)) {
+                            forget_entry(arg.path, st);
+                            if (unlinkat(entry.dir_fd(), entry.c_name(), 0) < 0) {
+                                return TreeRemoveReply{-1, 0, 0, 1};
                             }
+                            return TreeRemoveReply{0, 1, 0, 0};
+                        }
+
+                        int fd = openat(entry.dir_fd(), entry.c_name(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+                        if (fd < 0) {
+                            return TreeRemoveReply{-1, 0, 0, 1};
+                        }
+                        PathResolver::Dir dir(fd);
+
+                        auto t = _tree_walker.remove(dir.fd(), arg.path, tree_allow(context),
+                                                     [this](const std::string& path, const struct stat& removed) {
+                                                         forget_entry(path, removed);
+                                                     });
+                        uint64_t count = t.files + t.dirs;
+                        if (t.denied != 0 || t.errors != 0) {
+                            return TreeRemoveReply{-1, count, t.denied, t.errors};
+                        }
 
-                            if (!std::filesystem::is_regular_file(path)) {
-                                return TruncateReply{-1};
-                            } else {
-                                std::filesystem::resize_file(path, static_cast<uintmax_t>(arg.size));
-                                return TruncateReply{0};
+                        // The root of the export itself stays
+                        if (entry.name != ".") {
+                            forget_entry(arg.path, st);
+                            if (unlinkat(entry.dir_fd(), entry.c_name(), AT_REMOVEDIR) < 0) {
+                                return TreeRemoveReply{-1, count, 0, 1};
                             }
-                        } else if constexpr (std::is_same_v<T, RenameReq>) {
-                            auto path    = root.concat(arg.path);
-                            auto newPath = root.concat(arg.newPath);
+                            count++;
+                        }
+                        return TreeRemoveReply{0, count, 0, 0};
+                    } else if constexpr (std::is_same_v<T, SearchReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
 
-                            if (!acl.authorize_path(*context.client_name, arg.path) ||
-                                !acl.authorize_path(*context.client_name, arg.newPath)) {
+                        Searcher searcher(arg.pattern, arg.regex, Options::get<size_t>("tree_threads"));
+                        auto     count     = std::clamp<uint64_t>(arg.count, 1, Options::get<size_t>("readdir_page"));
+                        auto     open_file = [this](const std::string& path) {
+                            return _resolver.open(path, O_RDONLY | O_CLOEXEC);
+                        };
+                        auto     allow     = tree_allow(context);
+
+                        std::vector<Searcher::Match> matches;
+                        if (!arg.after.empty()) {
+                            if (!allow(arg.after)) {
                                 return ErrorReply("Unauthorized path");
                             }
+                            matches = searcher.search({arg.after}, arg.after_off, count, open_file);
+                        }
 
-                            if (!std::filesystem::is_regular_file(path)) {
-                                return RenameReply{-1};
-                            } else {
-                                std::filesystem::rename(path, newPath);
-                                return RenameReply{0};
-                            }
-                        } else if constexpr (std::is_same_v<T, UTimensReq>) {
-                            auto path = root.concat(arg.path);
+                        int fd = _resolver.open(arg.path, O_RDONLY | O_DIRECTORY);
+                        if (fd >= 0) {
+                            PathResolver::Dir dir(fd);
 
-                            if (!acl.authorize_path(*context.client_name, arg.path)) {
-                                return ErrorReply("Unauthorized path");
+                            // Listed a batch at a time, so the files of a batch can be searched in parallel
+                            std::string cursor = arg.after;
+                            bool        eof    = false;
+                            while (!eof && matches.size() < count) {
+                                std::vector<std::string> files;
+                                eof = _tree_walker.list(
+                                        dir.fd(), arg.path, cursor, search_batch, allow,
+                                        [&](const std::string& path, const struct stat& st) {
+                                            cursor = path;
+                                            if (S_ISREG(st.st_mode) && glob_matches(arg.glob, arg.path, path))
+                                                files.push_back(path);
+                                        });
+                                for (auto& match: searcher.search(files, 0, count - matches.size(), open_file))
+                                    matches.push_back(std::move(match));
                             }
+                        } else if (arg.after.empty()) {
+                            // A single file
+                            fd = open_file(arg.path);
+                            if (fd < 0) {
+                                return SearchReply{-1, {}, true};
+                            }
+                            close(fd);
+                            matches = searcher.search({arg.path}, 0, count, open_file);
+                        }
 
-                            timespec time[2] = {
-                                    {
-                                            arg.asecs,
-                                            arg.ans,
-                                    },
-                                    {
-                                            arg.msecs,
-                                            arg.mns,
-                                    },
-                            };
-                            int ret = utimensat(AT_FDCWD, path.c_str(), time, 0);
-                            return UTimensReply{ret};
-                        } else if constexpr (std::is_same_v<T, StatfsReq>) {
-                            auto path = root.concat(arg.path);
-
-                            struct statvfs res{};
-                            int            ret = statvfs(path.c_str(), &res);
-
-                            return StatfsReply{ret,          res.f_frsize, res.f_bsize, res.f_blocks, res.f_bfree,
-                                               res.f_bavail, res.f_files,  res.f_ffree, res.f_favail, res.f_namemax};
-                        } else if constexpr (std::is_same_v<T, KeepAliveReq>) {
-                            return KeepAliveReply{};
-                        } else
-                            throw Exception(std::string("Unexpected message type: ") + typeid(T).name());
-                    },
-                    msg));
+                        SearchReply reply{0, {}, matches.size() < count};
+                        for (auto& m: matches)
+                            reply.matches.emplace_back(std::move(m.path), m.offset, m.line, std::move(m.text));
+                        return reply;
+                    } else if constexpr (std::is_same_v<T, ChecksumReq>) {
+                        if (!acl.authorize_path(*context.client_name, arg.path)) {
+                            return ErrorReply("Unauthorized path");
+                        }
+                        if (arg.algorithm >= ChecksumAlgorithm::END) {
+                            return ErrorReply("Unknown checksum algorithm");
+                        }
+
+                        auto file = _fd_cache.get(arg.path);
+                        if (!file) {
+                            return ChecksumReply{-1, 0, 0, {}};
+                        }
+                        struct stat st;
+                        if (fstat(file->fd(), &st) < 0) {
+                            return ChecksumReply{-1, 0, 0, {}};
+                        }
+                        // Written back data of a lease holder has to be hashed too
+                        if (_leases.conflict(0, {st.st_dev, st.st_ino}, false) && fstat(file->fd(), &st) < 0) {
+                            return ChecksumReply{-1, 0, 0, {}};
+                        }
+
+                        auto size = checked_cast<uint64_t>(st.st_size);
+                        auto off  = std::min(arg.off, size);
+                        auto len  = std::min(arg.len, size - off);
+
+                        Checksum checksum(arg.algorithm == ChecksumAlgorithm::SHA256 ? Checksum::Algorithm::SHA256
+                                                                                      : Checksum::Algorithm::XXH64,
+                                          Options::get<size_t>("checksum_chunk"), Options::get<size_t>("tree_threads"));
+                        auto     digest = checksum.compute(
+                                [&](char* buf, size_t n, uint64_t at) {
+                                    return file->read(buf, n, checked_cast<off_t>(at));
+                                },
+                                off, len);
+                        return ChecksumReply{0, len, checksum.chunk(), std::move(digest)};
+                    } else if constexpr (std::is_same_v<T, IoSizeReq>) {
+                        // Not enforced, it's what the client should size its requests to
+                        uint64_t limit = std::max<uint64_t>(Options::get<size_t>("max_io_size"), min_io_size);
+                        return IoSizeReply{std::clamp<uint64_t>(arg.max_read, min_io_size, limit),
+                                           std::clamp<uint64_t>(arg.max_write, min_io_size, limit)};
+                    } else if constexpr (std::is_same_v<T, CompoundReq>) {
+                        std::vector<std::vector<uint8_t>> replies;
+                        uint64_t                          current = 0;
+                        for (const auto& op: arg.ops) {
+                            auto reply = handle_compound_op(context, op, current);
+                            replies.push_back(Serialize::serialize(reply));
+                            if (is_failure(reply))
+                                break;
+                        }
+                        return CompoundReply{std::move(replies)};
+                    } else if constexpr (std::is_same_v<T, KeepAliveReq>) {
+                        return KeepAliveReply{};
+                    } else if constexpr (std::is_same_v<T, StatsReq>) {
+                        auto       block_stats = _block_cache.stats();
+                        auto       hash_stats  = _hash_cache.stats();
+                        auto       mmap_stats  = _mmap_cache.stats();
+                        auto       fsync_stats = _group_commit.stats();
+                        StatsReply reply{{
+                                {"block_cache_hits", block_stats.hits},
+                                {"block_cache_misses", block_stats.misses},
+                                {"block_cache_shared_fills", block_stats.shared_fills},
+                                {"block_cache_evictions", block_stats.evictions},
+                                {"block_cache_invalidations", block_stats.invalidations},
+                                {"block_cache_bytes", block_stats.bytes},
+                                {"hash_cache_hits", hash_stats.hits},
+                                {"hash_cache_misses", hash_stats.misses},
+                                {"hash_cache_bytes", hash_stats.bytes},
+                                {"mmap_cache_hits", mmap_stats.hits},
+                                {"mmap_cache_misses", mmap_stats.misses},
+                                {"mmap_cache_entries", mmap_stats.entries},
+                                {"fd_cache_entries", _fd_cache.size()},
+                                {"dir_cursor_entries", _dir_cursors.size()},
+                                {"dir_fd_entries", _resolver.size()},
+                                {"watched_dirs", _watcher.size()},
+                                {"leases", _leases.size()},
+                                {"fsync_requests", fsync_stats.requests},
+                                {"fsync_groups", fsync_stats.groups},
+                        }};
+                        if (auto* sched = scheduler()) {
+                            for (const auto& [queue, depth]: sched->depths())
+                                reply.counters.emplace_back("queue_depth_" + queue, depth);
+                        }
+                        return reply;
+                    } else
+                        throw Exception(std::string("Unexpected message type: ") + typeid(T).name());
+                },
+                msg);
+    }
+
+public:
+    RemoteFsServer(uint16_t port, uint32_t ip, const std::string& cert_path, const std::string& key_path) :
+        Server(port, ip, cert_path, key_path, Options::get<size_t>("sched_workers"),
+               Options::get<size_t>("sched_quantum"), Options::get<size_t>("sched_user_workers")) {}
+
+    // Must be called before serving
+    void load_io_engines(const std::string& config) { _io_engines.load(config); }
+
+    // Logged in users share a queue over all their connections
+    std::string queue_of(ClientCtx& context) override {
+        std::lock_guard lock(context.ctx_mutex);
+        if (context.client_name)
+            return *context.client_name;
+        return Server::queue_of(context);
+    }
+
+    Scheduler::Limits limits_of(const std::string& queue) override {
+        if (queue.starts_with("#"))
+            return {};
+        return acl.limits(queue);
+    }
+
+    std::vector<uint8_t> handle_message(ClientCtx& context, std::vector<uint8_t> data) override {
+        try {
+            auto msg = Serialize::deserialize<AnyMsgT>(data);
+            if (!context.client_name) {
+                std::lock_guard lock(context.ctx_mutex);
+                if (!context.client_name) {
+                    return handle_auth(context, msg);
+                }
+            }
+            return Serialize::serialize(handle_request(context, msg));
         } catch (const std::exception& e) {
             return Serialize::serialize(AnyMsgT{ErrorReply(std::string("Error: ") + e.what())});
         }
     }
+
+    void handle_disconnect(ClientCtx& context) override {
+        {
+            std::lock_guard lock(_clients_mutex);
+            _clients.erase(context.id);
+        }
+        _watcher.forget(context.id);
+        _leases.release_all(context.id);
+        _handles.release_all(context.id);
+    }
 };
 
 static std::string read_file(std::string path) {
@@ -321,5 +1181,13 @@ void FsServer::run() {
 
     acl.load(acl_file, users_file);
 
+    if (!Options::get<std::string>("limits_path").empty()) {
+        acl.load_limits(read_file(Options::get<std::string>("limits_path")));
+    }
+
+    if (!Options::get<std::string>("io_engines_path").empty()) {
+        server.load_io_engines(read_file(Options::get<std::string>("io_engines_path")));
+    }
+
     server.run();
 }
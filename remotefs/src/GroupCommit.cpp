@@ -0,0 +1,78 @@
+#include "GroupCommit.hpp"
+
+#include <cerrno>
+#include <map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stuff.hpp"
+
+static int sync_one(int fd, bool datasync) { return (datasync ? fdatasync(fd) : fsync(fd)) < 0 ? -errno : 0; }
+
+GroupCommit::GroupCommit(bool enabled) : _enabled(enabled) {}
+
+int GroupCommit::sync(int fd, bool datasync) {
+    _requests++;
+    if (!_enabled) {
+        _groups++;
+        return sync_one(fd, datasync);
+    }
+
+    std::unique_lock lock(_mutex);
+    auto             group = _next;
+    size_t           index = group->entries.size();
+    group->entries.push_back({fd, datasync, 0, 0, 0});
+
+    // The group is committed by whoever finds nothing running, everyone else waits for it
+    _cv.wait(lock, [&]() { return group->done || !_running; });
+    if (!group->done) {
+        _running = true;
+        _next    = std::make_shared<Group>();
+        lock.unlock();
+
+        commit(*group);
+        _groups++;
+
+        lock.lock();
+        group->done = true;
+        _running    = false;
+        _cv.notify_all();
+    }
+    return group->entries[index].result;
+}
+
+void GroupCommit::commit(Group& group) {
+    // Files by (device, inode), so each is synced once
+    std::map<std::pair<uint64_t, uint64_t>, std::vector<Entry*>> files;
+    for (auto& entry: group.entries) {
+        struct stat st;
+        if (fstat(entry.fd, &st) < 0) {
+            entry.result = -errno;
+            continue;
+        }
+        entry.dev = checked_cast<uint64_t>(st.st_dev);
+        entry.ino = checked_cast<uint64_t>(st.st_ino);
+        files[{entry.dev, entry.ino}].push_back(&entry);
+    }
+
+    if (files.size() == 1) {
+        auto& entries  = files.begin()->second;
+        bool  datasync = true;
+        for (auto* entry: entries)
+            datasync = datasync && entry->datasync;
+        int result = sync_one(entries.front()->fd, datasync);
+        for (auto* entry: entries)
+            entry->result = result;
+        return;
+    }
+
+    // One commit of each filesystem covers all of its files
+    std::map<uint64_t, int> results;
+    for (auto& [key, entries]: files) {
+        if (!results.contains(key.first))
+            results[key.first] = syncfs(entries.front()->fd) < 0 ? -errno : 0;
+        for (auto* entry: entries)
+            entry->result = results[key.first];
+    }
+}
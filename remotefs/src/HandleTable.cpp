@@ -0,0 +1,40 @@
+#include "HandleTable.hpp"
+
+HandleTable::HandleTable(size_t per_owner) : _per_owner(per_owner) {}
+
+uint64_t HandleTable::add(int owner, std::string path, std::shared_ptr<FdCache::File> file) {
+    std::lock_guard lock(_mutex);
+    auto&           count = _counts[owner];
+    if (_per_owner > 0 && count >= _per_owner)
+        return 0;
+
+    uint64_t handle = _next_handle++;
+    _handles.emplace(handle, std::make_shared<Entry>(owner, std::move(path), std::move(file)));
+    count++;
+    return handle;
+}
+
+std::shared_ptr<HandleTable::Entry> HandleTable::get(int owner, uint64_t handle) {
+    std::lock_guard lock(_mutex);
+    auto            found = _handles.find(handle);
+    if (found == _handles.end() || found->second->owner != owner)
+        return nullptr;
+    return found->second;
+}
+
+bool HandleTable::release(int owner, uint64_t handle) {
+    std::lock_guard lock(_mutex);
+    auto            found = _handles.find(handle);
+    if (found == _handles.end() || found->second->owner != owner)
+        return false;
+    _handles.erase(found);
+    if (--_counts[owner] == 0)
+        _counts.erase(owner);
+    return true;
+}
+
+void HandleTable::release_all(int owner) {
+    std::lock_guard lock(_mutex);
+    std::erase_if(_handles, [&](const auto& entry) { return entry.second->owner == owner; });
+    _counts.erase(owner);
+}
@@ -0,0 +1,229 @@
+#include "IoEngine.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Exception.h"
+#include "Logger.h"
+#include "stuff.hpp"
+
+ssize_t BufferedIo::pread_all(int fd, void* buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = pread(fd, static_cast<char*>(buf) + done, len - done, off + checked_cast<off_t>(done));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return done > 0 ? checked_cast<ssize_t>(done) : -1;
+        }
+        if (ret == 0)
+            break;
+        done += static_cast<size_t>(ret);
+    }
+    return checked_cast<ssize_t>(done);
+}
+
+ssize_t BufferedIo::pwrite_all(int fd, const void* buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = pwrite(fd, static_cast<const char*>(buf) + done, len - done, off + checked_cast<off_t>(done));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return done > 0 ? checked_cast<ssize_t>(done) : -1;
+        }
+        done += static_cast<size_t>(ret);
+    }
+    return checked_cast<ssize_t>(done);
+}
+
+ssize_t BufferedIo::read(const IoFds& fds, void* buf, size_t len, off_t off) { return pread_all(fds.fd, buf, len, off); }
+
+ssize_t BufferedIo::write(const IoFds& fds, const void* buf, size_t len, off_t off) {
+    return pwrite_all(fds.fd, buf, len, off);
+}
+
+AlignedPool::AlignedPool(size_t size, size_t keep) :
+    _size(std::max((size + alignment - 1) / alignment * alignment, alignment)), _keep(keep) {}
+
+AlignedPool::~AlignedPool() {
+    for (auto* data: _free)
+        std::free(data);
+}
+
+AlignedPool::Buffer AlignedPool::get() {
+    {
+        std::lock_guard lock(_mutex);
+        if (!_free.empty()) {
+            auto* data = _free.back();
+            _free.pop_back();
+            return {*this, data};
+        }
+    }
+
+    auto* data = static_cast<uint8_t*>(std::aligned_alloc(alignment, _size));
+    if (!data)
+        throw std::bad_alloc();
+    return {*this, data};
+}
+
+void AlignedPool::put(uint8_t* data) {
+    {
+        std::lock_guard lock(_mutex);
+        if (_free.size() < _keep) {
+            _free.push_back(data);
+            return;
+        }
+    }
+    std::free(data);
+}
+
+static off_t align_down(off_t off) { return off / AlignedPool::alignment * AlignedPool::alignment; }
+
+int DirectIo::open_direct(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return -1;
+
+    // Opened again rather than switched with F_SETFL, so the page cache stays usable through fd
+    auto path   = "/proc/self/fd/" + std::to_string(fd);
+    int  direct = open(path.c_str(), (flags & O_ACCMODE) | O_DIRECT | O_CLOEXEC);
+    if (direct < 0) {
+        Logger::log(Logger::RemoteFs, "O_DIRECT is not supported here, using the page cache", Logger::DEBUG);
+    }
+    return direct;
+}
+
+ssize_t DirectIo::read(const IoFds& fds, void* buf, size_t len, off_t off) {
+    if (fds.direct < 0)
+        return BufferedIo::pread_all(fds.fd, buf, len, off);
+
+    auto   buffer = _pool.get();
+    size_t done   = 0;
+    while (done < len) {
+        off_t  pos   = off + checked_cast<off_t>(done);
+        off_t  start = align_down(pos);
+        size_t skip  = checked_cast<size_t>(pos - start);
+        size_t want  = std::min(_pool.size(), (skip + len - done + AlignedPool::alignment - 1) /
+                                                     AlignedPool::alignment * AlignedPool::alignment);
+
+        ssize_t ret = pread(fds.direct, buffer.data(), want, start);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            // The filesystem wants a bigger alignment
+            if (errno == EINVAL && done == 0)
+                return BufferedIo::pread_all(fds.fd, buf, len, off);
+            return done > 0 ? checked_cast<ssize_t>(done) : -1;
+        }
+
+        auto got = static_cast<size_t>(ret);
+        if (got <= skip)
+            break;
+        size_t n = std::min(got - skip, len - done);
+        std::memcpy(static_cast<char*>(buf) + done, buffer.data() + skip, n);
+        done += n;
+        // Direct reads only come back short at the end of file
+        if (got < want)
+            break;
+    }
+    return checked_cast<ssize_t>(done);
+}
+
+ssize_t DirectIo::write(const IoFds& fds, const void* buf, size_t len, off_t off) {
+    if (fds.direct < 0)
+        return BufferedIo::pwrite_all(fds.fd, buf, len, off);
+
+    const auto* data = static_cast<const char*>(buf);
+    size_t      done = 0;
+    auto        put  = [&](ssize_t ret, size_t wanted) {
+        if (ret > 0)
+            done += static_cast<size_t>(ret);
+        return ret == checked_cast<ssize_t>(wanted);
+    };
+    auto result = [&]() { return done > 0 ? checked_cast<ssize_t>(done) : -1; };
+
+    // The unaligned start and end go through the page cache, a direct write of the whole block would need to read it
+    // first and could race with other writers
+    size_t head = std::min(len, checked_cast<size_t>(align_down(off + AlignedPool::alignment - 1) - off));
+    if (head > 0 && !put(BufferedIo::pwrite_all(fds.fd, data, head, off), head))
+        return result();
+
+    auto buffer = _pool.get();
+    while (len - done >= AlignedPool::alignment) {
+        size_t n   = std::min(_pool.size(), (len - done) / AlignedPool::alignment * AlignedPool::alignment);
+        off_t  pos = off + checked_cast<off_t>(done);
+        std::memcpy(buffer.data(), data + done, n);
+
+        ssize_t ret = pwrite(fds.direct, buffer.data(), n, pos);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && errno == EINVAL)
+            break;
+        if (!put(ret, n))
+            return result();
+    }
+
+    // The tail, or everything left if the filesystem refused the direct write
+    size_t tail = len - done;
+    if (tail > 0)
+        put(BufferedIo::pwrite_all(fds.fd, data + done, tail, off + checked_cast<off_t>(done)), tail);
+    return result();
+}
+
+IoEngines::IoEngines(size_t buffer_size, size_t keep_buffers) :
+    _buffered(std::make_shared<BufferedIo>()), _direct(std::make_shared<DirectIo>(buffer_size, keep_buffers)) {}
+
+void IoEngines::load(const std::string& config) {
+    for (const auto& line: split(config, '\n')) {
+        auto tokens = split(line, ' ');
+        if (tokens.empty())
+            continue;
+
+        if (tokens.size() != 2 || !tokens[0].starts_with('/')) {
+            throw Exception("Could not parse I/O engine definition: " + line);
+        }
+
+        std::shared_ptr<IoEngine> engine;
+        if (tokens[1] == "buffered")
+            engine = _buffered;
+        else if (tokens[1] == "direct")
+            engine = _direct;
+        else
+            throw Exception("Unknown I/O engine: " + tokens[1]);
+
+        auto prefix = tokens[0];
+        while (prefix.size() > 1 && prefix.ends_with('/'))
+            prefix.pop_back();
+        _prefixes.insert_or_assign(prefix, engine);
+    }
+
+    Logger::log(
+            Logger::RemoteFs,
+            [&](std::ostream& os) {
+                os << "Loaded I/O engines:\n";
+                for (const auto& [prefix, engine]: _prefixes)
+                    os << prefix << " " << (engine == _direct ? "direct" : "buffered") << '\n';
+            },
+            Logger::INFO);
+}
+
+IoEngine& IoEngines::for_path(const std::string& path) {
+    IoEngine* found = _buffered.get();
+    size_t    best  = 0;
+    for (const auto& [prefix, engine]: _prefixes) {
+        bool below = path == prefix || prefix == "/" ||
+                     (path.starts_with(prefix) && path.size() > prefix.size() && path[prefix.size()] == '/');
+        if (below && prefix.size() >= best) {
+            found = engine.get();
+            best  = prefix.size();
+        }
+    }
+    return *found;
+}
@@ -0,0 +1,140 @@
+#include "LeaseManager.hpp"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+LeaseManager::LeaseManager(std::chrono::milliseconds recall_timeout, RecallT recall, WaitT wait) :
+    _recall_timeout(recall_timeout), _recall(std::move(recall)),
+    _wait(wait ? std::move(wait) : [](const std::function<void()>& fn) { fn(); }) {}
+
+void LeaseManager::erase(LeasesT::iterator it, uint64_t handle) {
+    auto& leases = it->second;
+    auto  found  = std::find_if(leases.begin(), leases.end(), [&](const Lease& l) { return l.handle == handle; });
+    if (found == leases.end())
+        return;
+
+    leases.erase(found);
+    if (leases.empty())
+        _leases.erase(it);
+    _by_handle.erase(handle);
+    _count.fetch_sub(1);
+}
+
+LeaseType LeaseManager::acquire(int owner, uint64_t handle, const Key& key, LeaseType wanted) {
+    if (!enabled() || wanted == LeaseType::NONE)
+        return LeaseType::NONE;
+
+    std::vector<Lease> to_recall;
+    bool               shared = false;
+    {
+        std::lock_guard lock(_mutex);
+        _revoked.erase(handle);
+        if (auto found = _by_handle.find(handle); found != _by_handle.end())
+            erase(_leases.find(found->second), handle);
+
+        if (auto found = _leases.find(key); found != _leases.end()) {
+            for (auto& lease: found->second) {
+                if (!conflicts(lease, handle, wanted == LeaseType::WRITE))
+                    continue;
+                shared = true;
+                if (!lease.recalled) {
+                    lease.recalled = true;
+                    to_recall.push_back(lease);
+                }
+            }
+        }
+
+        if (!shared) {
+            _leases[key].push_back(Lease{owner, handle, wanted});
+            _by_handle.emplace(handle, key);
+            _count.fetch_add(1);
+        }
+    }
+
+    // The file is shared, caching it would only cause more recalls
+    for (const auto& lease: to_recall)
+        _recall(lease.owner, lease.handle);
+    return shared ? LeaseType::NONE : wanted;
+}
+
+bool LeaseManager::conflict(uint64_t handle, const Key& key, bool write) {
+    if (!active())
+        return false;
+
+    std::unique_lock lock(_mutex);
+    auto pending = [&]() {
+        std::vector<uint64_t> handles;
+        if (auto found = _leases.find(key); found != _leases.end()) {
+            for (const auto& lease: found->second)
+                if (conflicts(lease, handle, write))
+                    handles.push_back(lease.handle);
+        }
+        return handles;
+    };
+
+    if (pending().empty())
+        return false;
+
+    std::vector<Lease> to_recall;
+    for (auto& lease: _leases.at(key)) {
+        if (conflicts(lease, handle, write) && !lease.recalled) {
+            lease.recalled = true;
+            to_recall.push_back(lease);
+        }
+    }
+
+    lock.unlock();
+    for (const auto& lease: to_recall)
+        _recall(lease.owner, lease.handle);
+    lock.lock();
+
+    bool returned = false;
+    _wait([&]() { returned = _returned.wait_for(lock, _recall_timeout, [&]() { return pending().empty(); }); });
+    if (returned)
+        return true;
+
+    for (uint64_t handle_revoked: pending()) {
+        Logger::log(Logger::RemoteFs,
+                    "Revoking lease of handle " + std::to_string(handle_revoked) + " not returned in time",
+                    Logger::ERROR);
+        auto& leases = _leases.at(key);
+        auto  lease  = std::find_if(leases.begin(), leases.end(),
+                                    [&](const Lease& l) { return l.handle == handle_revoked; });
+        _revoked.emplace(handle_revoked, lease->owner);
+        erase(_leases.find(key), handle_revoked);
+    }
+    return true;
+}
+
+bool LeaseManager::revoked(uint64_t handle) {
+    if (!enabled())
+        return false;
+    std::lock_guard lock(_mutex);
+    return _revoked.contains(handle);
+}
+
+void LeaseManager::release(uint64_t handle) {
+    std::lock_guard lock(_mutex);
+    _revoked.erase(handle);
+    auto found = _by_handle.find(handle);
+    if (found == _by_handle.end())
+        return;
+
+    erase(_leases.find(found->second), handle);
+    _returned.notify_all();
+}
+
+void LeaseManager::release_all(int owner) {
+    std::lock_guard       lock(_mutex);
+    std::vector<uint64_t> handles;
+    for (const auto& [key, leases]: _leases)
+        for (const auto& lease: leases)
+            if (lease.owner == owner)
+                handles.push_back(lease.handle);
+
+    for (uint64_t handle: handles)
+        erase(_leases.find(_by_handle.at(handle)), handle);
+    std::erase_if(_revoked, [&](const auto& entry) { return entry.second == owner; });
+    _returned.notify_all();
+}
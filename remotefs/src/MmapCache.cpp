@@ -0,0 +1,119 @@
+#include "MmapCache.hpp"
+
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "Exception.h"
+#include "stuff.hpp"
+
+// Set while a thread copies out of a mapping, so its SIGBUS can be turned into an error
+static thread_local sigjmp_buf* copy_fault = nullptr;
+
+static void on_sigbus(int, siginfo_t*, void*) {
+    if (copy_fault)
+        siglongjmp(*copy_fault, 1);
+    // Not a fault of ours, let it kill the process as it would without the handler
+    signal(SIGBUS, SIG_DFL);
+}
+
+static void install_sigbus_handler() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        struct sigaction act{};
+        act.sa_sigaction = on_sigbus;
+        // Not blocked in the handler, so jumping out of it needn't restore the signal mask
+        act.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&act.sa_mask);
+        if (sigaction(SIGBUS, &act, nullptr) < 0) {
+            throw ErrnoException("Could not install SIGBUS handler");
+        }
+    });
+}
+
+MmapCache::Mapping::Mapping(const uint8_t* data, size_t size, const struct stat& st) :
+    _data(data), _size(size), _mtime_sec(st.st_mtim.tv_sec), _mtime_nsec(st.st_mtim.tv_nsec) {}
+
+MmapCache::Mapping::~Mapping() { munmap(const_cast<uint8_t*>(_data), _size); }
+
+bool MmapCache::Mapping::valid(const struct stat& st) const {
+    return st.st_mtim.tv_sec == _mtime_sec && st.st_mtim.tv_nsec == _mtime_nsec &&
+           checked_cast<uint64_t>(st.st_size) == _size && st.st_nlink > 0;
+}
+
+bool MmapCache::Mapping::copy(size_t from, size_t len, uint8_t* out) const {
+    sigjmp_buf jmp;
+    if (sigsetjmp(jmp, 0) != 0) {
+        copy_fault = nullptr;
+        return false;
+    }
+    copy_fault = &jmp;
+    memcpy(out, _data + from, len);
+    copy_fault = nullptr;
+    return true;
+}
+
+MmapCache::MmapCache(size_t capacity, size_t max_file_size) : _capacity(capacity), _max_file_size(max_file_size) {
+    if (enabled())
+        install_sigbus_handler();
+}
+
+MmapCache::MappingT MmapCache::get(int fd, const struct stat& st) {
+    if (!enabled() || !S_ISREG(st.st_mode) || st.st_size <= 0 || checked_cast<uint64_t>(st.st_size) > _max_file_size)
+        return nullptr;
+
+    Key key{checked_cast<uint64_t>(st.st_dev), checked_cast<uint64_t>(st.st_ino)};
+    {
+        std::lock_guard lock(_mutex);
+        auto            found = _map.find(key);
+        if (found != _map.end()) {
+            if (found->second->second->valid(st)) {
+                _lru.splice(_lru.begin(), _lru, found->second);
+                _hits++;
+                return found->second->second;
+            }
+            _lru.erase(found->second);
+            _map.erase(found);
+        }
+    }
+    _misses++;
+    // Not mapped again, so the cache doesn't keep the unlinked file alive
+    if (st.st_nlink == 0)
+        return nullptr;
+
+    // Mapped outside the lock, if someone else mapped it in the meantime the newer one wins
+    auto  size = checked_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return nullptr;
+    auto mapping = std::make_shared<const Mapping>(static_cast<const uint8_t*>(data), size, st);
+
+    std::lock_guard lock(_mutex);
+    if (auto found = _map.find(key); found != _map.end()) {
+        _lru.erase(found->second);
+        _map.erase(found);
+    }
+    _lru.emplace_front(key, mapping);
+    _map.emplace(key, _lru.begin());
+    while (_lru.size() > _capacity) {
+        _map.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+    return mapping;
+}
+
+void MmapCache::invalidate(uint64_t dev, uint64_t ino) {
+    std::lock_guard lock(_mutex);
+    auto            found = _map.find({dev, ino});
+    if (found == _map.end())
+        return;
+    _lru.erase(found->second);
+    _map.erase(found);
+}
+
+MmapCache::Stats MmapCache::stats() {
+    std::lock_guard lock(_mutex);
+    return {_hits.load(), _misses.load(), _lru.size()};
+}
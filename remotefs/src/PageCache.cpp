@@ -0,0 +1,167 @@
+#include "PageCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "stuff.hpp"
+
+PageCache::PageCache(size_t capacity, size_t block_size) :
+    _capacity(capacity), _block_size(std::max<size_t>(block_size, 1)) {}
+
+void PageCache::drop_blocks(File& file) {
+    for (auto& [block, it]: file.blocks) {
+        _bytes -= it->data->size();
+        _lru.erase(it);
+    }
+    file.blocks.clear();
+    file.token = ++_next_token;
+}
+
+void PageCache::erase(FilesT::iterator it) {
+    drop_blocks(it->second);
+    _files.erase(it);
+}
+
+uint64_t PageCache::validate(const std::string& path, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec) {
+    std::lock_guard lock(_mutex);
+    Version         version{size, mtime_sec, mtime_nsec};
+    auto            found = _files.find(path);
+    // Nothing will be cached for an empty file, so it isn't remembered either
+    if (found == _files.end() && size == 0)
+        return 0;
+
+    auto [it, inserted] = _files.try_emplace(path);
+    File& file          = it->second;
+    if (inserted)
+        file.token = ++_next_token;
+
+    if (file.version != version) {
+        // Only our own last write accounts for the change, anyone else's could have left the size as it was
+        if (!file.version || file.written != version || file.size != size)
+            drop_blocks(file);
+        file.version = version;
+        file.size    = size;
+        file.written.reset();
+    }
+    return file.token;
+}
+
+PageCache::BlockT PageCache::get(const std::string& path, uint64_t block) {
+    std::lock_guard lock(_mutex);
+    auto            file = _files.find(path);
+    if (file == _files.end()) {
+        _misses++;
+        return nullptr;
+    }
+    auto found = file->second.blocks.find(block);
+    if (found == file->second.blocks.end()) {
+        _misses++;
+        return nullptr;
+    }
+
+    _hits++;
+    _lru.splice(_lru.begin(), _lru, found->second);
+    return found->second->data;
+}
+
+void PageCache::put(const std::string& path, uint64_t block, BlockT data, uint64_t token) {
+    if (!enabled() || data->size() > _block_size)
+        return;
+
+    std::lock_guard lock(_mutex);
+    auto            file = _files.find(path);
+    if (file == _files.end() || file->second.token != token)
+        return;
+
+    if (auto found = file->second.blocks.find(block); found != file->second.blocks.end()) {
+        _bytes -= found->second->data->size();
+        _lru.erase(found->second);
+        file->second.blocks.erase(found);
+    }
+
+    _bytes += data->size();
+    _lru.push_front({file, block, std::move(data)});
+    file->second.blocks.emplace(block, _lru.begin());
+
+    while (_bytes > _capacity) {
+        auto& victim = _lru.back();
+        auto  owner  = victim.file;
+        _bytes -= victim.data->size();
+        owner->second.blocks.erase(victim.block);
+        _lru.pop_back();
+        _evictions++;
+        if (owner->second.blocks.empty())
+            _files.erase(owner);
+    }
+}
+
+void PageCache::write(const std::string& path, const char* buf, size_t len, uint64_t off) {
+    std::lock_guard lock(_mutex);
+    auto            found = _files.find(path);
+    if (found == _files.end())
+        return;
+
+    File&    file = found->second;
+    uint64_t end  = off + len;
+
+    // A short last block marks the end of the file, which a write past that block moves
+    uint64_t last = file.size / _block_size;
+    if (auto cached = file.blocks.find(last); cached != file.blocks.end() && off >= (last + 1) * _block_size) {
+        _bytes -= cached->second->data->size();
+        _lru.erase(cached->second);
+        file.blocks.erase(cached);
+    }
+
+    // Until the server tells the version this write leads to
+    file.written.reset();
+    file.size = std::max(file.size, end);
+    // Blocks being fetched now may have the data from before the write
+    file.token = ++_next_token;
+
+    for (uint64_t block = off / _block_size; block * _block_size < end; block++) {
+        auto cached = file.blocks.find(block);
+        if (cached == file.blocks.end())
+            continue;
+
+        uint64_t start = block * _block_size;
+        uint64_t from  = std::max(off, start);
+        uint64_t to    = std::min(end, start + _block_size);
+
+        // Blocks are shared with readers, so they're copied rather than changed in place
+        auto   data = std::make_shared<std::vector<uint8_t>>(*cached->second->data);
+        size_t old  = data->size();
+        if (data->size() < to - start)
+            data->resize(checked_cast<size_t>(to - start));
+        std::memcpy(data->data() + (from - start), buf + (from - off), checked_cast<size_t>(to - from));
+
+        _bytes += data->size() - old;
+        cached->second->data = std::move(data);
+    }
+}
+
+void PageCache::wrote(const std::string& path, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec) {
+    std::lock_guard lock(_mutex);
+    if (auto found = _files.find(path); found != _files.end())
+        found->second.written = Version{size, mtime_sec, mtime_nsec};
+}
+
+void PageCache::invalidate(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    if (auto found = _files.find(path); found != _files.end())
+        erase(found);
+}
+
+void PageCache::invalidate_tree(const std::string& path) {
+    std::lock_guard lock(_mutex);
+    if (auto found = _files.find(path); found != _files.end())
+        erase(found);
+
+    auto prefix = path == "/" ? path : path + "/";
+    for (auto it = _files.lower_bound(prefix); it != _files.end() && it->first.starts_with(prefix);)
+        erase(it++);
+}
+
+PageCache::Stats PageCache::stats() {
+    std::lock_guard lock(_mutex);
+    return {_hits, _misses, _evictions, _bytes, _files.size()};
+}
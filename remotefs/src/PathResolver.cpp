@@ -0,0 +1,289 @@
+#include "PathResolver.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <string_view>
+
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "Exception.h"
+#include "Logger.h"
+#include "stuff.hpp"
+
+PathResolver::Dir::~Dir() { close(_fd); }
+
+// Resolves path one component at a time without following symlinks, for kernels without openat2
+static int open_nofollow(int dir_fd, const char* path, int flags, mode_t mode) {
+    if (path[0] == '/') {
+        errno = EXDEV;
+        return -1;
+    }
+
+    std::string_view rest(path);
+    int              cur = dir_fd;
+    while (true) {
+        size_t      slash = rest.find('/');
+        bool        last  = slash == std::string_view::npos;
+        std::string component(rest.substr(0, slash));
+        rest = last ? std::string_view() : rest.substr(slash + 1);
+
+        if (!last && (component.empty() || component == "."))
+            continue;
+
+        int next = -1;
+        if (component == "..")
+            errno = EXDEV;
+        else if (last)
+            next = openat(cur, component.empty() ? "." : component.c_str(), flags | O_NOFOLLOW | O_CLOEXEC, mode);
+        else
+            next = openat(cur, component.c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+        if (cur != dir_fd) {
+            int saved = errno;
+            close(cur);
+            errno = saved;
+        }
+        if (next < 0 || last)
+            return next;
+        cur = next;
+    }
+}
+
+// openat with RESOLVE_BENEATH and any extra resolve flags,
+// on kernels without openat2 walks the path without following any symlinks
+static int open_beneath(int dir_fd, const char* path, int flags, mode_t mode, uint64_t resolve = 0) {
+    static std::atomic<bool> no_openat2 = false;
+
+    if (!no_openat2.load(std::memory_order_relaxed)) {
+        open_how how{};
+        how.flags   = static_cast<uint64_t>(flags | O_CLOEXEC);
+        how.mode    = (flags & O_CREAT) ? mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS | resolve;
+
+        int fd;
+        do {
+            fd = checked_cast<int>(syscall(SYS_openat2, dir_fd, path, &how, sizeof(how)));
+        } while (fd < 0 && errno == EAGAIN);
+
+        if (fd >= 0 || errno != ENOSYS)
+            return fd;
+        if (!no_openat2.exchange(true))
+            Logger::log(Logger::RemoteFs, "openat2 is not supported here, symlinks in the export will not be followed",
+                        Logger::ERROR);
+    }
+
+    return open_nofollow(dir_fd, path, flags, mode);
+}
+
+// Splits an absolute client path into the root relative parent directory and the last component
+static bool split_path(const std::string& path, std::string& parent, std::string& name) {
+
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t next = path.find('/', pos);
+        if (next == std::string::npos)
+            next = path.size();
+
+        std::string component = path.substr(pos, next - pos);
+        pos                   = next + 1;
+        if (component.empty())
+            continue;
+        // Clients never send these, and .. could step out of a cached directory
+        if (component == "." || component == "..") {
+            errno = EINVAL;
+            return false;
+        }
+
+        if (!name.empty())
+            parent += parent.empty() ? name : "/" + name;
+        name = std::move(component);
+    }
+
+    if (name.empty())
+        name = ".";
+    return true;
+}
+
+// The root relative path of a split client path
+static std::string join_path(const std::string& parent, const std::string& name) {
+    if (parent.empty())
+        return name;
+    return name == "." ? parent : parent + "/" + name;
+}
+
+PathResolver::PathResolver(const std::filesystem::path& root, size_t capacity) : _capacity(capacity) {
+    int fd = ::open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw ErrnoException("Could not open " + root.string());
+    }
+    _root = std::make_shared<const Dir>(fd);
+}
+
+std::shared_ptr<const PathResolver::Dir> PathResolver::get_dir(const std::string& rel) {
+    if (rel.empty())
+        return _root;
+
+    // Start from the closest cached ancestor
+    std::shared_ptr<const Dir> base = _root;
+    std::string                rest = rel;
+    {
+        std::lock_guard lock(_mutex);
+        std::string     key = rel;
+        while (true) {
+            if (auto found = _map.find(key); found != _map.end()) {
+                _lru.splice(_lru.begin(), _lru, found->second);
+                if (key == rel)
+                    return found->second->second;
+                base = found->second->second;
+                rest = rel.substr(key.size() + 1);
+                break;
+            }
+            auto slash = key.rfind('/');
+            if (slash == std::string::npos)
+                break;
+            key.resize(slash);
+        }
+    }
+
+    int fd = open_from(base->fd(), rest, rel, O_PATH | O_DIRECTORY, 0);
+    if (fd < 0)
+        return nullptr;
+    auto dir = std::make_shared<const Dir>(fd);
+
+    if (_capacity == 0)
+        return dir;
+
+    std::lock_guard lock(_mutex);
+    if (auto found = _map.find(rel); found != _map.end()) {
+        // Someone else opened it in the meantime
+        _lru.splice(_lru.begin(), _lru, found->second);
+        return found->second->second;
+    }
+
+    _lru.emplace_front(rel, dir);
+    _map.emplace(rel, _lru.begin());
+    while (_lru.size() > _capacity) {
+        _map.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+    return dir;
+}
+
+int PathResolver::open_from(int dir_fd, const std::string& rest, const std::string& rel, int flags, mode_t mode) {
+    int fd = open_beneath(dir_fd, rest.c_str(), flags, mode, RESOLVE_NO_SYMLINKS);
+    if (fd >= 0 || errno != ELOOP)
+        return fd;
+    return open_beneath(_root->fd(), rel.c_str(), flags, mode);
+}
+
+std::optional<PathResolver::Entry> PathResolver::try_resolve(const std::string& path, std::string* rel) {
+    std::string parent;
+    std::string name;
+    if (!split_path(path, parent, name))
+        return std::nullopt;
+    if (rel)
+        *rel = join_path(parent, name);
+
+    auto dir = get_dir(parent);
+    if (!dir)
+        return std::nullopt;
+    return Entry{std::move(dir), std::move(name)};
+}
+
+PathResolver::Entry PathResolver::resolve(const std::string& path) {
+    auto entry = try_resolve(path);
+    if (!entry) {
+        throw ErrnoException("Could not resolve " + path);
+    }
+    return std::move(*entry);
+}
+
+int PathResolver::open(const std::string& path, int flags, mode_t mode) {
+    std::string rel;
+    auto        entry = try_resolve(path, &rel);
+    if (!entry)
+        return -1;
+    return open_from(entry->dir_fd(), entry->name, rel, flags, mode);
+}
+
+static void statx_to_stat(const struct statx& in, struct stat& out) {
+    out            = {};
+    out.st_dev     = makedev(in.stx_dev_major, in.stx_dev_minor);
+    out.st_ino     = in.stx_ino;
+    out.st_mode    = in.stx_mode;
+    out.st_nlink   = in.stx_nlink;
+    out.st_uid     = in.stx_uid;
+    out.st_gid     = in.stx_gid;
+    out.st_rdev    = makedev(in.stx_rdev_major, in.stx_rdev_minor);
+    out.st_size    = checked_cast<off_t>(in.stx_size);
+    out.st_blksize = in.stx_blksize;
+    out.st_blocks  = checked_cast<blkcnt_t>(in.stx_blocks);
+    out.st_atim    = {in.stx_atime.tv_sec, in.stx_atime.tv_nsec};
+    out.st_mtim    = {in.stx_mtime.tv_sec, in.stx_mtime.tv_nsec};
+    out.st_ctim    = {in.stx_ctime.tv_sec, in.stx_ctime.tv_nsec};
+}
+
+int PathResolver::stat(const std::string& path, struct stat& buf) {
+    std::string rel;
+    auto        entry = try_resolve(path, &rel);
+    if (!entry)
+        return -1;
+    return stat_rel(entry->dir_fd(), entry->c_name(), rel, buf);
+}
+
+int PathResolver::stat_at(const std::string& dir_path, int dir_fd, const char* name, struct stat& buf) {
+    std::string parent;
+    std::string dir_name;
+    if (!split_path(dir_path, parent, dir_name))
+        return -1;
+    std::string dir_rel = join_path(parent, dir_name);
+    return stat_rel(dir_fd, name, dir_rel == "." ? name : dir_rel + "/" + name, buf);
+}
+
+int PathResolver::stat_rel(int dir_fd, const char* name, const std::string& rel, struct stat& buf) {
+    struct statx stx;
+    if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, &stx) < 0)
+        return -1;
+
+    if (S_ISLNK(stx.stx_mode)) {
+        // Only follow symlinks that stay inside the root
+        int fd = open_beneath(_root->fd(), rel.c_str(), O_PATH, 0);
+        if (fd < 0)
+            return -1;
+        int ret = statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx);
+        close(fd);
+        if (ret < 0)
+            return -1;
+    }
+
+    statx_to_stat(stx, buf);
+    return 0;
+}
+
+void PathResolver::invalidate(const std::string& path) {
+    std::string parent;
+    std::string name;
+    // The root itself is never evicted
+    if (!split_path(path, parent, name) || name == ".")
+        return;
+    std::string rel = parent.empty() ? name : parent + "/" + name;
+
+    std::lock_guard lock(_mutex);
+    for (auto it = _lru.begin(); it != _lru.end();) {
+        if (it->first == rel || it->first.starts_with(rel + "/")) {
+            _map.erase(it->first);
+            it = _lru.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+size_t PathResolver::size() {
+    std::lock_guard lock(_mutex);
+    return _lru.size();
+}
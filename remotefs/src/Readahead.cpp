@@ -0,0 +1,40 @@
+#include "Readahead.hpp"
+
+#include <algorithm>
+
+#include "stuff.hpp"
+
+std::pair<off_t, size_t> Readahead::on_read(off_t off, size_t len) {
+    std::lock_guard lock(_mutex);
+
+    off_t end = off + checked_cast<off_t>(len);
+
+    // Reads from the start of the file are treated as the beginning of a stream
+    bool sequential = off == _next_off || (off == 0 && _next_off == 0);
+    _next_off       = end;
+
+    if (!sequential || _max_window == 0 || len == 0) {
+        _window    = 0;
+        _ahead_end = 0;
+        return {0, 0};
+    }
+
+    if (_window == 0) {
+        _window    = std::min(_min_window, _max_window);
+        _ahead_end = end;
+    } else if (_ahead_end - end >= checked_cast<off_t>(_window / 2)) {
+        // Still far enough ahead of the reader
+        return {0, 0};
+    } else {
+        _window = std::min(_window * 2, _max_window);
+    }
+
+    off_t  start   = std::max(_ahead_end, end);
+    off_t  new_end = end + checked_cast<off_t>(_window);
+    _ahead_end     = std::max(_ahead_end, new_end);
+
+    if (new_end <= start)
+        return {0, 0};
+
+    return {start, static_cast<size_t>(new_end - start)};
+}
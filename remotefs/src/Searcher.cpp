@@ -0,0 +1,191 @@
+#include "Searcher.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include <unistd.h>
+
+#include "Exception.h"
+#include "IoEngine.hpp"
+#include "stuff.hpp"
+
+// Portable vector extension, compiles to SSE2 on x86 and NEON on ARM
+using BytesT = uint8_t __attribute__((vector_size(16)));
+
+const char* LiteralMatcher::find(const char* begin, const char* end) const {
+    size_t n = _needle.size();
+    if (n == 0)
+        return begin;
+    if (checked_cast<size_t>(end - begin) < n)
+        return nullptr;
+    if (n == 1)
+        return static_cast<const char*>(memchr(begin, _needle[0], checked_cast<size_t>(end - begin)));
+
+    BytesT first = BytesT{} + static_cast<uint8_t>(_needle.front());
+    BytesT last  = BytesT{} + static_cast<uint8_t>(_needle.back());
+
+    // Past the last position a match can start at
+    const char* stop = end - n + 1;
+    const char* p    = begin;
+    for (; stop - p >= 16; p += 16) {
+        BytesT starts, ends;
+        std::memcpy(&starts, p, sizeof(starts));
+        std::memcpy(&ends, p + n - 1, sizeof(ends));
+        auto candidates = (starts == first) & (ends == last);
+
+        uint64_t words[2];
+        std::memcpy(words, &candidates, sizeof(words));
+        if ((words[0] | words[1]) == 0)
+            continue;
+
+        for (size_t i = 0; i < 16; i++) {
+            if (candidates[i] && std::memcmp(p + i + 1, _needle.data() + 1, n - 2) == 0)
+                return p + i;
+        }
+    }
+
+    for (; p < stop; p++) {
+        if (*p == _needle.front() && std::memcmp(p, _needle.data(), n) == 0)
+            return p;
+    }
+    return nullptr;
+}
+
+Searcher::Searcher(const std::string& pattern, bool regex, size_t threads) : _threads(std::max<size_t>(threads, 1)) {
+    if (pattern.empty() || pattern.find('\n') != std::string::npos) {
+        throw Exception("Patterns must be a non-empty single line");
+    }
+
+    if (!regex) {
+        _literal.emplace(pattern);
+        return;
+    }
+    try {
+        _regex.emplace(pattern, std::regex::extended | std::regex::optimize);
+    } catch (const std::regex_error& e) {
+        throw Exception("Invalid regular expression " + pattern + ": " + e.what());
+    }
+}
+
+template<typename F>
+void Searcher::matching_lines(const char* begin, const char* end, F fn) const {
+    auto line_end = [end](const char* from) {
+        auto* nl = static_cast<const char*>(memchr(from, '\n', checked_cast<size_t>(end - from)));
+        return nl ? nl : end;
+    };
+
+    if (_literal) {
+        // p is always at the start of a line
+        for (const char* p = begin; p < end;) {
+            const char* found = _literal->find(p, end);
+            if (!found)
+                return;
+            auto*       nl    = static_cast<const char*>(memrchr(p, '\n', checked_cast<size_t>(found - p)));
+            const char* start = nl ? nl + 1 : p;
+            const char* stop  = line_end(found);
+            if (!fn(start, stop))
+                return;
+            p = stop + 1;
+        }
+        return;
+    }
+
+    for (const char* start = begin; start < end;) {
+        const char* stop = line_end(start);
+        if (std::regex_search(start, stop, *_regex) && !fn(start, stop))
+            return;
+        start = stop + 1;
+    }
+}
+
+std::vector<Searcher::Match> Searcher::search_fd(int fd, const std::string& path, uint64_t from, size_t max) const {
+    constexpr size_t chunk = 1024 * 1024;
+    // Longer lines are split rather than kept whole
+    constexpr size_t max_line = 16 * 1024 * 1024;
+
+    std::vector<Match> out;
+    std::vector<char>  buf;
+    size_t             carry = 0; // Start of a line left over from the previous chunk
+    uint64_t           base  = 0; // Offset of buf in the file, always at the start of a line
+    uint64_t           line  = 1;
+    bool               first = true;
+
+    while (out.size() < max) {
+        buf.resize(carry + chunk);
+        ssize_t got = BufferedIo::pread_all(fd, buf.data() + carry, chunk, checked_cast<off_t>(base + carry));
+        if (got < 0)
+            break;
+        bool   eof  = static_cast<size_t>(got) < chunk;
+        size_t size = carry + static_cast<size_t>(got);
+
+        if (first && memchr(buf.data(), 0, size))
+            break;
+        first = false;
+
+        size_t end = size;
+        if (!eof) {
+            auto* nl = static_cast<const char*>(memrchr(buf.data(), '\n', size));
+            if (nl) {
+                end = checked_cast<size_t>(nl - buf.data()) + 1;
+            } else if (size < max_line) {
+                carry = size;
+                continue;
+            }
+        }
+
+        const char* counted = buf.data();
+        matching_lines(buf.data(), buf.data() + end, [&](const char* start, const char* stop) {
+            line += checked_cast<uint64_t>(std::count(counted, start, '\n'));
+            counted         = start;
+            uint64_t offset = base + checked_cast<uint64_t>(start - buf.data());
+            if (offset >= from) {
+                out.push_back(Match{path, offset, line,
+                                    std::string(start, std::min(checked_cast<size_t>(stop - start), max_text))});
+            }
+            return out.size() < max;
+        });
+        if (eof)
+            break;
+        line += checked_cast<uint64_t>(std::count(counted, static_cast<const char*>(buf.data() + end), '\n'));
+
+        std::memmove(buf.data(), buf.data() + end, size - end);
+        carry = size - end;
+        base += end;
+    }
+    return out;
+}
+
+std::vector<Searcher::Match> Searcher::search(const std::vector<std::string>& paths, uint64_t first_from, size_t max,
+                                              const OpenT& open) const {
+    std::vector<std::vector<Match>> found(paths.size());
+    std::atomic<size_t>             next{0};
+
+    auto work = [&]() {
+        for (size_t i; (i = next++) < paths.size();) {
+            int fd = open(paths[i]);
+            if (fd < 0)
+                continue;
+            found[i] = search_fd(fd, paths[i], i == 0 ? first_from : 0, max);
+            close(fd);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(_threads, paths.size()); i++)
+        threads.emplace_back(work);
+    work();
+    for (auto& t: threads)
+        t.join();
+
+    std::vector<Match> out;
+    for (auto& file: found) {
+        for (auto& match: file) {
+            if (out.size() == max)
+                return out;
+            out.push_back(std::move(match));
+        }
+    }
+    return out;
+}
@@ -0,0 +1,296 @@
+#include "TreeWalker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Exception.h"
+#include "stuff.hpp"
+
+struct TreeWalker::Node {
+    std::shared_ptr<Node> parent;
+    std::string           name; // In the parent
+    std::string           path;
+    struct stat           st{};
+    int                   fd = -1;
+    // Its own listing and the children that aren't done yet
+    std::atomic<size_t>   pending{1};
+    // Something below couldn't be removed or was skipped, so the directory can't be removed either
+    std::atomic<bool>     failed{false};
+
+    ~Node() {
+        if (fd >= 0)
+            close(fd);
+    }
+};
+
+struct TreeWalker::Walk {
+    Walk(const AllowT& allow_fn, const VisitT* removed_fn) : allow(allow_fn), removed(removed_fn) {}
+
+    const AllowT& allow;
+    // Null unless removing
+    const VisitT* removed;
+
+    std::mutex                         mutex;
+    std::condition_variable            cond;
+    std::vector<std::shared_ptr<Node>> stack;
+    size_t                             busy = 0;
+
+    std::atomic<uint64_t> files{0}, dirs{0}, bytes{0}, allocated{0}, denied{0}, errors{0};
+
+    Totals totals() const {
+        return Totals{files.load(), dirs.load(), bytes.load(), allocated.load(), denied.load(), errors.load()};
+    }
+};
+
+void TreeWalker::finish(Walk& walk, std::shared_ptr<Node> node) {
+    while (node && node->pending.fetch_sub(1) == 1) {
+        auto parent = node->parent;
+        if (walk.removed && parent) {
+            if (node->failed) {
+                parent->failed = true;
+            } else {
+                (*walk.removed)(node->path, node->st);
+                if (unlinkat(parent->fd, node->name.c_str(), AT_REMOVEDIR) < 0) {
+                    walk.errors++;
+                    parent->failed = true;
+                } else {
+                    walk.dirs++;
+                }
+            }
+        }
+        node = std::move(parent);
+    }
+}
+
+void TreeWalker::list_node(Walk& walk, const std::shared_ptr<Node>& node) {
+    if (node->parent)
+        node->fd = openat(node->parent->fd, node->name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    DIR* dir = nullptr;
+    if (node->fd >= 0) {
+        // The stream owns its descriptor, the node's one stays open for the children
+        int dir_fd = fcntl(node->fd, F_DUPFD_CLOEXEC, 0);
+        if (dir_fd >= 0 && !(dir = fdopendir(dir_fd)))
+            close(dir_fd);
+    }
+    if (!dir) {
+        walk.errors++;
+        node->failed = true;
+        finish(walk, node);
+        return;
+    }
+    // Duplicates share the position, the directory may have been read through another one before
+    rewinddir(dir);
+
+    while (dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        auto        path = join(node->path, entry->d_name);
+        struct stat st;
+        if (fstatat(node->fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            walk.errors++;
+            node->failed = true;
+            continue;
+        }
+        if (!walk.allow(path)) {
+            walk.denied++;
+            node->failed = true;
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (!walk.removed)
+                walk.dirs++;
+            auto child = std::make_shared<Node>();
+            child->parent = node;
+            child->name   = entry->d_name;
+            child->path   = std::move(path);
+            child->st     = st;
+            node->pending++;
+            {
+                std::lock_guard lock(walk.mutex);
+                walk.stack.push_back(std::move(child));
+            }
+            walk.cond.notify_one();
+            continue;
+        }
+
+        if (walk.removed) {
+            (*walk.removed)(path, st);
+            if (unlinkat(node->fd, entry->d_name, 0) < 0) {
+                walk.errors++;
+                node->failed = true;
+                continue;
+            }
+        }
+        walk.files++;
+        walk.bytes += checked_cast<uint64_t>(st.st_size);
+        walk.allocated += checked_cast<uint64_t>(st.st_blocks) * 512;
+    }
+    closedir(dir);
+
+    finish(walk, node);
+}
+
+void TreeWalker::walk(Walk& state, int dir_fd, const std::string& path) {
+    auto root  = std::make_shared<Node>();
+    root->path = path;
+    root->fd   = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    state.stack.push_back(std::move(root));
+
+    // Last in first out, so that few directories are open at once
+    auto work = [&state]() {
+        for (;;) {
+            std::shared_ptr<Node> node;
+            {
+                std::unique_lock lock(state.mutex);
+                state.cond.wait(lock, [&] { return !state.stack.empty() || state.busy == 0; });
+                if (state.stack.empty())
+                    return;
+                node = std::move(state.stack.back());
+                state.stack.pop_back();
+                state.busy++;
+            }
+
+            list_node(state, node);
+            node.reset();
+
+            std::lock_guard lock(state.mutex);
+            if (--state.busy == 0 && state.stack.empty())
+                state.cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < _threads; i++)
+        threads.emplace_back(work);
+    work();
+    for (auto& t: threads)
+        t.join();
+}
+
+TreeWalker::Totals TreeWalker::summarize(int dir_fd, const std::string& path, const AllowT& allow) {
+    Walk state(allow, nullptr);
+    walk(state, dir_fd, path);
+    return state.totals();
+}
+
+TreeWalker::Totals TreeWalker::remove(int dir_fd, const std::string& path, const AllowT& allow,
+                                      const VisitT& removed) {
+    Walk state(allow, &removed);
+    walk(state, dir_fd, path);
+    return state.totals();
+}
+
+// Runs fn(i) for i in [0, n), split between up to threads threads if there is enough to do
+template<typename F>
+static void parallel_for(size_t n, size_t threads, F fn) {
+    constexpr size_t min_per_thread = 64;
+
+    threads = std::min(threads, n / min_per_thread);
+    if (threads <= 1) {
+        for (size_t i = 0; i < n; i++)
+            fn(i);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (size_t i = t; i < n; i += threads)
+                fn(i);
+        });
+    }
+    for (auto& w: workers)
+        w.join();
+}
+
+bool TreeWalker::list(int dir_fd, const std::string& path, const std::string& after, size_t count,
+                      const AllowT& allow, const VisitT& fn) {
+    std::vector<std::string> cursor;
+    if (!after.empty()) {
+        auto prefix = join(path, "");
+        if (!after.starts_with(prefix)) {
+            throw Exception("Cursor " + after + " is not below " + path);
+        }
+        for (auto& component: split(after.substr(prefix.size()), '/'))
+            if (!component.empty())
+                cursor.push_back(std::move(component));
+    }
+
+    int fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        throw ErrnoException("Could not duplicate directory descriptor");
+    }
+    size_t left = count;
+    return list_dir(fd, path, cursor, 0, !cursor.empty(), left, allow, fn);
+}
+
+bool TreeWalker::list_dir(int fd, const std::string& path, const std::vector<std::string>& after, size_t depth,
+                          bool resume, size_t& left, const AllowT& allow, const VisitT& fn) {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(fdopendir(fd), &closedir);
+    if (!dir) {
+        close(fd);
+        return true;
+    }
+    rewinddir(dir.get());
+
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(dir.get())) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            names.emplace_back(entry->d_name);
+    }
+    std::sort(names.begin(), names.end());
+
+    size_t pos = 0;
+    if (resume)
+        pos = checked_cast<size_t>(std::lower_bound(names.begin(), names.end(), after[depth]) - names.begin());
+
+    while (pos < names.size()) {
+        // Stats a page worth of entries at a time, the directories among them may fill it up anyway
+        size_t                   batch = std::min(names.size() - pos, std::max<size_t>(left + 1, 64));
+        std::vector<struct stat> sts(batch);
+        std::vector<char>        ok(batch);
+        parallel_for(batch, _threads, [&](size_t i) {
+            ok[i] = fstatat(dirfd(dir.get()), names[pos + i].c_str(), &sts[i], AT_SYMLINK_NOFOLLOW) == 0;
+        });
+
+        for (size_t i = 0; i < batch; i++) {
+            const auto& name  = names[pos + i];
+            auto        child = join(path, name);
+            if (!ok[i] || !allow(child))
+                continue;
+
+            // The entry the previous call ended in or below, it was returned already
+            bool resuming = resume && name == after[depth];
+            if (!resuming) {
+                if (left == 0)
+                    return false;
+                fn(child, sts[i]);
+                left--;
+            }
+
+            if (S_ISDIR(sts[i].st_mode)) {
+                int child_fd =
+                        openat(dirfd(dir.get()), name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (child_fd >= 0 &&
+                    !list_dir(child_fd, child, after, depth + 1, resuming && depth + 1 < after.size(), left, allow,
+                              fn))
+                    return false;
+            }
+        }
+        pos += batch;
+    }
+
+    return true;
+}
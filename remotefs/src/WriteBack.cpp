@@ -0,0 +1,241 @@
+#include "WriteBack.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "Exception.h"
+#include "Logger.h"
+#include "stuff.hpp"
+
+WriteBack::WriteBack(size_t capacity, size_t threads, std::chrono::milliseconds delay, size_t max_store,
+                     StoreT store) :
+    _capacity(capacity), _delay(delay), _max_store(std::max<size_t>(max_store, 1)), _store(std::move(store)) {
+    if (!enabled())
+        return;
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+        _threads.emplace_back([this]() { work(); });
+}
+
+WriteBack::~WriteBack() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _work_cv.notify_all();
+    for (auto& t: _threads)
+        t.join();
+}
+
+size_t WriteBack::merge(RangesT& ranges, const char* buf, size_t len, uint64_t off) {
+    uint64_t end = off + len;
+
+    // The ranges touching [off, end), starting with one that ends right at off
+    auto first = ranges.upper_bound(off);
+    if (first != ranges.begin() && std::prev(first)->first + std::prev(first)->second.size() >= off)
+        --first;
+    auto     last   = first;
+    uint64_t start  = off;
+    uint64_t stop   = end;
+    size_t   before = 0;
+    for (; last != ranges.end() && last->first <= end; ++last) {
+        start = std::min(start, last->first);
+        stop  = std::max(stop, last->first + last->second.size());
+        before += last->second.size();
+    }
+
+    // Appending to a range reuses its buffer, so sequential writes don't copy what came before
+    std::vector<uint8_t> data;
+    auto                 rest = first;
+    if (first != last && first->first == start) {
+        data = std::move(first->second);
+        ++rest;
+    }
+    data.resize(checked_cast<size_t>(stop - start));
+    for (auto it = rest; it != last; ++it)
+        std::memcpy(data.data() + (it->first - start), it->second.data(), it->second.size());
+    std::memcpy(data.data() + (off - start), buf, len);
+
+    ranges.erase(first, last);
+    ranges.emplace(start, std::move(data));
+    return checked_cast<size_t>(stop - start) - before;
+}
+
+void WriteBack::write(uint64_t handle, const std::string& path, const char* buf, size_t len, uint64_t off) {
+    std::unique_lock lock(_mutex);
+    // A single write larger than the capacity still goes through once nothing else is pending
+    if (_pending > 0 && _pending + len > _capacity) {
+        _work_cv.notify_all();
+        _done_cv.wait(lock, [&]() { return _pending == 0 || _pending + len <= _capacity; });
+    }
+
+    auto& file = _files[handle];
+    if (!file)
+        file = std::make_shared<File>();
+    file->path = path;
+    if (file->dirty.empty())
+        file->since = std::chrono::steady_clock::now();
+    file->written = std::chrono::system_clock::now();
+    _pending += merge(file->dirty, buf, len, off);
+    _work_cv.notify_one();
+}
+
+std::optional<WriteBack::Job> WriteBack::next_job() {
+    auto now      = std::chrono::steady_clock::now();
+    bool pressure = _stop || _pending >= _capacity / 2;
+
+    for (auto& [handle, file]: _files) {
+        bool due = pressure || file->waiters > 0 || now - file->since >= _delay;
+        for (auto it = file->dirty.begin(); it != file->dirty.end(); ++it) {
+            uint64_t from = it->first;
+            uint64_t to   = from + it->second.size();
+            // Waits for an overlapping write being sent, so the older data can't land last
+            bool busy = std::any_of(file->sending.begin(), file->sending.end(),
+                                    [&](const auto& range) { return range.first < to && from < range.second; });
+            if (busy || (!due && it->second.size() < _max_store))
+                continue;
+
+            Job job{file, handle, file->path, from, std::move(it->second)};
+            file->dirty.erase(it);
+            // Sent a piece at a time, the rest stays dirty
+            if (job.data.size() > _max_store) {
+                std::vector<uint8_t> rest(job.data.begin() + checked_cast<ptrdiff_t>(_max_store), job.data.end());
+                job.data.resize(_max_store);
+                file->dirty.emplace(from + _max_store, std::move(rest));
+            }
+            file->sending.emplace_back(from, from + job.data.size());
+            return job;
+        }
+    }
+    return std::nullopt;
+}
+
+void WriteBack::work() {
+    std::unique_lock lock(_mutex);
+    for (;;) {
+        auto job = next_job();
+        if (!job) {
+            bool dirty = std::any_of(_files.begin(), _files.end(),
+                                     [](const auto& file) { return !file.second->dirty.empty(); });
+            if (_stop && !dirty)
+                return;
+            // Dirty data becomes due after the delay even if nobody asks for it
+            if (dirty)
+                _work_cv.wait_for(lock, _delay);
+            else
+                _work_cv.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        std::optional<std::string> error;
+        try {
+            _store(job->handle, job->path, job->off, job->data);
+        } catch (std::exception& e) {
+            error = e.what();
+            Logger::log(Logger::RemoteFs, std::string("Could not write back: ") + e.what(), Logger::ERROR);
+        }
+        lock.lock();
+
+        auto& file = *job->file;
+        auto  sent = std::find(file.sending.begin(), file.sending.end(),
+                               std::pair<uint64_t, uint64_t>{job->off, job->off + job->data.size()});
+        file.sending.erase(sent);
+        if (error && !file.error)
+            file.error = std::move(error);
+        _pending -= job->data.size();
+
+        _done_cv.notify_all();
+        // A range that waited for this one can go now
+        _work_cv.notify_all();
+    }
+}
+
+void WriteBack::wait_locked(std::unique_lock<std::mutex>& lock, File& file) {
+    if (file.dirty.empty() && file.sending.empty())
+        return;
+    file.waiters++;
+    _work_cv.notify_all();
+    _done_cv.wait(lock, [&]() { return file.dirty.empty() && file.sending.empty(); });
+    file.waiters--;
+}
+
+void WriteBack::drain(uint64_t handle) {
+    std::unique_lock lock(_mutex);
+    auto             found = _files.find(handle);
+    if (found == _files.end())
+        return;
+    auto file = found->second;
+    wait_locked(lock, *file);
+}
+
+void WriteBack::drain_path(const std::string& path) {
+    std::unique_lock                   lock(_mutex);
+    std::vector<std::shared_ptr<File>> files;
+    for (auto& [handle, file]: _files) {
+        if (file->path == path)
+            files.push_back(file);
+    }
+    for (auto& file: files)
+        wait_locked(lock, *file);
+}
+
+std::optional<WriteBack::Dirty> WriteBack::dirty(const std::string& path) {
+    std::lock_guard      lock(_mutex);
+    std::optional<Dirty> ret;
+    for (auto& [handle, file]: _files) {
+        if (file->path != path || (file->dirty.empty() && file->sending.empty()))
+            continue;
+
+        uint64_t end = 0;
+        if (!file->dirty.empty())
+            end = file->dirty.rbegin()->first + file->dirty.rbegin()->second.size();
+        for (const auto& range: file->sending)
+            end = std::max(end, range.second);
+
+        if (!ret)
+            ret = Dirty{end, file->written};
+        ret->end     = std::max(ret->end, end);
+        ret->written = std::max(ret->written, file->written);
+    }
+    return ret;
+}
+
+void WriteBack::sync(uint64_t handle) {
+    std::unique_lock lock(_mutex);
+    auto             found = _files.find(handle);
+    if (found == _files.end())
+        return;
+    auto file = found->second;
+    wait_locked(lock, *file);
+
+    auto error = std::exchange(file->error, std::nullopt);
+    if (error)
+        throw Exception("Write back failed: " + *error);
+}
+
+void WriteBack::release(uint64_t handle) {
+    std::unique_lock lock(_mutex);
+    auto             found = _files.find(handle);
+    if (found == _files.end())
+        return;
+    auto file = found->second;
+    wait_locked(lock, *file);
+
+    _files.erase(handle);
+    if (file->error)
+        throw Exception("Write back failed: " + *file->error);
+}
+
+void WriteBack::rename(const std::string& from, const std::string& to) {
+    std::lock_guard lock(_mutex);
+    for (auto& [handle, file]: _files) {
+        if (file->path == from)
+            file->path = to;
+    }
+}
+
+size_t WriteBack::pending() {
+    std::lock_guard lock(_mutex);
+    return _pending;
+}
@@ -30,6 +30,22 @@ int main(int argc, char* argv[]) {
             FsServer().run();
         } else if (Options::get<std::string>("mode") == "client") {
             FsClient().run();
+        } else if (Options::get<std::string>("mode") == "stats") {
+            FsClient().stats();
+        } else if (Options::get<std::string>("mode") == "copy") {
+            FsClient().copy();
+        } else if (Options::get<std::string>("mode") == "sync") {
+            FsClient().sync();
+        } else if (Options::get<std::string>("mode") == "du") {
+            FsClient().du();
+        } else if (Options::get<std::string>("mode") == "tree") {
+            FsClient().tree();
+        } else if (Options::get<std::string>("mode") == "rm") {
+            FsClient().remove();
+        } else if (Options::get<std::string>("mode") == "search") {
+            FsClient().search();
+        } else if (Options::get<std::string>("mode") == "checksum") {
+            FsClient().checksum();
         } else {
             throw Exception("Unknown mode");
         }
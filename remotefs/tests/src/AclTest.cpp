@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 
 #include "Acl.hpp"
+#include "Exception.h"
 
 // sha256 hash of string "password"
 static const std::string pass_hash = "5e884898da28047151d0e56f8dc6292773603d0d6aabbdd62a11ef721d1542d8";
@@ -90,3 +91,19 @@ TEST(AclTest, MultipleUsers3) {
     ASSERT_TRUE(acl.authorize_path("user2", "/C/a"));
     ASSERT_TRUE(acl.authorize_path("user3", "/C/a"));
 }
+
+TEST(AclTest, Limits) {
+    ACL acl;
+    acl.load_limits("* 1 0 0\nuser1 4 0 0\nuser2 1 1000 10485760\n");
+
+    EXPECT_EQ(acl.limits("user1"), (Scheduler::Limits{4, 0, 0}));
+    EXPECT_EQ(acl.limits("user2"), (Scheduler::Limits{1, 1000, 10485760}));
+    EXPECT_EQ(acl.limits("user3"), (Scheduler::Limits{1, 0, 0}));
+
+    ACL empty;
+    empty.load_limits("");
+    EXPECT_EQ(empty.limits("user1"), Scheduler::Limits{});
+
+    EXPECT_THROW(empty.load_limits("user1 1 2"), Exception);
+    EXPECT_THROW(empty.load_limits("user1 a 2 3"), Exception);
+}
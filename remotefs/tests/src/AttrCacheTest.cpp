@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "AttrCache.hpp"
+
+using namespace std::chrono_literals;
+
+static GetattrReply file(uint64_t ino) { return GetattrReply{FileType::REG_FILE, 0644, 1, 10, ino, 0, 0}; }
+static GetattrReply none() { return GetattrReply{FileType::NONE, 0, 0, 0, 0, 0, 0}; }
+
+TEST(AttrCache, SharedPrefixes) {
+    AttrCache cache(1h, 1h, 1000, 1024 * 1024);
+    for (const std::string path: {"/a", "/ab", "/abc", "/a/b", "/abd", "/b", "/"})
+        cache.put(path, file(path.size()), cache.generation());
+
+    for (const std::string path: {"/a", "/ab", "/abc", "/a/b", "/abd", "/b", "/"}) {
+        auto found = cache.get(path);
+        ASSERT_TRUE(found) << path;
+        EXPECT_EQ(found->ino, path.size());
+    }
+    EXPECT_FALSE(cache.get("/c"));
+    EXPECT_FALSE(cache.get("/a/"));
+    EXPECT_FALSE(cache.get("/abcd"));
+    EXPECT_EQ(cache.stats().entries, 7);
+
+    cache.invalidate("/ab");
+    EXPECT_FALSE(cache.get("/ab"));
+    EXPECT_TRUE(cache.get("/abc"));
+    EXPECT_TRUE(cache.get("/abd"));
+    EXPECT_EQ(cache.stats().entries, 6);
+}
+
+TEST(AttrCache, InvalidateTree) {
+    AttrCache cache(1h, 1h, 1000, 1024 * 1024);
+    for (const std::string path: {"/d", "/d/x", "/d/y/z", "/dd", "/d2/x"})
+        cache.put(path, file(1), cache.generation());
+
+    cache.invalidate_tree("/d");
+    EXPECT_FALSE(cache.get("/d"));
+    EXPECT_FALSE(cache.get("/d/x"));
+    EXPECT_FALSE(cache.get("/d/y/z"));
+    EXPECT_TRUE(cache.get("/dd"));
+    EXPECT_TRUE(cache.get("/d2/x"));
+
+    cache.invalidate_tree("/");
+    EXPECT_FALSE(cache.get("/dd"));
+    EXPECT_EQ(cache.stats().entries, 0);
+    EXPECT_EQ(cache.stats().bytes, 0);
+}
+
+TEST(AttrCache, NegativeEntriesHaveTheirOwnTtl) {
+    AttrCache cache(1h, 20ms, 1000, 1024 * 1024);
+    cache.put("/missing", none(), cache.generation());
+    cache.put("/there", file(1), cache.generation());
+
+    auto found = cache.get("/missing");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->type, FileType::NONE);
+
+    std::this_thread::sleep_for(50ms);
+    EXPECT_FALSE(cache.get("/missing"));
+    EXPECT_TRUE(cache.get("/there"));
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.negative_hits, 1);
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+
+    AttrCache positive_only(1h, 0ms, 1000, 1024 * 1024);
+    positive_only.put("/missing", none(), positive_only.generation());
+    EXPECT_FALSE(positive_only.get("/missing"));
+}
+
+TEST(AttrCache, StalePutsAreSkipped) {
+    AttrCache cache(1h, 1h, 1000, 1024 * 1024);
+    auto      generation = cache.generation();
+    cache.invalidate("/other");
+    cache.put("/a", file(1), generation);
+    EXPECT_FALSE(cache.get("/a"));
+}
+
+TEST(AttrCache, BoundedByEntriesAndBytes) {
+    AttrCache cache(1h, 1h, 100, 1024 * 1024);
+    for (int i = 0; i < 1000; i++) {
+        cache.put("/dir/file" + std::to_string(i), file(i), cache.generation());
+        // Keeps being used, so it stays
+        EXPECT_TRUE(cache.get("/dir/file0"));
+    }
+    EXPECT_LE(cache.stats().entries, 100);
+    EXPECT_GT(cache.stats().evictions, 0);
+
+    AttrCache small(1h, 1h, 100000, 16 * 1024);
+    for (int i = 0; i < 1000; i++)
+        small.put("/dir/file" + std::to_string(i), file(i), small.generation());
+    EXPECT_LE(small.stats().bytes, 16 * 1024);
+    EXPECT_GT(small.stats().entries, 0);
+}
+
+TEST(AttrCache, MatchesAMap) {
+    AttrCache                       cache(1h, 1h, 1000000, 1024 * 1024 * 1024);
+    std::map<std::string, uint64_t> expected;
+    std::mt19937                    rng(42);
+    const std::vector<std::string>  parts{"a", "b", "ab", "ba", "abc", "x"};
+    auto                            random_path = [&]() {
+        std::string path;
+        for (size_t n = 1 + rng() % 3; n > 0; n--)
+            path += "/" + parts[rng() % parts.size()];
+        return path;
+    };
+
+    for (uint64_t i = 0; i < 20000; i++) {
+        auto path = random_path();
+        switch (rng() % 4) {
+            case 0:
+            case 1:
+                cache.put(path, file(i), cache.generation());
+                expected[path] = i;
+                break;
+            case 2:
+                cache.invalidate(path);
+                expected.erase(path);
+                break;
+            case 3:
+                cache.invalidate_tree(path);
+                std::erase_if(expected, [&](const auto& e) {
+                    return e.first == path || e.first.starts_with(path + "/");
+                });
+                break;
+        }
+    }
+
+    EXPECT_EQ(cache.stats().entries, expected.size());
+    for (const auto& [path, ino]: expected) {
+        auto found = cache.get(path);
+        ASSERT_TRUE(found) << path;
+        EXPECT_EQ(found->ino, ino);
+    }
+    cache.invalidate_tree("/");
+    EXPECT_EQ(cache.stats().bytes, 0);
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "BlockCache.hpp"
+
+static std::vector<uint8_t> block_of(uint8_t value) { return std::vector<uint8_t>(16, value); }
+
+TEST(BlockCacheTest, HitsAndVersions) {
+    BlockCache cache(1024, 16, 1);
+    int        fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        return block_of(static_cast<uint8_t>(fills));
+    };
+
+    ASSERT_EQ(cache.get({1, 1, 0}, {1, 0}, fill)->at(0), 1);
+    ASSERT_EQ(cache.get({1, 1, 0}, {1, 0}, fill)->at(0), 1);
+    ASSERT_EQ(fills, 1);
+
+    // Different mtime means the file changed
+    ASSERT_EQ(cache.get({1, 1, 0}, {2, 0}, fill)->at(0), 2);
+    ASSERT_EQ(fills, 2);
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.bytes, 16);
+}
+
+TEST(BlockCacheTest, Invalidates) {
+    BlockCache cache(1024, 16, 4);
+    int        fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        return block_of(0);
+    };
+
+    for (uint64_t i = 0; i < 4; i++)
+        cache.get({1, 1, i}, {1, 0}, fill);
+    cache.get({1, 2, 0}, {1, 0}, fill);
+    ASSERT_EQ(fills, 5);
+
+    cache.invalidate(1, 1, 1, 2);
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    cache.get({1, 1, 3}, {1, 0}, fill);
+    ASSERT_EQ(fills, 5);
+    cache.get({1, 1, 1}, {1, 0}, fill);
+    ASSERT_EQ(fills, 6);
+
+    // Big ranges take the scanning path
+    cache.invalidate(1, 1, 0, 1000000);
+    cache.get({1, 2, 0}, {1, 0}, fill);
+    ASSERT_EQ(fills, 6);
+    cache.get({1, 1, 3}, {1, 0}, fill);
+    ASSERT_EQ(fills, 7);
+}
+
+TEST(BlockCacheTest, Evicts) {
+    BlockCache cache(32, 16, 1);
+    int        fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        return block_of(0);
+    };
+
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    cache.get({1, 1, 1}, {1, 0}, fill);
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    cache.get({1, 1, 2}, {1, 0}, fill);
+    ASSERT_EQ(fills, 3);
+    ASSERT_EQ(cache.stats().evictions, 1);
+    ASSERT_EQ(cache.stats().bytes, 32);
+
+    // Block 1 was the least recently used
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    ASSERT_EQ(fills, 3);
+    cache.get({1, 1, 1}, {1, 0}, fill);
+    ASSERT_EQ(fills, 4);
+}
+
+TEST(BlockCacheTest, SmallCapacity) {
+    // Less than a block per shard
+    BlockCache cache(20, 16, 16);
+    int        fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        return block_of(0);
+    };
+
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    ASSERT_EQ(fills, 1);
+    ASSERT_EQ(cache.stats().evictions, 0);
+    ASSERT_EQ(cache.stats().bytes, 16);
+}
+
+TEST(BlockCacheTest, SingleFlight) {
+    BlockCache       cache(1024, 16);
+    std::atomic<int> fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return block_of(42);
+    };
+
+    std::vector<std::thread> threads;
+    std::atomic<int>         ok = 0;
+    for (int i = 0; i < 8; i++) {
+        threads.emplace_back([&]() {
+            if (cache.get({1, 1, 0}, {1, 0}, fill)->at(0) == 42)
+                ok++;
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+
+    ASSERT_EQ(fills, 1);
+    ASSERT_EQ(ok, 8);
+}
+
+TEST(BlockCacheTest, FailedFill) {
+    BlockCache cache(1024, 16);
+
+    ASSERT_THROW(cache.get({1, 1, 0}, {1, 0}, []() -> std::vector<uint8_t> { throw std::runtime_error("fail"); }),
+                 std::runtime_error);
+    ASSERT_EQ(cache.get({1, 1, 0}, {1, 0}, []() { return block_of(1); })->at(0), 1);
+}
+
+TEST(BlockCacheTest, Disabled) {
+    BlockCache cache(0, 16);
+    int        fills = 0;
+
+    auto fill = [&]() {
+        fills++;
+        return block_of(0);
+    };
+
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    cache.get({1, 1, 0}, {1, 0}, fill);
+    ASSERT_EQ(fills, 2);
+}
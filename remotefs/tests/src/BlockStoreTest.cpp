@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "BlockStore.hpp"
+
+static BlockStore::BlockT block(size_t size, uint8_t fill) {
+    return std::make_shared<const std::vector<uint8_t>>(size, fill);
+}
+
+TEST(BlockStoreTest, StoresByHash) {
+    BlockStore store(1024);
+    EXPECT_EQ(store.get("a"), nullptr);
+
+    store.put("a", block(100, 1));
+    auto got = store.get("a");
+    ASSERT_NE(got, nullptr);
+    EXPECT_EQ(*got, std::vector<uint8_t>(100, 1));
+
+    // The first copy of a hash is kept
+    store.put("a", block(100, 2));
+    EXPECT_EQ(*store.get("a"), std::vector<uint8_t>(100, 1));
+
+    auto stats = store.stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.bytes, 100);
+}
+
+TEST(BlockStoreTest, EvictsLeastRecentlyUsed) {
+    BlockStore store(300);
+    store.put("a", block(100, 1));
+    store.put("b", block(100, 2));
+    store.put("c", block(100, 3));
+
+    store.get("a");
+    store.put("d", block(100, 4));
+
+    EXPECT_NE(store.get("a"), nullptr);
+    EXPECT_EQ(store.get("b"), nullptr);
+    EXPECT_NE(store.get("c"), nullptr);
+    EXPECT_NE(store.get("d"), nullptr);
+    EXPECT_EQ(store.stats().evictions, 1);
+    EXPECT_EQ(store.stats().bytes, 300);
+}
+
+TEST(BlockStoreTest, Disabled) {
+    BlockStore store(0);
+    EXPECT_FALSE(store.enabled());
+    store.put("a", block(100, 1));
+    EXPECT_EQ(store.get("a"), nullptr);
+
+    // Blocks larger than the whole store are not kept
+    BlockStore small(10);
+    small.put("a", block(100, 1));
+    EXPECT_EQ(small.get("a"), nullptr);
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+
+#include "ChangeWatcher.hpp"
+#include "TempDirTest.hpp"
+
+class ChangeWatcherTest : public TempDirTest {
+protected:
+    void SetUp() override {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(_dir / "a" / "sub");
+        std::filesystem::create_directories(_dir / "b");
+    }
+
+    ChangeWatcher make_watcher(size_t max_watches) {
+        return ChangeWatcher(
+                max_watches,
+                [this](const std::string& path) {
+                    return open((_dir.native() + path).c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+                },
+                [this](int client, const ChangeWatcher::Changes& changes) {
+                    std::lock_guard lock(_mutex);
+                    auto&           merged = _changes[client];
+                    merged.paths.insert(changes.paths.begin(), changes.paths.end());
+                    merged.trees.insert(changes.trees.begin(), changes.trees.end());
+                    _cond.notify_all();
+                });
+    }
+
+    // Waits until pred holds for the changes reported so far
+    template<typename F>
+    bool wait_for(F pred) {
+        std::unique_lock lock(_mutex);
+        return _cond.wait_for(lock, std::chrono::seconds(5), [&]() { return pred(_changes); });
+    }
+
+    std::mutex                                      _mutex;
+    std::condition_variable                         _cond;
+    std::unordered_map<int, ChangeWatcher::Changes> _changes;
+};
+
+TEST_F(ChangeWatcherTest, ReportsChangedEntries) {
+    auto watcher = make_watcher(16);
+    ASSERT_TRUE(watcher.enabled());
+    watcher.watch(1, "/a");
+    watcher.watch(2, "/b");
+
+    std::ofstream(_dir / "a" / "file") << "hello";
+    EXPECT_TRUE(wait_for([](auto& changes) { return changes[1].paths.contains("/a/file"); }));
+    {
+        std::lock_guard lock(_mutex);
+        // Creating an entry changes the directory itself too
+        EXPECT_TRUE(_changes[1].paths.contains("/a"));
+        EXPECT_FALSE(_changes.contains(2));
+    }
+
+    std::filesystem::rename(_dir / "a" / "sub", _dir / "b" / "moved");
+    EXPECT_TRUE(wait_for([](auto& changes) {
+        return changes[1].trees.contains("/a/sub") && changes[2].trees.contains("/b/moved");
+    }));
+}
+
+TEST_F(ChangeWatcherTest, DropsLeastRecentlyWatched) {
+    auto watcher = make_watcher(2);
+    watcher.watch(1, "/a");
+    watcher.watch(1, "/b");
+    watcher.watch(1, "/a");
+    watcher.watch(1, "/a/sub");
+
+    EXPECT_EQ(watcher.size(), 2);
+    // The client can't rely on anything it cached under the dropped directory
+    EXPECT_TRUE(wait_for([](auto& changes) { return changes[1].trees.contains("/b"); }));
+}
+
+TEST_F(ChangeWatcherTest, ForgetsClients) {
+    auto watcher = make_watcher(16);
+    watcher.watch(1, "/a");
+    watcher.watch(2, "/a");
+    watcher.watch(1, "/b");
+
+    watcher.forget(1);
+    EXPECT_EQ(watcher.size(), 1);
+
+    std::ofstream(_dir / "a" / "file") << "hello";
+    std::ofstream(_dir / "b" / "file") << "hello";
+    EXPECT_TRUE(wait_for([](auto& changes) { return changes[2].paths.contains("/a/file"); }));
+    std::lock_guard lock(_mutex);
+    EXPECT_FALSE(_changes.contains(1));
+}
+
+TEST_F(ChangeWatcherTest, Disabled) {
+    auto watcher = make_watcher(0);
+    EXPECT_FALSE(watcher.enabled());
+    watcher.watch(1, "/a");
+    EXPECT_EQ(watcher.size(), 0);
+}
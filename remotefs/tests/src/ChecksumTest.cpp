@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+#include "Checksum.hpp"
+#include "Exception.h"
+
+static Checksum::ReadT reader(const std::string& data) {
+    return [&data](char* buf, size_t len, uint64_t off) -> ssize_t {
+        if (off >= data.size())
+            return 0;
+        size_t n = std::min(len, data.size() - off);
+        std::memcpy(buf, data.data() + off, n);
+        return static_cast<ssize_t>(n);
+    };
+}
+
+TEST(Checksum, SingleChunkIsPlainDigest) {
+    std::string data = "abc";
+    Checksum    sha(Checksum::Algorithm::SHA256, 1024, 4);
+    EXPECT_EQ(Checksum::to_hex(sha.compute(reader(data), 0, 3)),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    Checksum xxh(Checksum::Algorithm::XXH64, 1024, 4);
+    EXPECT_EQ(Checksum::to_hex(xxh.compute(reader(data), 0, 3)), "44bc2cf5ad770999");
+    EXPECT_EQ(Checksum::to_hex(xxh.compute(reader(data), 0, 0)), "ef46db3751d8e999");
+}
+
+TEST(Checksum, ChunksAreHashedInOrder) {
+    std::string data;
+    for (int i = 0; i < 10000; i++)
+        data += static_cast<char>(i * 31 + i / 7);
+
+    for (auto algorithm: {Checksum::Algorithm::SHA256, Checksum::Algorithm::XXH64}) {
+        Checksum one(algorithm, 1000, 1);
+        Checksum many(algorithm, 1000, 8);
+
+        // The digest of the concatenated chunk digests
+        std::string all;
+        for (size_t off = 0; off < 9500; off += 1000)
+            all += one.digest(data.data() + 250 + off, std::min<size_t>(1000, 9500 - off));
+        auto expected = one.digest(all.data(), all.size());
+
+        EXPECT_EQ(one.compute(reader(data), 250, 9500), expected);
+        EXPECT_EQ(many.compute(reader(data), 250, 9500), expected);
+        EXPECT_NE(many.compute(reader(data), 251, 9500), expected);
+    }
+}
+
+TEST(Checksum, ShortReadThrows) {
+    std::string data(5000, 'x');
+    Checksum    sum(Checksum::Algorithm::XXH64, 1000, 4);
+    EXPECT_THROW(sum.compute(reader(data), 0, 6000), Exception);
+    EXPECT_THROW(sum.compute(reader(data), 4500, 600), Exception);
+    EXPECT_NO_THROW(sum.compute(reader(data), 4000, 1000));
+}
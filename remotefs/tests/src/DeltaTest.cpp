@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "Delta.hpp"
+
+static std::vector<uint8_t> make_data(size_t len, unsigned seed) {
+    std::mt19937         gen(seed);
+    std::vector<uint8_t> out(len);
+    for (auto& b: out)
+        b = static_cast<uint8_t>(gen());
+    return out;
+}
+
+static std::vector<BlockSigT> signatures(const std::vector<uint8_t>& data, uint64_t block_size) {
+    std::vector<BlockSigT> out;
+    for (size_t off = 0; off < data.size(); off += block_size)
+        out.push_back(Delta::signature(data.data() + off, std::min<size_t>(block_size, data.size() - off)));
+    return out;
+}
+
+// Applies the ops like the server does, returns the result and the number of literal bytes
+static std::pair<std::vector<uint8_t>, size_t> apply(const std::vector<uint8_t>& base, uint64_t block_size,
+                                                     const std::vector<DeltaOp>& ops) {
+    std::vector<uint8_t> out;
+    size_t               literal = 0;
+    for (const auto& op: ops) {
+        size_t from = std::min<size_t>(op.copy_block * block_size, base.size());
+        size_t to   = std::min<size_t>((op.copy_block + op.copy_count) * block_size, base.size());
+        out.insert(out.end(), base.begin() + static_cast<ssize_t>(from), base.begin() + static_cast<ssize_t>(to));
+        out.insert(out.end(), op.data.begin(), op.data.end());
+        literal += op.data.size();
+    }
+    return {out, literal};
+}
+
+static size_t round_trip(const std::vector<uint8_t>& base, const std::vector<uint8_t>& changed, uint64_t block_size) {
+    auto ops = Delta::compute(signatures(base, block_size), block_size, base.size(), changed.data(), changed.size());
+
+    auto [out, literal] = apply(base, block_size, ops);
+    EXPECT_EQ(out, changed);
+    return literal;
+}
+
+TEST(DeltaTest, RollingChecksum) {
+    auto data = make_data(4096, 1);
+
+    Delta::RollingChecksum sum(data.data(), 512);
+    for (size_t i = 0; i + 512 < data.size(); i++) {
+        sum.roll(data[i], data[i + 512]);
+        ASSERT_EQ(sum.value(), Delta::RollingChecksum(data.data() + i + 1, 512).value());
+    }
+}
+
+TEST(DeltaTest, Identical) {
+    auto data = make_data(100 * 1024 + 17, 2);
+    ASSERT_EQ(round_trip(data, data, 1024), 0);
+}
+
+TEST(DeltaTest, Edited) {
+    auto base    = make_data(100 * 1024 + 17, 3);
+    auto changed = base;
+
+    changed[50000] ^= 0xff;
+    ASSERT_LE(round_trip(base, changed, 1024), 1024);
+
+    // Everything after the insertion is shifted
+    changed.insert(changed.begin() + 10000, {'a', 'b', 'c'});
+    ASSERT_LE(round_trip(base, changed, 1024), 3 * 1024);
+
+    changed.erase(changed.begin() + 70000, changed.begin() + 70500);
+    ASSERT_LE(round_trip(base, changed, 1024), 4 * 1024);
+}
+
+TEST(DeltaTest, ShortLastBlock) {
+    auto base    = make_data(10 * 1024 + 100, 4);
+    auto changed = base;
+    changed[10]  = static_cast<uint8_t>(changed[10] + 1);
+    // The short tail is matched too
+    ASSERT_LE(round_trip(base, changed, 1024), 1024);
+}
+
+TEST(DeltaTest, Empty) {
+    auto data = make_data(5000, 5);
+    ASSERT_EQ(round_trip({}, data, 1024), data.size());
+    ASSERT_EQ(round_trip(data, {}, 1024), 0);
+    ASSERT_EQ(round_trip(data, make_data(5000, 6), 1024), 5000);
+}
+
+TEST(DeltaTest, BlockSize) {
+    ASSERT_EQ(Delta::block_size_for(0), Delta::min_block);
+    ASSERT_EQ(Delta::block_size_for(500ULL * 1024 * 1024), 32 * 1024);
+    ASSERT_EQ(Delta::block_size_for(1ULL << 50), Delta::max_block);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include "DirCursorCache.hpp"
+#include "TempDirTest.hpp"
+
+class DirCursorCacheTest : public TempDirTest {
+protected:
+    void SetUp() override {
+        TempDirTest::SetUp();
+        for (int i = 0; i < 10; i++)
+            make_file(std::to_string(i), "");
+    }
+
+    // Reads up to count names, returns the cookie after the last one
+    static uint64_t read_names(DIR* dir, int count, std::set<std::string>& names) {
+        for (int i = 0; i < count; i++) {
+            dirent* entry = readdir(dir);
+            if (!entry)
+                break;
+            names.emplace(entry->d_name);
+        }
+        return static_cast<uint64_t>(telldir(dir));
+    }
+};
+
+TEST_F(DirCursorCacheTest, ResumesCachedStream) {
+    DirCursorCache        cache(4);
+    std::set<std::string> names;
+
+    auto dir = cache.take(_dir, 0);
+    ASSERT_TRUE(dir);
+    uint64_t cookie = read_names(dir.get(), 5, names);
+    DIR*     raw    = dir.get();
+    cache.put(_dir, cookie, std::move(dir));
+    ASSERT_EQ(cache.size(), 1);
+
+    auto again = cache.take(_dir, cookie);
+    ASSERT_EQ(again.get(), raw);
+    ASSERT_EQ(cache.size(), 0);
+
+    read_names(again.get(), 100, names);
+    // 10 files, . and ..
+    ASSERT_EQ(names.size(), 12);
+}
+
+TEST_F(DirCursorCacheTest, SeeksOnMiss) {
+    DirCursorCache        cache(0);
+    std::set<std::string> first;
+    std::set<std::string> rest;
+
+    auto     dir    = cache.take(_dir, 0);
+    uint64_t cookie = read_names(dir.get(), 5, first);
+    cache.put(_dir, cookie, std::move(dir));
+    ASSERT_EQ(cache.size(), 0);
+
+    auto fresh = cache.take(_dir, cookie);
+    ASSERT_TRUE(fresh);
+    read_names(fresh.get(), 100, rest);
+    ASSERT_EQ(first.size() + rest.size(), 12);
+    for (const auto& name: rest)
+        ASSERT_EQ(first.count(name), 0);
+}
+
+TEST_F(DirCursorCacheTest, EvictsAndInvalidates) {
+    DirCursorCache cache(2);
+    auto           other = _dir / "sub";
+    std::filesystem::create_directory(other);
+
+    cache.put(_dir, 1, cache.take(_dir, 0));
+    cache.put(_dir, 2, cache.take(_dir, 0));
+    cache.put(other, 1, cache.take(other, 0));
+    ASSERT_EQ(cache.size(), 2);
+
+    cache.invalidate(_dir);
+    ASSERT_EQ(cache.size(), 1);
+    cache.invalidate(other);
+    ASSERT_EQ(cache.size(), 0);
+}
+
+TEST_F(DirCursorCacheTest, Missing) {
+    DirCursorCache cache(2);
+    ASSERT_FALSE(cache.take(_dir / "nope", 0));
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "DiskCache.hpp"
+#include "TempDirTest.hpp"
+
+class DiskCacheTest : public TempDirTest {};
+
+static const DiskCache::Version v1{4000, 1, 0};
+static const DiskCache::Version v2{4000, 2, 0};
+
+TEST_F(DiskCacheTest, Disabled) {
+    DiskCache cache("", 1024, 100);
+    EXPECT_FALSE(cache.enabled());
+    cache.put("/a", 0, v1, std::vector<uint8_t>(100, 1));
+    EXPECT_FALSE(cache.get("/a", 0, v1));
+}
+
+TEST_F(DiskCacheTest, StoresBlocks) {
+    DiskCache cache(_dir, 1024 * 1024, 100);
+    EXPECT_FALSE(cache.get("/a", 0, v1));
+
+    cache.put("/a", 0, v1, std::vector<uint8_t>(100, 1));
+    cache.put("/a", 1, v1, std::vector<uint8_t>(100, 2));
+    auto got = cache.get("/a", 1, v1);
+    ASSERT_TRUE(got);
+    EXPECT_TRUE(got->current);
+    EXPECT_EQ(got->data, std::vector<uint8_t>(100, 2));
+
+    // Another version of the file has to be checked
+    got = cache.get("/a", 0, v2);
+    ASSERT_TRUE(got);
+    EXPECT_FALSE(got->current);
+    cache.revalidate("/a", 0, v2);
+    EXPECT_TRUE(cache.get("/a", 0, v2)->current);
+
+    // The last block of a file has to end where the file does
+    cache.put("/b", 0, {10, 1, 0}, std::vector<uint8_t>(10, 3));
+    EXPECT_TRUE(cache.get("/b", 0, {10, 2, 0}));
+    EXPECT_FALSE(cache.get("/b", 0, {20, 2, 0}));
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.stale_hits, 2);
+    EXPECT_EQ(stats.misses, 2);
+}
+
+TEST_F(DiskCacheTest, SurvivesReopening) {
+    {
+        DiskCache cache(_dir, 1024 * 1024, 100);
+        cache.put("/a", 0, v1, std::vector<uint8_t>(100, 1));
+        cache.sync();
+        // After the index, found by scanning the segment
+        cache.put("/a", 1, v1, std::vector<uint8_t>(100, 2));
+        cache.put("/a", 0, v1, std::vector<uint8_t>(100, 3));
+        cache.put("/b", 0, v1, std::vector<uint8_t>(100, 4));
+        cache.invalidate("/b");
+        cache.sync();
+        cache.put("/c", 0, v1, std::vector<uint8_t>(100, 5));
+    }
+
+    DiskCache cache(_dir, 1024 * 1024, 100);
+    EXPECT_EQ(cache.get("/a", 0, v1)->data, std::vector<uint8_t>(100, 3));
+    EXPECT_EQ(cache.get("/a", 1, v1)->data, std::vector<uint8_t>(100, 2));
+    EXPECT_FALSE(cache.get("/b", 0, v1));
+    EXPECT_EQ(cache.get("/c", 0, v1)->data, std::vector<uint8_t>(100, 5));
+}
+
+TEST_F(DiskCacheTest, RecoversFromTornWrites) {
+    std::filesystem::path segment;
+    {
+        DiskCache cache(_dir, 1024 * 1024, 100);
+        cache.put("/a", 0, v1, std::vector<uint8_t>(100, 1));
+        cache.put("/a", 1, v1, std::vector<uint8_t>(100, 2));
+        segment = _dir / "1.log";
+    }
+    // Neither the index nor the end of the last record made it
+    std::filesystem::remove(_dir / "index");
+    std::filesystem::resize_file(segment, std::filesystem::file_size(segment) - 10);
+
+    {
+        DiskCache cache(_dir, 1024 * 1024, 100);
+        EXPECT_TRUE(cache.get("/a", 0, v1));
+        EXPECT_FALSE(cache.get("/a", 1, v1));
+        cache.put("/a", 1, v1, std::vector<uint8_t>(100, 3));
+    }
+
+    std::filesystem::remove(_dir / "index");
+    DiskCache cache(_dir, 1024 * 1024, 100);
+    EXPECT_EQ(cache.get("/a", 1, v1)->data, std::vector<uint8_t>(100, 3));
+}
+
+TEST_F(DiskCacheTest, EvictsOldestSegments) {
+    // Segments of one block each
+    DiskCache cache(_dir, 16 * 150, 100);
+    for (uint64_t i = 0; i < 40; i++) {
+        cache.put("/a", i, v1, std::vector<uint8_t>(100, static_cast<uint8_t>(i)));
+        // Kept by being read
+        EXPECT_TRUE(cache.get("/a", 0, v1));
+    }
+
+    auto stats = cache.stats();
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_LE(stats.bytes, 16 * 150);
+    EXPECT_FALSE(cache.get("/a", 1, v1));
+    EXPECT_TRUE(cache.get("/a", 39, v1));
+    EXPECT_EQ(cache.get("/a", 0, v1)->data, std::vector<uint8_t>(100, 0));
+
+    std::vector<std::filesystem::path> segments;
+    for (const auto& file: std::filesystem::directory_iterator(_dir)) {
+        if (file.path().extension() == ".log")
+            segments.push_back(file.path());
+    }
+    EXPECT_LE(segments.size(), 16);
+}
+
+TEST_F(DiskCacheTest, InvalidatesTrees) {
+    DiskCache cache(_dir, 1024 * 1024, 100);
+    for (const auto* path: {"/d", "/d/a", "/d/b/c", "/dd"})
+        cache.put(path, 0, {10, 1, 0}, std::vector<uint8_t>(10, 1));
+
+    cache.invalidate_tree("/d");
+    EXPECT_FALSE(cache.get("/d", 0, {10, 1, 0}));
+    EXPECT_FALSE(cache.get("/d/a", 0, {10, 1, 0}));
+    EXPECT_FALSE(cache.get("/d/b/c", 0, {10, 1, 0}));
+    EXPECT_TRUE(cache.get("/dd", 0, {10, 1, 0}));
+}
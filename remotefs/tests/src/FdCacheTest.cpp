@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+#include "FdCache.hpp"
+#include "TempDirTest.hpp"
+
+class FdCacheTest : public TempDirTest {};
+
+TEST_F(FdCacheTest, ReadWrite) {
+    FdCache cache(4);
+    auto    path = make_file("a", "hello world");
+
+    auto file = cache.get(path, true);
+    ASSERT_NE(file, nullptr);
+    ASSERT_TRUE(file->writable());
+
+    char buf[16]{};
+    ASSERT_EQ(file->read(buf, 5, 6), 5);
+    ASSERT_EQ(std::string(buf, 5), "world");
+
+    ASSERT_EQ(file->read(buf, 16, 6), 5);
+    ASSERT_EQ(file->read(buf, 16, 100), 0);
+
+    ASSERT_EQ(file->write("there", 5, 6), 5);
+    ASSERT_EQ(file->read(buf, 11, 0), 11);
+    ASSERT_EQ(std::string(buf, 11), "hello there");
+}
+
+TEST_F(FdCacheTest, Reuses) {
+    FdCache cache(4);
+    auto    path = make_file("a", "a");
+
+    auto first = cache.get(path);
+    ASSERT_EQ(first, cache.get(path));
+    ASSERT_EQ(cache.size(), 1);
+
+    cache.invalidate(path);
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_NE(first, cache.get(path));
+}
+
+TEST_F(FdCacheTest, Evicts) {
+    FdCache cache(2);
+    auto    a = make_file("a", "a");
+    auto    b = make_file("b", "b");
+    auto    c = make_file("c", "c");
+
+    auto fa = cache.get(a);
+    auto fb = cache.get(b);
+    ASSERT_EQ(fa, cache.get(a));
+    cache.get(c);
+    ASSERT_EQ(cache.size(), 2);
+
+    // b was the least recently used one
+    ASSERT_EQ(fa, cache.get(a));
+    ASSERT_NE(fb, cache.get(b));
+
+    // Evicted files are still usable by their holders
+    char buf;
+    ASSERT_EQ(fb->read(&buf, 1, 0), 1);
+    ASSERT_EQ(buf, 'b');
+}
+
+TEST_F(FdCacheTest, NotRegular) {
+    FdCache cache(2);
+
+    ASSERT_EQ(cache.get(_dir), nullptr);
+    ASSERT_EQ(cache.get(_dir / "missing"), nullptr);
+    ASSERT_EQ(cache.size(), 0);
+}
+
+TEST_F(FdCacheTest, CopyTo) {
+    FdCache cache(4);
+    auto    src = cache.get(make_file("a", "hello world"));
+    auto    dst = cache.get(make_file("b", "0123456789"), true);
+    ASSERT_NE(src, nullptr);
+    ASSERT_NE(dst, nullptr);
+
+    ASSERT_EQ(src->copy_to(*dst, 6, 2, 5), 5);
+    // Stops at the end of the source
+    ASSERT_EQ(src->copy_to(*dst, 6, 8, 100), 5);
+
+    char buf[16]{};
+    ASSERT_EQ(dst->read(buf, 16, 0), 13);
+    ASSERT_EQ(std::string(buf, 13), "01world7world");
+}
+
+TEST_F(FdCacheTest, ReadOnlyUntilWritten) {
+    FdCache cache(4);
+    auto    path = make_file("a", "a");
+
+    auto reader = cache.get(path);
+    ASSERT_FALSE(reader->writable());
+    ASSERT_EQ(reader, cache.get(path));
+
+    auto writer = cache.get(path, true);
+    ASSERT_NE(writer, reader);
+    ASSERT_TRUE(writer->writable());
+    // Readers can share the writable one from now on
+    ASSERT_EQ(cache.get(path), writer);
+    ASSERT_EQ(cache.get(path, true), writer);
+    ASSERT_EQ(cache.size(), 1);
+}
+
+TEST_F(FdCacheTest, RunningExecutable) {
+    FdCache cache(4);
+
+    // Can't be opened for writing while it runs, but can be read
+    auto file = cache.get("/proc/self/exe", true);
+    ASSERT_NE(file, nullptr);
+    ASSERT_FALSE(file->writable());
+}
+
+TEST_F(FdCacheTest, Replaced) {
+    FdCache cache(4);
+    auto    path = make_file("a", "old");
+
+    auto old = cache.get(path);
+    make_file("b", "new");
+    std::filesystem::rename(_dir / "b", path);
+
+    auto renamed = cache.get(path);
+    ASSERT_NE(renamed, old);
+    char buf[3];
+    ASSERT_EQ(renamed->read(buf, 3, 0), 3);
+    ASSERT_EQ(std::string(buf, 3), "new");
+    ASSERT_EQ(cache.size(), 1);
+
+    std::filesystem::remove(path);
+    ASSERT_EQ(cache.get(path), nullptr);
+    make_file("a", "recreated");
+    auto recreated = cache.get(path);
+    ASSERT_NE(recreated, nullptr);
+    ASSERT_NE(recreated, renamed);
+    ASSERT_EQ(cache.size(), 1);
+}
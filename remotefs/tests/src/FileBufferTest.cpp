@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "FileBuffer.hpp"
+
+// Stands in for the file on the server
+class FileBufferTest : public ::testing::Test {
+protected:
+    static constexpr size_t block_size = 4;
+
+    FileBuffer make_buffer(size_t capacity = 1024) {
+        return FileBuffer(
+                block_size, capacity, _file.size(),
+                [this](const std::vector<uint64_t>& blocks) {
+                    std::vector<std::vector<uint8_t>> ret;
+                    for (uint64_t block: blocks) {
+                        _fetched.push_back(block);
+                        size_t start = std::min(_file.size(), block * block_size);
+                        size_t end   = std::min(_file.size(), start + block_size);
+                        ret.emplace_back(_file.begin() + start, _file.begin() + end);
+                    }
+                    return ret;
+                },
+                [this](const std::vector<std::pair<uint64_t, const std::vector<uint8_t>*>>& blocks) {
+                    for (const auto& [block, data]: blocks) {
+                        _stored.push_back(block);
+                        size_t start = block * block_size;
+                        if (_file.size() < start + data->size())
+                            _file.resize(start + data->size());
+                        std::copy(data->begin(), data->end(), _file.begin() + start);
+                    }
+                });
+    }
+
+    static std::string read(FileBuffer& buffer, size_t len, uint64_t off) {
+        std::string out(len, '\0');
+        out.resize(buffer.read(out.data(), len, off));
+        return out;
+    }
+
+    std::string           _file = "0123456789";
+    std::vector<uint64_t> _fetched;
+    std::vector<uint64_t> _stored;
+};
+
+TEST_F(FileBufferTest, ReadsThroughCache) {
+    auto buffer = make_buffer();
+    EXPECT_EQ(read(buffer, 5, 3), "34567");
+    EXPECT_EQ(_fetched, (std::vector<uint64_t>{0, 1}));
+
+    EXPECT_EQ(read(buffer, 100, 2), "23456789");
+    EXPECT_EQ(_fetched, (std::vector<uint64_t>{0, 1, 2}));
+    EXPECT_EQ(read(buffer, 10, 10), "");
+}
+
+TEST_F(FileBufferTest, BuffersWrites) {
+    auto buffer = make_buffer();
+    buffer.write("ab", 2, 5);
+    // Partly overwritten blocks are fetched first
+    EXPECT_EQ(_fetched, (std::vector<uint64_t>{1}));
+    buffer.write("xyz", 3, 12);
+    EXPECT_EQ(buffer.size(), 15);
+    EXPECT_EQ(_file, "0123456789");
+
+    EXPECT_EQ(read(buffer, 100, 0), std::string("01234ab789\0\0xyz", 15));
+
+    buffer.flush();
+    EXPECT_EQ(_stored, (std::vector<uint64_t>{1, 3}));
+    EXPECT_EQ(_file, std::string("01234ab789\0\0xyz", 15));
+    EXPECT_FALSE(buffer.dirty());
+}
+
+TEST_F(FileBufferTest, SkipsFetchForOverwrittenBlocks) {
+    auto buffer = make_buffer();
+    buffer.write("abcdefgh", 8, 4);
+    EXPECT_TRUE(_fetched.empty());
+    EXPECT_EQ(read(buffer, 100, 0), "0123abcdefgh");
+}
+
+TEST_F(FileBufferTest, Truncates) {
+    auto buffer = make_buffer();
+    buffer.write("ab", 2, 8);
+    buffer.truncate(6);
+    EXPECT_EQ(read(buffer, 100, 0), "012345");
+    buffer.truncate(8);
+    EXPECT_EQ(read(buffer, 100, 0), std::string("012345\0\0", 8));
+    buffer.flush();
+    EXPECT_TRUE(_stored.empty());
+}
+
+TEST_F(FileBufferTest, FlushesOverCapacity) {
+    auto buffer = make_buffer(8);
+    buffer.write("abcd", 4, 0);
+    buffer.write("efgh", 4, 4);
+    EXPECT_TRUE(_stored.empty());
+    buffer.write("ij", 2, 8);
+    EXPECT_EQ(_file, "abcdefghij");
+    EXPECT_EQ(buffer.cached_bytes(), 0);
+}
+
+TEST_F(FileBufferTest, SharedBudget) {
+    _file       = "abcdefgh";
+    auto budget = std::make_shared<std::atomic<size_t>>(0);
+    auto fetch  = [this](const std::vector<uint64_t>& blocks) {
+        std::vector<std::vector<uint8_t>> ret;
+        for (uint64_t block: blocks)
+            ret.emplace_back(_file.begin() + block * block_size, _file.begin() + (block + 1) * block_size);
+        return ret;
+    };
+    auto store = [](const std::vector<std::pair<uint64_t, const std::vector<uint8_t>*>>&) {};
+
+    FileBuffer first(block_size, 8, _file.size(), fetch, store, budget);
+    FileBuffer second(block_size, 8, _file.size(), fetch, store, budget);
+    ASSERT_EQ(read(first, 8, 0), "abcdefgh");
+    ASSERT_EQ(budget->load(), 8);
+
+    // Over the budget together, so the second one gives up its blocks
+    ASSERT_EQ(read(second, 4, 0), "abcd");
+    ASSERT_EQ(second.cached_bytes(), 0);
+    ASSERT_EQ(budget->load(), 8);
+
+    {
+        FileBuffer moved(std::move(first));
+        ASSERT_EQ(budget->load(), 8);
+    }
+    ASSERT_EQ(budget->load(), 0);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "GroupCommit.hpp"
+#include "TempDirTest.hpp"
+
+class GroupCommitTest : public TempDirTest {
+protected:
+    void SetUp() override {
+        TempDirTest::SetUp();
+        for (int i = 0; i < 4; i++) {
+            int fd = open((_dir / std::to_string(i)).c_str(), O_RDWR | O_CREAT, 0644);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(write(fd, "data", 4), 4);
+            _fds.push_back(fd);
+        }
+    }
+
+    void TearDown() override {
+        for (int fd: _fds)
+            close(fd);
+        TempDirTest::TearDown();
+    }
+
+    std::vector<int> _fds;
+};
+
+TEST_F(GroupCommitTest, ConcurrentSyncsAreGrouped) {
+    GroupCommit              group(true);
+    std::vector<std::thread> threads;
+    std::atomic<int>         failed{0};
+    for (int t = 0; t < 16; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 20; i++) {
+                if (group.sync(_fds[static_cast<size_t>(t) % _fds.size()], i % 2 == 0) != 0)
+                    failed++;
+            }
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+
+    EXPECT_EQ(failed, 0);
+    auto stats = group.stats();
+    EXPECT_EQ(stats.requests, 320);
+    EXPECT_GE(stats.groups, 1);
+    EXPECT_LE(stats.groups, stats.requests);
+}
+
+TEST_F(GroupCommitTest, Disabled) {
+    GroupCommit group(false);
+    EXPECT_EQ(group.sync(_fds[0], false), 0);
+    EXPECT_EQ(group.sync(_fds[1], true), 0);
+    EXPECT_EQ(group.stats().groups, 2);
+}
+
+TEST_F(GroupCommitTest, BadFd) {
+    GroupCommit group(true);
+    EXPECT_EQ(group.sync(-1, false), -EBADF);
+    EXPECT_EQ(group.sync(_fds[0], false), 0);
+}
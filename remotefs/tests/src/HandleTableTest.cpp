@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+
+#include "HandleTable.hpp"
+
+TEST(HandleTableTest, LimitPerOwner) {
+    HandleTable table(2);
+
+    auto first  = table.add(1, "a", nullptr);
+    auto second = table.add(1, "b", nullptr);
+    EXPECT_NE(first, 0);
+    EXPECT_NE(second, 0);
+    EXPECT_EQ(table.add(1, "c", nullptr), 0);
+
+    // Other owners have their own limit
+    EXPECT_NE(table.add(2, "a", nullptr), 0);
+
+    EXPECT_TRUE(table.release(1, first));
+    EXPECT_NE(table.add(1, "c", nullptr), 0);
+    EXPECT_EQ(table.add(1, "d", nullptr), 0);
+
+    table.release_all(1);
+    EXPECT_EQ(table.get(1, second), nullptr);
+    EXPECT_NE(table.add(1, "e", nullptr), 0);
+}
+
+TEST(HandleTableTest, ForeignHandle) {
+    HandleTable table;
+
+    auto handle = table.add(1, "a", nullptr);
+    EXPECT_EQ(table.get(2, handle), nullptr);
+    EXPECT_FALSE(table.release(2, handle));
+    EXPECT_NE(table.get(1, handle), nullptr);
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "Exception.h"
+#include "FdCache.hpp"
+#include "IoEngine.hpp"
+#include "TempDirTest.hpp"
+
+class IoEngineTest : public TempDirTest {
+protected:
+    static std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+        std::vector<uint8_t> out(size);
+        for (size_t i = 0; i < size; i++)
+            out[i] = static_cast<uint8_t>(i * 31 + i / 4096 + seed);
+        return out;
+    }
+
+};
+
+TEST_F(IoEngineTest, DirectReadsUnaligned) {
+    DirectIo engine(16384, 2);
+    auto     contents = pattern(100000, 1);
+    auto     path     = make_file("a", contents);
+
+    FdCache::File file(open(path.c_str(), O_RDWR | O_CLOEXEC), true, engine);
+    ASSERT_FALSE(file.cached());
+
+    for (auto [off, len]: std::vector<std::pair<size_t, size_t>>{
+                 {0, 4096}, {1, 10}, {4095, 2}, {5000, 40000}, {99990, 100}, {100000, 10}, {12345, 100000}}) {
+        std::vector<uint8_t> buf(len);
+        auto                 got = file.read(buf.data(), len, static_cast<off_t>(off));
+        size_t               exp = off < contents.size() ? std::min(len, contents.size() - off) : 0;
+        ASSERT_EQ(got, static_cast<ssize_t>(exp)) << off << " " << len;
+        ASSERT_TRUE(std::equal(buf.begin(), buf.begin() + static_cast<ptrdiff_t>(exp),
+                               contents.begin() + static_cast<ptrdiff_t>(off)));
+    }
+}
+
+TEST_F(IoEngineTest, DirectWritesUnaligned) {
+    DirectIo engine(16384, 2);
+    auto     contents = pattern(50000, 2);
+    auto     path     = make_file("a", contents);
+
+    FdCache::File file(open(path.c_str(), O_RDWR | O_CLOEXEC), true, engine);
+    for (auto [off, len]: std::vector<std::pair<size_t, size_t>>{
+                 {0, 8192}, {3, 5}, {4000, 200}, {4096, 40000}, {100, 45000}, {49000, 5000}, {60000, 4096}}) {
+        auto data = pattern(len, static_cast<uint8_t>(off));
+        ASSERT_EQ(file.write(data.data(), len, static_cast<off_t>(off)), static_cast<ssize_t>(len));
+        if (contents.size() < off + len)
+            contents.resize(off + len);
+        std::copy(data.begin(), data.end(), contents.begin() + static_cast<ptrdiff_t>(off));
+    }
+
+    // The file doesn't grow past the last byte written
+    ASSERT_EQ(std::filesystem::file_size(path), contents.size());
+    std::vector<uint8_t> buf(contents.size());
+    ASSERT_EQ(file.read(buf.data(), buf.size(), 0), static_cast<ssize_t>(buf.size()));
+    ASSERT_EQ(buf, contents);
+
+    std::ifstream        ifs(path, std::ios::binary);
+    std::vector<uint8_t> on_disk((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(on_disk, contents);
+}
+
+TEST_F(IoEngineTest, ReadOnly) {
+    DirectIo engine(8192, 1);
+    auto     contents = pattern(10000, 3);
+    auto     path     = make_file("a", contents);
+
+    FdCache::File        file(open(path.c_str(), O_RDONLY | O_CLOEXEC), false, engine);
+    std::vector<uint8_t> buf(contents.size());
+    ASSERT_EQ(file.read(buf.data(), buf.size(), 0), static_cast<ssize_t>(buf.size()));
+    ASSERT_EQ(buf, contents);
+    ASSERT_EQ(file.write(buf.data(), 10, 0), -1);
+}
+
+TEST_F(IoEngineTest, Pool) {
+    AlignedPool pool(5000, 1);
+    ASSERT_EQ(pool.size(), 8192);
+
+    uint8_t* kept;
+    {
+        auto a = pool.get();
+        auto b = pool.get();
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(a.data()) % AlignedPool::alignment, 0);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(b.data()) % AlignedPool::alignment, 0);
+        ASSERT_NE(a.data(), b.data());
+        kept = b.data();
+    }
+    // Only one is kept, the one returned first
+    ASSERT_EQ(pool.get().data(), kept);
+}
+
+TEST_F(IoEngineTest, Prefixes) {
+    IoEngines engines(4096, 1);
+    ASSERT_TRUE(engines.for_path("/data/a").cached());
+
+    engines.load("/data direct\n/data/small/ buffered\n\n/scratch direct\n");
+    ASSERT_FALSE(engines.for_path("/data").cached());
+    ASSERT_FALSE(engines.for_path("/data/big/a").cached());
+    ASSERT_TRUE(engines.for_path("/data/small").cached());
+    ASSERT_TRUE(engines.for_path("/data/small/a").cached());
+    ASSERT_TRUE(engines.for_path("/database").cached());
+    ASSERT_TRUE(engines.for_path("/other").cached());
+    ASSERT_FALSE(engines.for_path("/scratch/x").cached());
+
+    engines.load("/ direct");
+    ASSERT_FALSE(engines.for_path("/other").cached());
+    ASSERT_TRUE(engines.for_path("/data/small/a").cached());
+
+    ASSERT_THROW(engines.load("/x fast"), Exception);
+    ASSERT_THROW(engines.load("x direct"), Exception);
+    ASSERT_THROW(engines.load("/x"), Exception);
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "LeaseManager.hpp"
+
+class LeaseManagerTest : public ::testing::Test {
+protected:
+    LeaseManager make_manager(std::chrono::milliseconds timeout, bool return_leases = true) {
+        return LeaseManager(timeout, [this, return_leases](int owner, uint64_t handle) {
+            _recalled.emplace_back(owner, handle);
+            if (return_leases)
+                _returners.emplace_back([this, handle]() { _manager->release(handle); });
+        });
+    }
+
+    void TearDown() override {
+        for (auto& thread: _returners)
+            thread.join();
+    }
+
+    LeaseManager*                         _manager = nullptr;
+    std::vector<std::pair<int, uint64_t>> _recalled;
+    std::vector<std::thread>              _returners;
+};
+
+TEST_F(LeaseManagerTest, SharesReadLeases) {
+    auto manager = make_manager(std::chrono::seconds(5));
+    _manager     = &manager;
+
+    EXPECT_EQ(manager.acquire(1, 10, {1, 1}, LeaseType::READ), LeaseType::READ);
+    EXPECT_EQ(manager.acquire(2, 20, {1, 1}, LeaseType::READ), LeaseType::READ);
+    EXPECT_FALSE(manager.conflict(30, {1, 1}, false));
+    EXPECT_TRUE(_recalled.empty());
+
+    // Another file
+    EXPECT_EQ(manager.acquire(2, 21, {1, 2}, LeaseType::WRITE), LeaseType::WRITE);
+    EXPECT_EQ(manager.size(), 3);
+}
+
+TEST_F(LeaseManagerTest, RecallsOnConflict) {
+    auto manager = make_manager(std::chrono::seconds(5));
+    _manager     = &manager;
+
+    EXPECT_EQ(manager.acquire(1, 10, {1, 1}, LeaseType::WRITE), LeaseType::WRITE);
+    // The holder's own accesses don't conflict
+    EXPECT_FALSE(manager.conflict(10, {1, 1}, true));
+
+    EXPECT_TRUE(manager.conflict(20, {1, 1}, false));
+    EXPECT_EQ(_recalled, (std::vector<std::pair<int, uint64_t>>{{1, 10}}));
+    EXPECT_EQ(manager.size(), 0);
+    EXPECT_FALSE(manager.active());
+}
+
+TEST_F(LeaseManagerTest, SharedFileGetsNoLease) {
+    auto manager = make_manager(std::chrono::seconds(5));
+    _manager     = &manager;
+
+    EXPECT_EQ(manager.acquire(1, 10, {1, 1}, LeaseType::READ), LeaseType::READ);
+    EXPECT_EQ(manager.acquire(2, 20, {1, 1}, LeaseType::WRITE), LeaseType::NONE);
+    for (auto& thread: _returners)
+        thread.join();
+    _returners.clear();
+    EXPECT_EQ(_recalled, (std::vector<std::pair<int, uint64_t>>{{1, 10}}));
+    EXPECT_EQ(manager.size(), 0);
+}
+
+TEST_F(LeaseManagerTest, RevokesAfterTimeout) {
+    auto manager = make_manager(std::chrono::milliseconds(50), false);
+    _manager     = &manager;
+
+    EXPECT_EQ(manager.acquire(1, 10, {1, 1}, LeaseType::WRITE), LeaseType::WRITE);
+    EXPECT_TRUE(manager.conflict(20, {1, 1}, true));
+    EXPECT_EQ(manager.size(), 0);
+
+    // Until the holder gives the lease up, what it buffered must not be written
+    EXPECT_TRUE(manager.revoked(10));
+    EXPECT_FALSE(manager.revoked(20));
+    manager.release(10);
+    EXPECT_FALSE(manager.revoked(10));
+
+    EXPECT_EQ(manager.acquire(1, 11, {1, 1}, LeaseType::WRITE), LeaseType::WRITE);
+    EXPECT_TRUE(manager.conflict(20, {1, 1}, true));
+    manager.release_all(1);
+    EXPECT_FALSE(manager.revoked(11));
+}
+
+TEST_F(LeaseManagerTest, WaitsThroughHook) {
+    size_t       waits = 0;
+    LeaseManager manager(
+            std::chrono::milliseconds(50), [](int, uint64_t) {},
+            [&](const std::function<void()>& wait) {
+                waits++;
+                wait();
+            });
+
+    EXPECT_FALSE(manager.conflict(20, {1, 1}, true));
+    EXPECT_EQ(waits, 0);
+
+    manager.acquire(1, 10, {1, 1}, LeaseType::READ);
+    EXPECT_TRUE(manager.conflict(20, {1, 1}, true));
+    EXPECT_EQ(waits, 1);
+}
+
+TEST_F(LeaseManagerTest, ReleasesByOwner) {
+    auto manager = make_manager(std::chrono::seconds(5));
+    _manager     = &manager;
+
+    manager.acquire(1, 10, {1, 1}, LeaseType::READ);
+    manager.acquire(1, 11, {1, 2}, LeaseType::WRITE);
+    manager.acquire(2, 20, {1, 1}, LeaseType::READ);
+    manager.release_all(1);
+    EXPECT_EQ(manager.size(), 1);
+    manager.release(20);
+    EXPECT_EQ(manager.size(), 0);
+
+    auto disabled = LeaseManager(std::chrono::milliseconds(0), {});
+    EXPECT_EQ(disabled.acquire(1, 10, {1, 1}, LeaseType::WRITE), LeaseType::NONE);
+}
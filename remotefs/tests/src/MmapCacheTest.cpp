@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "MmapCache.hpp"
+#include "TempDirTest.hpp"
+
+class MmapCacheTest : public TempDirTest {
+protected:
+    void TearDown() override {
+        for (int fd: _fds)
+            close(fd);
+        TempDirTest::TearDown();
+    }
+
+    int open_file(const std::string& name, const std::string& contents) {
+        int fd = open(make_file(name, contents).c_str(), O_RDWR | O_CLOEXEC);
+        _fds.push_back(fd);
+        return fd;
+    }
+
+    static struct stat stat_of(int fd) {
+        struct stat st;
+        fstat(fd, &st);
+        return st;
+    }
+
+    static std::string contents(const MmapCache::MappingT& mapping) {
+        return {reinterpret_cast<const char*>(mapping->data()), mapping->size()};
+    }
+
+    std::vector<int> _fds;
+};
+
+TEST_F(MmapCacheTest, Hits) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    auto first = cache.get(fd, stat_of(fd));
+    ASSERT_NE(first, nullptr);
+    ASSERT_EQ(contents(first), "hello");
+    ASSERT_EQ(cache.get(fd, stat_of(fd)), first);
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.entries, 1);
+}
+
+TEST_F(MmapCacheTest, InPlaceWritesShowThrough) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    auto mapping = cache.get(fd, stat_of(fd));
+    ASSERT_EQ(pwrite(fd, "J", 1, 0), 1);
+    ASSERT_EQ(contents(mapping), "Jello");
+}
+
+TEST_F(MmapCacheTest, Remaps) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    auto first = cache.get(fd, stat_of(fd));
+    ASSERT_EQ(pwrite(fd, " world", 6, 5), 6);
+
+    auto second = cache.get(fd, stat_of(fd));
+    ASSERT_NE(second, first);
+    ASSERT_EQ(contents(second), "hello world");
+    // Still usable by whoever held it
+    ASSERT_EQ(contents(first), "hello");
+
+    struct stat st = stat_of(fd);
+    st.st_mtim.tv_nsec ^= 1;
+    ASSERT_NE(cache.get(fd, st), second);
+}
+
+TEST_F(MmapCacheTest, Limits) {
+    MmapCache cache(2, 8);
+    int       big   = open_file("big", "123456789");
+    int       empty = open_file("empty", "");
+    ASSERT_EQ(cache.get(big, stat_of(big)), nullptr);
+    ASSERT_EQ(cache.get(empty, stat_of(empty)), nullptr);
+
+    int  a       = open_file("a", "a");
+    int  b       = open_file("b", "b");
+    int  c       = open_file("c", "c");
+    auto a_first = cache.get(a, stat_of(a));
+    cache.get(b, stat_of(b));
+    cache.get(c, stat_of(c));
+    ASSERT_EQ(cache.stats().entries, 2);
+    ASSERT_NE(cache.get(a, stat_of(a)), a_first);
+    ASSERT_EQ(contents(a_first), "a");
+
+    MmapCache disabled(0, 8);
+    ASSERT_EQ(disabled.get(a, stat_of(a)), nullptr);
+}
+
+TEST_F(MmapCacheTest, Invalidate) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    auto        first = cache.get(fd, stat_of(fd));
+    struct stat st    = stat_of(fd);
+    cache.invalidate(st.st_dev, st.st_ino);
+    ASSERT_EQ(cache.stats().entries, 0);
+    ASSERT_NE(cache.get(fd, st), first);
+}
+
+TEST_F(MmapCacheTest, TruncatedUnderCopy) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    auto    mapping = cache.get(fd, stat_of(fd));
+    uint8_t buf[5];
+    ASSERT_TRUE(mapping->copy(0, 5, buf));
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buf), 5), "hello");
+
+    ASSERT_EQ(ftruncate(fd, 0), 0);
+    ASSERT_FALSE(mapping->copy(0, 5, buf));
+    // Still usable afterwards
+    ASSERT_EQ(ftruncate(fd, 5), 0);
+    ASSERT_TRUE(mapping->copy(0, 5, buf));
+}
+
+TEST_F(MmapCacheTest, Unlinked) {
+    MmapCache cache(4, 1024);
+    int       fd = open_file("a", "hello");
+
+    ASSERT_NE(cache.get(fd, stat_of(fd)), nullptr);
+    std::filesystem::remove(_dir / "a");
+    ASSERT_EQ(cache.get(fd, stat_of(fd)), nullptr);
+    ASSERT_EQ(cache.stats().entries, 0);
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include "PageCache.hpp"
+
+static PageCache::BlockT block(size_t size, uint8_t fill) {
+    return std::make_shared<const std::vector<uint8_t>>(size, fill);
+}
+
+TEST(PageCacheTest, KeepsBlocksOfTheSameVersion) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 150, 1, 0);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+
+    cache.put("/a", 0, block(100, 1), token);
+    cache.put("/a", 1, block(50, 2), token);
+    EXPECT_EQ(cache.validate("/a", 150, 1, 0), token);
+    ASSERT_NE(cache.get("/a", 0), nullptr);
+    EXPECT_EQ(*cache.get("/a", 1), std::vector<uint8_t>(50, 2));
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.bytes, 150);
+}
+
+TEST(PageCacheTest, DropsBlocksWhenTheFileChanges) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 100, 1, 0);
+    cache.put("/a", 0, block(100, 1), token);
+
+    auto changed = cache.validate("/a", 100, 1, 5);
+    EXPECT_NE(changed, token);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+    EXPECT_EQ(cache.stats().bytes, 0);
+
+    // Read before the change
+    cache.put("/a", 0, block(100, 1), token);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+}
+
+TEST(PageCacheTest, WritesGoThrough) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 120, 1, 0);
+    cache.put("/a", 0, block(100, 1), token);
+    cache.put("/a", 1, block(20, 2), token);
+
+    std::vector<char> data(30, 3);
+    cache.write("/a", data.data(), data.size(), 90);
+
+    auto first = cache.get("/a", 0);
+    EXPECT_EQ((*first)[89], 1);
+    EXPECT_EQ((*first)[90], 3);
+    auto second = cache.get("/a", 1);
+    ASSERT_EQ(second->size(), 20);
+    EXPECT_EQ((*second)[19], 3);
+
+    // The version the server reported after our write
+    cache.wrote("/a", 120, 2, 0);
+    cache.validate("/a", 120, 2, 0);
+    EXPECT_EQ((*cache.get("/a", 0))[90], 3);
+    // Someone else's isn't
+    cache.validate("/a", 120, 3, 0);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+}
+
+TEST(PageCacheTest, OthersWritesAfterOursDropBlocks) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 100, 1, 0);
+    cache.put("/a", 0, block(100, 1), token);
+
+    // Written locally, then overwritten by someone else without changing the size
+    std::vector<char> data(10, 2);
+    cache.write("/a", data.data(), data.size(), 0);
+    cache.validate("/a", 100, 3, 0);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+
+    // Same if the server told us about our write, but the file changed again since
+    token = cache.validate("/a", 100, 3, 0);
+    cache.put("/a", 0, block(100, 1), token);
+    cache.write("/a", data.data(), data.size(), 0);
+    cache.wrote("/a", 100, 4, 0);
+    cache.validate("/a", 100, 5, 0);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+}
+
+TEST(PageCacheTest, WritesExtendTheLastBlock) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 10, 1, 0);
+    cache.put("/a", 0, block(10, 1), token);
+
+    std::vector<char> data(10, 2);
+    cache.write("/a", data.data(), data.size(), 20);
+    auto got = cache.get("/a", 0);
+    ASSERT_EQ(got->size(), 30);
+    EXPECT_EQ((*got)[15], 0);
+    EXPECT_EQ((*got)[25], 2);
+
+    // Past the cached last block, which would now end the file too early
+    cache.write("/a", data.data(), data.size(), 250);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+    cache.validate("/a", 260, 2, 0);
+    EXPECT_EQ(cache.stats().bytes, 0);
+}
+
+TEST(PageCacheTest, SkipsBlocksReadDuringAWrite) {
+    PageCache cache(1024, 100);
+    auto      token = cache.validate("/a", 100, 1, 0);
+
+    std::vector<char> data(10, 2);
+    cache.write("/a", data.data(), data.size(), 0);
+    cache.put("/a", 0, block(100, 1), token);
+    EXPECT_EQ(cache.get("/a", 0), nullptr);
+}
+
+TEST(PageCacheTest, EvictsLeastRecentlyUsed) {
+    PageCache cache(300, 100);
+    auto      token = cache.validate("/a", 1000, 1, 0);
+    cache.put("/a", 0, block(100, 0), token);
+    cache.put("/a", 1, block(100, 1), token);
+    cache.put("/a", 2, block(100, 2), token);
+
+    cache.get("/a", 0);
+    cache.put("/a", 3, block(100, 3), token);
+    EXPECT_NE(cache.get("/a", 0), nullptr);
+    EXPECT_EQ(cache.get("/a", 1), nullptr);
+    EXPECT_NE(cache.get("/a", 3), nullptr);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.evictions, 1);
+    EXPECT_EQ(stats.bytes, 300);
+}
+
+TEST(PageCacheTest, ForgetsFilesWithoutBlocks) {
+    PageCache cache(200, 100);
+    for (int i = 0; i < 10; i++) {
+        auto path  = "/" + std::to_string(i);
+        auto token = cache.validate(path, 100, 1, 0);
+        cache.put(path, 0, block(100, 1), token);
+    }
+    EXPECT_EQ(cache.stats().files, 2);
+
+    // Empty files have nothing to cache
+    cache.validate("/empty", 0, 1, 0);
+    EXPECT_EQ(cache.stats().files, 2);
+}
+
+TEST(PageCacheTest, InvalidatesTrees) {
+    PageCache cache(1024, 100);
+    for (const auto* path: {"/d", "/d/a", "/d/b/c", "/dd"}) {
+        auto token = cache.validate(path, 10, 1, 0);
+        cache.put(path, 0, block(10, 1), token);
+    }
+
+    cache.invalidate_tree("/d");
+    EXPECT_EQ(cache.get("/d", 0), nullptr);
+    EXPECT_EQ(cache.get("/d/a", 0), nullptr);
+    EXPECT_EQ(cache.get("/d/b/c", 0), nullptr);
+    EXPECT_NE(cache.get("/dd", 0), nullptr);
+
+    cache.invalidate("/dd");
+    EXPECT_EQ(cache.get("/dd", 0), nullptr);
+    EXPECT_EQ(cache.stats().bytes, 0);
+}
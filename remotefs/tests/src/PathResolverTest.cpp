@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "PathResolver.hpp"
+#include "TempDirTest.hpp"
+
+class PathResolverTest : public TempDirTest {
+protected:
+    void SetUp() override {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(_dir / "root" / "a" / "b");
+        make_file("root/a/b/file", "hello");
+        make_file("outside", "secret");
+    }
+};
+
+TEST_F(PathResolverTest, Stat) {
+    PathResolver resolver(_dir / "root", 4);
+
+    struct stat st;
+    ASSERT_EQ(resolver.stat("/a/b/file", st), 0);
+    ASSERT_TRUE(S_ISREG(st.st_mode));
+    ASSERT_EQ(st.st_size, 5);
+
+    ASSERT_EQ(resolver.stat("/", st), 0);
+    ASSERT_TRUE(S_ISDIR(st.st_mode));
+    ASSERT_EQ(resolver.stat("//a//b/", st), 0);
+    ASSERT_TRUE(S_ISDIR(st.st_mode));
+
+    ASSERT_EQ(resolver.stat("/a/missing", st), -1);
+    ASSERT_EQ(errno, ENOENT);
+    ASSERT_EQ(resolver.stat("/missing/file", st), -1);
+    ASSERT_EQ(errno, ENOENT);
+}
+
+TEST_F(PathResolverTest, CachesDirectories) {
+    PathResolver resolver(_dir / "root", 4);
+
+    auto first = resolver.resolve("/a/b/file");
+    ASSERT_EQ(first.name, "file");
+    ASSERT_EQ(resolver.size(), 1);
+
+    auto second = resolver.resolve("/a/b/other");
+    ASSERT_EQ(first.dir, second.dir);
+
+    resolver.resolve("/a/x");
+    ASSERT_EQ(resolver.size(), 2);
+
+    resolver.invalidate("/a");
+    ASSERT_EQ(resolver.size(), 0);
+    // Still usable by holders
+    struct stat st;
+    ASSERT_EQ(fstatat(first.dir_fd(), "file", &st, 0), 0);
+}
+
+TEST_F(PathResolverTest, Open) {
+    PathResolver resolver(_dir / "root", 0);
+
+    int fd = resolver.open("/a/b/file", O_RDONLY);
+    ASSERT_GE(fd, 0);
+    char buf[5];
+    ASSERT_EQ(read(fd, buf, 5), 5);
+    close(fd);
+
+    fd = resolver.open("/a/new", O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_TRUE(std::filesystem::exists(_dir / "root" / "a" / "new"));
+    ASSERT_EQ(resolver.size(), 0);
+}
+
+TEST_F(PathResolverTest, StaysInsideRoot) {
+    PathResolver resolver(_dir / "root", 4);
+    std::filesystem::create_symlink(_dir / "outside", _dir / "root" / "link");
+    std::filesystem::create_directory_symlink(_dir, _dir / "root" / "dirlink");
+    std::filesystem::create_symlink("a/b/file", _dir / "root" / "inside");
+
+    struct stat st;
+    ASSERT_EQ(resolver.stat("/../outside", st), -1);
+    ASSERT_EQ(resolver.stat("/a/../../outside", st), -1);
+    ASSERT_EQ(resolver.open("/link", O_RDONLY), -1);
+    ASSERT_EQ(resolver.stat("/link", st), -1);
+    ASSERT_EQ(resolver.stat("/dirlink/outside", st), -1);
+    ASSERT_THROW(resolver.resolve("/dirlink/outside"), std::exception);
+
+    // Links that stay inside are fine
+    ASSERT_EQ(resolver.stat("/inside", st), 0);
+    ASSERT_EQ(st.st_size, 5);
+
+    // Same for names inside an already open directory
+    auto root = resolver.resolve("/link");
+    ASSERT_EQ(resolver.stat_at("/", root.dir_fd(), "link", st), -1);
+    ASSERT_EQ(resolver.stat_at("/", root.dir_fd(), "inside", st), 0);
+    ASSERT_EQ(st.st_size, 5);
+}
+
+TEST_F(PathResolverTest, LinkToParentInsideRoot) {
+    std::filesystem::create_directories(_dir / "root" / "c");
+    std::ofstream(_dir / "root" / "c" / "file") << "in c";
+    std::filesystem::create_directory_symlink("../c", _dir / "root" / "a" / "link");
+
+    auto check = [&](PathResolver& resolver) {
+        struct stat st;
+        ASSERT_EQ(resolver.stat("/a/link", st), 0);
+        ASSERT_TRUE(S_ISDIR(st.st_mode));
+        ASSERT_EQ(resolver.stat("/a/link/file", st), 0);
+        ASSERT_EQ(st.st_size, 4);
+
+        int fd = resolver.open("/a/link/file", O_RDONLY);
+        ASSERT_GE(fd, 0);
+        close(fd);
+
+        fd = resolver.open("/a", O_RDONLY | O_DIRECTORY);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(resolver.stat_at("/a", fd, "link", st), 0);
+        ASSERT_TRUE(S_ISDIR(st.st_mode));
+        close(fd);
+    };
+
+    // Nothing cached yet
+    PathResolver cold(_dir / "root", 0);
+    check(cold);
+
+    // With /a and /a/link already cached
+    PathResolver warm(_dir / "root", 8);
+    warm.resolve("/a/x");
+    warm.resolve("/a/link/x");
+    ASSERT_EQ(warm.size(), 2);
+    check(warm);
+}
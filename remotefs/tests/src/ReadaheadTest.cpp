@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "Readahead.hpp"
+
+static constexpr size_t chunk = 128 * 1024;
+
+TEST(ReadaheadTest, GrowsOnSequential) {
+    Readahead ra(chunk, 4 * chunk);
+
+    auto first = ra.on_read(0, chunk);
+    ASSERT_EQ(first.first, chunk);
+    ASSERT_EQ(first.second, chunk);
+
+    size_t prefetched = first.first + first.second;
+    for (size_t off = chunk; off < 64 * chunk; off += chunk) {
+        auto [ahead_off, ahead_len] = ra.on_read(static_cast<off_t>(off), chunk);
+        if (ahead_len > 0) {
+            // Never prefetches the same data twice and never leaves gaps
+            ASSERT_EQ(static_cast<size_t>(ahead_off), prefetched);
+            prefetched += ahead_len;
+        }
+        // Always stays ahead of the reader
+        ASSERT_GT(prefetched, off + chunk);
+    }
+
+    ASSERT_EQ(ra.window(), 4 * chunk);
+}
+
+TEST(ReadaheadTest, ResetsOnRandom) {
+    Readahead ra(chunk, 4 * chunk);
+
+    ra.on_read(0, chunk);
+    ra.on_read(chunk, chunk);
+    ASSERT_EQ(ra.window(), 2 * chunk);
+
+    ASSERT_EQ(ra.on_read(100 * chunk, chunk).second, 0);
+    ASSERT_EQ(ra.window(), 0);
+
+    // Continuing from the new position is a new stream
+    auto next = ra.on_read(101 * chunk, chunk);
+    ASSERT_EQ(next.first, 102 * chunk);
+    ASSERT_EQ(next.second, chunk);
+}
+
+TEST(ReadaheadTest, Disabled) {
+    Readahead ra(chunk, 0);
+
+    ASSERT_EQ(ra.on_read(0, chunk).second, 0);
+    ASSERT_EQ(ra.on_read(chunk, chunk).second, 0);
+}
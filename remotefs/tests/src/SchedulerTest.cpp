@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+
+#include <future>
+#include <latch>
+
+#include "Scheduler.hpp"
+
+class SchedulerTest : public ::testing::Test {
+protected:
+    // Occupies the only worker until released, so that everything submitted meanwhile is queued
+    void block(Scheduler& scheduler) {
+        scheduler.submit("block", 0, [this] {
+            _gate.get_future().wait();
+            return uint64_t(0);
+        });
+    }
+
+    // Records the order tasks of each queue ran in
+    Scheduler::TaskT record(const std::string& queue, std::latch& done) {
+        return [this, queue, &done] {
+            {
+                std::lock_guard lock(_mutex);
+                _order.push_back(queue);
+            }
+            done.count_down();
+            return uint64_t(0);
+        };
+    }
+
+    std::promise<void>       _gate;
+    std::mutex               _mutex;
+    std::vector<std::string> _order;
+};
+
+TEST_F(SchedulerTest, RunsEverything) {
+    Scheduler   scheduler(4, 4 * Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; });
+    std::latch  done(300);
+    for (int i = 0; i < 100; i++) {
+        scheduler.submit("a", 0, record("a", done));
+        scheduler.submit("b", 1000, record("b", done));
+        scheduler.submit("c", 100000, record("c", done));
+    }
+    done.wait();
+    EXPECT_EQ(_order.size(), 300);
+}
+
+TEST_F(SchedulerTest, BusyQueueDoesNotStarveOthers) {
+    Scheduler scheduler(1, 2 * Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; });
+    block(scheduler);
+
+    std::latch done(55);
+    for (int i = 0; i < 50; i++)
+        scheduler.submit("busy", 0, record("busy", done));
+    for (int i = 0; i < 5; i++)
+        scheduler.submit("quiet", 0, record("quiet", done));
+
+    EXPECT_EQ(scheduler.depths()["busy"], 50);
+    EXPECT_EQ(scheduler.depths()["quiet"], 5);
+
+    _gate.set_value();
+    done.wait();
+
+    // Both queues take turns of two requests
+    size_t last_quiet = 0;
+    for (size_t i = 0; i < _order.size(); i++)
+        if (_order[i] == "quiet")
+            last_quiet = i;
+    EXPECT_LT(last_quiet, 15);
+}
+
+TEST_F(SchedulerTest, Weights) {
+    Scheduler scheduler(1, Scheduler::op_cost, [](const std::string& queue) {
+        return Scheduler::Limits{queue == "heavy" ? 3U : 1U, 0, 0};
+    });
+    block(scheduler);
+
+    std::latch done(80);
+    for (int i = 0; i < 40; i++) {
+        scheduler.submit("heavy", 0, record("heavy", done));
+        scheduler.submit("light", 0, record("light", done));
+    }
+
+    _gate.set_value();
+    done.wait();
+
+    auto heavy = std::count(_order.begin(), _order.begin() + 40, "heavy");
+    EXPECT_GE(heavy, 28);
+    EXPECT_LE(heavy, 32);
+}
+
+TEST_F(SchedulerTest, BigRepliesAreCharged) {
+    Scheduler scheduler(1, Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; });
+    block(scheduler);
+
+    std::latch done(20);
+    for (int i = 0; i < 10; i++) {
+        scheduler.submit("reader", 0, [&] {
+            record("reader", done)();
+            return uint64_t(10 * Scheduler::op_cost);
+        });
+        scheduler.submit("small", 0, record("small", done));
+    }
+
+    _gate.set_value();
+    done.wait();
+
+    // Every big reply is paid for with ten turns of the other queue
+    EXPECT_LE(std::count(_order.begin(), _order.begin() + 11, "reader"), 2);
+}
+
+TEST_F(SchedulerTest, IopsCap) {
+    Scheduler scheduler(4, Scheduler::op_cost, [](const std::string& queue) {
+        return queue == "capped" ? Scheduler::Limits{1, 20, 0} : Scheduler::Limits{};
+    });
+
+    auto       start = Scheduler::ClockT::now();
+    std::latch done(30);
+    // The first second worth of requests goes through immediately
+    for (int i = 0; i < 30; i++)
+        scheduler.submit("capped", 0, record("capped", done));
+
+    std::latch other(10);
+    for (int i = 0; i < 10; i++)
+        scheduler.submit("other", 0, record("other", other));
+    other.wait();
+    EXPECT_LT(Scheduler::ClockT::now() - start, std::chrono::milliseconds(300));
+
+    done.wait();
+    EXPECT_GE(Scheduler::ClockT::now() - start, std::chrono::milliseconds(400));
+}
+
+TEST_F(SchedulerTest, BandwidthCap) {
+    Scheduler scheduler(2, Scheduler::op_cost, [](const std::string&) {
+        return Scheduler::Limits{1, 0, 1024 * 1024};
+    });
+
+    auto       start = Scheduler::ClockT::now();
+    std::latch done(4);
+    for (int i = 0; i < 4; i++)
+        scheduler.submit("capped", 0, [&] {
+            record("capped", done)();
+            return uint64_t(512 * 1024);
+        });
+    done.wait();
+
+    // A second worth of bandwidth is available immediately, the rest has to wait
+    EXPECT_GE(Scheduler::ClockT::now() - start, std::chrono::milliseconds(400));
+}
+
+TEST_F(SchedulerTest, SlowQueueDoesNotTakeEveryWorker) {
+    Scheduler scheduler(4, Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; }, 2);
+
+    // More slow requests than there are workers
+    auto       gate = _gate.get_future().share();
+    std::latch slow_done(8);
+    for (int i = 0; i < 8; i++)
+        scheduler.submit("slow", 0, [&, gate] {
+            gate.wait();
+            slow_done.count_down();
+            return uint64_t(0);
+        });
+
+    std::latch done(10);
+    for (int i = 0; i < 10; i++)
+        scheduler.submit("other", 0, record("other", done));
+    done.wait();
+    EXPECT_EQ(scheduler.depths()["slow"], 6);
+
+    _gate.set_value();
+    slow_done.wait();
+}
+
+TEST_F(SchedulerTest, BlockingTasksDoNotHoldWorkers) {
+    Scheduler scheduler(2, Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; });
+
+    // Both workers wait, spares serve the rest meanwhile
+    auto       gate = _gate.get_future().share();
+    std::latch blocked_done(2);
+    for (int i = 0; i < 2; i++)
+        scheduler.submit("waiting", 0, [&, gate] {
+            scheduler.blocking([&] { gate.wait(); });
+            blocked_done.count_down();
+            return uint64_t(0);
+        });
+
+    std::latch done(10);
+    for (int i = 0; i < 10; i++)
+        scheduler.submit("other", 0, record("other", done));
+    done.wait();
+
+    _gate.set_value();
+    blocked_done.wait();
+
+    // Outside of the workers it just runs
+    bool ran = false;
+    scheduler.blocking([&] { ran = true; });
+    EXPECT_TRUE(ran);
+}
+
+TEST_F(SchedulerTest, BlockedTasksDoNotCountAgainstQueue) {
+    Scheduler scheduler(4, Scheduler::op_cost, [](const std::string&) { return Scheduler::Limits{}; }, 2);
+
+    // As many requests as the queue may run wait for one that is submitted after them
+    std::promise<void> released;
+    auto               gate = released.get_future().share();
+    std::latch         blocked_done(2);
+    for (int i = 0; i < 2; i++)
+        scheduler.submit("user", 0, [&, gate] {
+            scheduler.blocking([&] { gate.wait(); });
+            blocked_done.count_down();
+            return uint64_t(0);
+        });
+    scheduler.submit("user", 0, [&] {
+        released.set_value();
+        return uint64_t(0);
+    });
+
+    blocked_done.wait();
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include <fcntl.h>
+
+#include "Exception.h"
+#include "Searcher.hpp"
+#include "TempDirTest.hpp"
+
+class SearcherTest : public TempDirTest {
+protected:
+    // Returns the name the searcher knows the file by
+    std::string add_file(const std::string& name, const std::string& contents) {
+        make_file(name, contents);
+        return name;
+    }
+
+    Searcher::OpenT opener() {
+        return [this](const std::string& name) { return open((_dir / name).c_str(), O_RDONLY | O_CLOEXEC); };
+    }
+};
+
+TEST(LiteralMatcherTest, MatchesNaive) {
+    std::mt19937 rng(42);
+    for (size_t n: {1, 2, 3, 5, 16, 17, 40}) {
+        for (int round = 0; round < 50; round++) {
+            // A small alphabet, so there are plenty of partial matches
+            std::string hay(rng() % 300, 'a');
+            for (auto& c: hay)
+                c = static_cast<char>('a' + rng() % 3);
+            std::string needle(n, 'a');
+            for (auto& c: needle)
+                c = static_cast<char>('a' + rng() % 3);
+
+            LiteralMatcher matcher(needle);
+            const char*    begin = hay.data();
+            const char*    end   = hay.data() + hay.size();
+            for (size_t from = 0; from <= hay.size(); from += 7) {
+                auto        expected = hay.find(needle, from);
+                const char* found    = matcher.find(begin + from, end);
+                if (expected == std::string::npos)
+                    ASSERT_EQ(found, nullptr) << hay << " " << needle << " " << from;
+                else
+                    ASSERT_EQ(found, begin + expected) << hay << " " << needle << " " << from;
+            }
+        }
+    }
+}
+
+TEST_F(SearcherTest, Lines) {
+    auto path = add_file("a", "one needle\ntwo\nneedle three needle\n\nfour\nlast needle");
+
+    Searcher searcher("needle", false, 1);
+    int      fd      = open((_dir / path).c_str(), O_RDONLY);
+    auto     matches = searcher.search_fd(fd, "a", 0, 100);
+    close(fd);
+
+    ASSERT_EQ(matches.size(), 3);
+    ASSERT_EQ(matches[0].line, 1);
+    ASSERT_EQ(matches[0].offset, 0);
+    ASSERT_EQ(matches[0].text, "one needle");
+    ASSERT_EQ(matches[1].line, 3);
+    ASSERT_EQ(matches[1].offset, 15);
+    ASSERT_EQ(matches[1].text, "needle three needle");
+    ASSERT_EQ(matches[2].line, 6);
+    ASSERT_EQ(matches[2].text, "last needle");
+}
+
+TEST_F(SearcherTest, Regex) {
+    auto     path = add_file("a", "int x;\nfloat y;\nint zz;\n");
+    Searcher searcher("^int [a-z]{2};$", true, 1);
+    auto     matches = searcher.search({path}, 0, 100, opener());
+    ASSERT_EQ(matches.size(), 1);
+    ASSERT_EQ(matches[0].line, 3);
+    ASSERT_EQ(matches[0].text, "int zz;");
+
+    ASSERT_THROW(Searcher("(", true, 1), Exception);
+    ASSERT_THROW(Searcher("", false, 1), Exception);
+    ASSERT_THROW(Searcher("a\nb", false, 1), Exception);
+}
+
+TEST_F(SearcherTest, AcrossChunks) {
+    // Lines straddle the chunk boundaries, and the line numbers carry over
+    std::string contents;
+    for (int i = 0; i < 300000; i++)
+        contents += (i % 1000 == 999 ? "match " : "line ") + std::to_string(i) + "\n";
+    auto path = add_file("a", contents);
+
+    Searcher searcher("match", false, 1);
+    auto     matches = searcher.search({path}, 0, 1000, opener());
+    ASSERT_EQ(matches.size(), 300);
+    for (size_t i = 0; i < matches.size(); i++) {
+        ASSERT_EQ(matches[i].line, i * 1000 + 1000);
+        ASSERT_EQ(matches[i].text, "match " + std::to_string(i * 1000 + 999));
+        ASSERT_EQ(contents.substr(matches[i].offset, matches[i].text.size()), matches[i].text);
+    }
+}
+
+TEST_F(SearcherTest, ContinuesAndLimits) {
+    std::vector<std::string> paths;
+    for (int f = 0; f < 20; f++) {
+        std::string contents;
+        for (int i = 0; i < 10; i++)
+            contents += "x" + std::to_string(f) + "-" + std::to_string(i) + "\n";
+        paths.push_back(add_file("f" + std::to_string(f), contents));
+    }
+    paths.push_back("missing");
+    paths.push_back(add_file("binary", std::string("x\0x\n", 4)));
+
+    Searcher searcher("x", false, 4);
+    auto     all = searcher.search(paths, 0, 1000, opener());
+    ASSERT_EQ(all.size(), 200);
+    for (size_t i = 0; i < all.size(); i++)
+        ASSERT_EQ(all[i].path, "f" + std::to_string(i / 10));
+
+    // Paging by the last match returns everything once
+    std::vector<Searcher::Match> paged;
+    size_t                       start = 0;
+    uint64_t                     from  = 0;
+    while (start < paths.size()) {
+        std::vector<std::string> rest(paths.begin() + static_cast<ptrdiff_t>(start), paths.end());
+        auto                     page = searcher.search(rest, from, 7, opener());
+        if (page.empty())
+            break;
+        ASSERT_LE(page.size(), 7);
+        paged.insert(paged.end(), page.begin(), page.end());
+        start = static_cast<size_t>(std::find(paths.begin(), paths.end(), page.back().path) - paths.begin());
+        from  = page.back().offset + 1;
+    }
+    ASSERT_EQ(paged.size(), all.size());
+    for (size_t i = 0; i < all.size(); i++)
+        ASSERT_EQ(paged[i].text, all[i].text);
+}
@@ -0,0 +1,45 @@
+#ifndef TEMPDIRTEST_HPP
+#define TEMPDIRTEST_HPP
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fixture giving every test an empty directory of its own, removed after the test
+// The name is unique, so runs of the same test from different build trees don't get in each other's way
+class TempDirTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const auto* info    = ::testing::UnitTest::GetInstance()->current_test_info();
+        std::string name    = std::string(info->test_suite_name()) + "." + info->name() + ".XXXXXX";
+        std::string pattern = (std::filesystem::temp_directory_path() / name).native();
+        ASSERT_NE(mkdtemp(pattern.data()), nullptr) << "Could not create " << pattern << ": " << strerror(errno);
+        _dir = pattern;
+    }
+
+    void TearDown() override { std::filesystem::remove_all(_dir); }
+
+    // Creates or replaces a file in the directory, returns its path
+    std::filesystem::path make_file(const std::string& name, std::string_view contents) {
+        auto          path = _dir / name;
+        std::ofstream ofs(path, std::ios::binary);
+        ofs.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        return path;
+    }
+
+    std::filesystem::path make_file(const std::string& name, const std::vector<uint8_t>& contents) {
+        return make_file(name, std::string_view(reinterpret_cast<const char*>(contents.data()), contents.size()));
+    }
+
+    std::filesystem::path _dir;
+};
+
+#endif // TEMPDIRTEST_HPP
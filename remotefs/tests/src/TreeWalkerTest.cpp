@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "TreeWalker.hpp"
+#include "TempDirTest.hpp"
+
+class TreeWalkerTest : public TempDirTest {
+protected:
+    void SetUp() override {
+        TempDirTest::SetUp();
+        // 3 directories with 20 subdirectories with 5 files each, and a symlink that must not be followed
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 20; j++) {
+                auto sub = _dir / "root" / ("d" + std::to_string(i)) / ("s" + std::to_string(j));
+                std::filesystem::create_directories(sub);
+                for (int k = 0; k < 5; k++)
+                    std::ofstream(sub / ("f" + std::to_string(k))) << "hello";
+            }
+        }
+        std::filesystem::create_directories(_dir / "outside");
+        std::ofstream(_dir / "outside" / "file") << "secret";
+        std::filesystem::create_directory_symlink(_dir / "outside", _dir / "root" / "link");
+
+        _fd = open((_dir / "root").c_str(), O_RDONLY | O_DIRECTORY);
+        ASSERT_GE(_fd, 0);
+    }
+
+    void TearDown() override {
+        close(_fd);
+        TempDirTest::TearDown();
+    }
+
+    static bool allow_all(const std::string&) { return true; }
+
+    int _fd = -1;
+};
+
+TEST_F(TreeWalkerTest, Summarize) {
+    TreeWalker walker(4);
+
+    auto t = walker.summarize(_fd, "/", allow_all);
+    EXPECT_EQ(t.dirs, 3 + 60);
+    EXPECT_EQ(t.files, 300 + 1);
+    EXPECT_EQ(t.bytes, 300 * 5 + std::filesystem::read_symlink(_dir / "root" / "link").native().size());
+    EXPECT_EQ(t.denied, 0);
+    EXPECT_EQ(t.errors, 0);
+}
+
+TEST_F(TreeWalkerTest, SummarizeSkipsDenied) {
+    TreeWalker walker(4);
+
+    auto t = walker.summarize(_fd, "/", [](const std::string& path) { return !path.starts_with("/d1"); });
+    EXPECT_EQ(t.dirs, 2 + 40);
+    EXPECT_EQ(t.files, 200 + 1);
+    EXPECT_EQ(t.denied, 1);
+}
+
+TEST_F(TreeWalkerTest, ListPages) {
+    TreeWalker walker(4);
+
+    std::vector<std::string> all;
+    std::string              after;
+    for (;;) {
+        std::vector<std::string> page;
+        bool eof = walker.list(_fd, "/", after, 7, allow_all,
+                               [&](const std::string& path, const struct stat&) { page.push_back(path); });
+        ASSERT_LE(page.size(), 7);
+        all.insert(all.end(), page.begin(), page.end());
+        if (eof)
+            break;
+        ASSERT_EQ(page.size(), 7);
+        after = page.back();
+    }
+
+    ASSERT_EQ(all.size(), 3 + 60 + 300 + 1);
+    EXPECT_EQ(all[0], "/d0");
+    EXPECT_EQ(all[1], "/d0/s0");
+    EXPECT_EQ(all[2], "/d0/s0/f0");
+    EXPECT_EQ(all[7], "/d0/s1");
+    EXPECT_EQ(all.back(), "/link");
+    EXPECT_EQ(std::set<std::string>(all.begin(), all.end()).size(), all.size());
+}
+
+TEST_F(TreeWalkerTest, ListSubdirectoryAndDenied) {
+    TreeWalker walker(1);
+
+    std::vector<std::string> all;
+    bool eof = walker.list(_fd, "/", "", 1000, [](const std::string& path) { return !path.starts_with("/d0/s1"); },
+                           [&](const std::string& path, const struct stat&) { all.push_back(path); });
+    EXPECT_TRUE(eof);
+    EXPECT_EQ(all.size(), 3 + 60 + 300 + 1 - 11 * 6);
+
+    int sub = open((_dir / "root" / "d2").c_str(), O_RDONLY | O_DIRECTORY);
+    all.clear();
+    eof = walker.list(sub, "/d2", "/d2/s5/f4", 3, allow_all,
+                      [&](const std::string& path, const struct stat&) { all.push_back(path); });
+    close(sub);
+    EXPECT_FALSE(eof);
+    EXPECT_EQ(all, (std::vector<std::string>{"/d2/s6", "/d2/s6/f0", "/d2/s6/f1"}));
+
+    EXPECT_ANY_THROW(walker.list(_fd, "/d2", "/d1/s0", 3, allow_all, [](const std::string&, const struct stat&) {}));
+}
+
+TEST_F(TreeWalkerTest, Remove) {
+    TreeWalker walker(4);
+
+    std::mutex            mutex;
+    std::set<std::string> removed;
+    auto t = walker.remove(_fd, "/", [](const std::string& path) { return !path.starts_with("/d1/s3"); },
+                           [&](const std::string& path, const struct stat&) {
+                               std::lock_guard lock(mutex);
+                               removed.insert(path);
+                           });
+
+    // d1/s3 and its parent d1 stay
+    EXPECT_EQ(t.denied, 1);
+    EXPECT_EQ(t.errors, 0);
+    EXPECT_EQ(t.files, 300 - 5 + 1);
+    EXPECT_EQ(t.dirs, 2 + 59);
+    EXPECT_TRUE(removed.contains("/d0/s0/f0"));
+    EXPECT_TRUE(removed.contains("/d0"));
+    EXPECT_FALSE(removed.contains("/d1"));
+    EXPECT_TRUE(std::filesystem::exists(_dir / "root" / "d1" / "s3" / "f0"));
+    EXPECT_FALSE(std::filesystem::exists(_dir / "root" / "d1" / "s2"));
+    EXPECT_FALSE(std::filesystem::exists(_dir / "root" / "d0"));
+    EXPECT_FALSE(std::filesystem::is_symlink(_dir / "root" / "link"));
+    // Not followed
+    EXPECT_TRUE(std::filesystem::exists(_dir / "outside" / "file"));
+
+    t = walker.remove(_fd, "/", allow_all, [](const std::string&, const struct stat&) {});
+    EXPECT_EQ(t.files, 5);
+    EXPECT_EQ(t.dirs, 2);
+    EXPECT_TRUE(std::filesystem::is_empty(_dir / "root"));
+}
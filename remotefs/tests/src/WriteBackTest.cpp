@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "Exception.h"
+#include "WriteBack.hpp"
+
+using namespace std::chrono_literals;
+
+// Stands in for the files on the server
+class WriteBackTest : public ::testing::Test {
+protected:
+    WriteBack::StoreT store() {
+        return [this](uint64_t handle, const std::string&, uint64_t off, const std::vector<uint8_t>& data) {
+            if (_fail)
+                throw Exception("No space left");
+            std::lock_guard lock(_mutex);
+            auto&           file = _files[handle];
+            if (file.size() < off + data.size())
+                file.resize(off + data.size());
+            std::memcpy(file.data() + off, data.data(), data.size());
+            _stores++;
+        };
+    }
+
+    std::string file(uint64_t handle) {
+        std::lock_guard lock(_mutex);
+        return _files[handle];
+    }
+
+    std::mutex                                _mutex;
+    std::unordered_map<uint64_t, std::string> _files;
+    std::atomic<size_t>                       _stores{0};
+    std::atomic<bool>                         _fail{false};
+};
+
+TEST_F(WriteBackTest, SmallWritesAreCoalesced) {
+    WriteBack   wb(1024 * 1024, 2, 1h, 1024 * 1024, store());
+    std::string data;
+    for (int i = 0; i < 1000; i++) {
+        auto chunk = std::to_string(i) + ",";
+        wb.write(1, "/f", chunk.data(), chunk.size(), data.size());
+        data += chunk;
+    }
+    EXPECT_EQ(_stores, 0);
+    EXPECT_EQ(wb.pending(), data.size());
+
+    wb.sync(1);
+    EXPECT_EQ(_stores, 1);
+    EXPECT_EQ(file(1), data);
+    EXPECT_EQ(wb.pending(), 0);
+}
+
+TEST_F(WriteBackTest, OverlappingWritesKeepTheLatest) {
+    // Ranges over max_store go out right away, while the later writes still come in
+    WriteBack wb(1024 * 1024, 4, 1h, 4, store());
+    wb.write(1, "/f", "aaaaaaaaaa", 10, 0);
+    wb.write(1, "/f", "bbb", 3, 8);
+    wb.write(1, "/f", "cc", 2, 2);
+    wb.write(1, "/f", "d", 1, 20);
+    wb.write(1, "/f", "eeeeeeeeeeee", 12, 9);
+
+    wb.sync(1);
+    EXPECT_EQ(file(1), "aaccaaaabeeeeeeeeeeee");
+    // Sent in pieces of at most max_store bytes
+    EXPECT_GE(_stores, 6);
+}
+
+TEST_F(WriteBackTest, SentAfterDelay) {
+    WriteBack wb(1024 * 1024, 1, 10ms, 1024 * 1024, store());
+    wb.write(1, "/f", "abc", 3, 0);
+    for (int i = 0; i < 500 && _stores == 0; i++)
+        std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(_stores, 1);
+    EXPECT_EQ(file(1), "abc");
+}
+
+TEST_F(WriteBackTest, ParallelWritersUnderCapacity) {
+    WriteBack                wb(4096, 4, 1ms, 1024, store());
+    std::vector<std::thread> threads;
+    for (uint64_t h = 1; h <= 4; h++) {
+        threads.emplace_back([&wb, h]() {
+            std::string chunk(100, static_cast<char>('a' + h));
+            for (int i = 0; i < 200; i++)
+                wb.write(h, "/f" + std::to_string(h), chunk.data(), chunk.size(), i * chunk.size());
+            wb.release(h);
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+
+    for (uint64_t h = 1; h <= 4; h++)
+        EXPECT_EQ(file(h), std::string(20000, static_cast<char>('a' + h)));
+    EXPECT_EQ(wb.pending(), 0);
+}
+
+TEST_F(WriteBackTest, ErrorsAreReportedOnceBySync) {
+    WriteBack wb(1024 * 1024, 2, 1h, 1024, store());
+    _fail = true;
+    wb.write(1, "/f", "abc", 3, 0);
+    wb.write(2, "/g", "abc", 3, 0);
+    // Draining keeps the error for sync
+    wb.drain_path("/f");
+    EXPECT_EQ(wb.pending(), 3);
+
+    EXPECT_THROW(wb.sync(1), Exception);
+    EXPECT_NO_THROW(wb.sync(1));
+    EXPECT_THROW(wb.release(2), Exception);
+    EXPECT_EQ(wb.pending(), 0);
+
+    _fail = false;
+    wb.write(2, "/g", "abc", 3, 0);
+    EXPECT_NO_THROW(wb.release(2));
+    EXPECT_EQ(file(2), "abc");
+}
+
+TEST_F(WriteBackTest, RenameKeepsPath) {
+    WriteBack wb(1024 * 1024, 1, 1h, 1024, store());
+    wb.write(1, "/f", "abc", 3, 0);
+    wb.rename("/f", "/g");
+    wb.drain_path("/f");
+    EXPECT_EQ(wb.pending(), 3);
+    wb.drain_path("/g");
+    EXPECT_EQ(wb.pending(), 0);
+    EXPECT_EQ(file(1), "abc");
+}
+
+TEST_F(WriteBackTest, DirtyWithoutWaiting) {
+    WriteBack wb(1024 * 1024, 1, 1h, 1024 * 1024, store());
+    EXPECT_FALSE(wb.dirty("/f"));
+
+    auto before = std::chrono::system_clock::now();
+    wb.write(1, "/f", "abc", 3, 10);
+    wb.write(2, "/f", "de", 2, 0);
+    auto dirty = wb.dirty("/f");
+    ASSERT_TRUE(dirty);
+    EXPECT_EQ(dirty->end, 13);
+    EXPECT_GE(dirty->written, before);
+    // Nothing was sent to find that out
+    EXPECT_EQ(_stores, 0);
+    EXPECT_FALSE(wb.dirty("/g"));
+
+    wb.drain_path("/f");
+    EXPECT_FALSE(wb.dirty("/f"));
+}
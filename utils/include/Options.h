@@ -56,8 +56,53 @@ private:
                                                                               {"path", ""},
                                                                               {"acl_path", ""},
                                                                               {"users_path", ""},
+                                                                              {"limits_path", ""},
                                                                               {"username", ""},
-                                                                              {"password", ""}};
+                                                                              {"password", ""},
+                                                                              {"fd_cache_size", 256U},
+                                                                              {"max_handles", 4096U},
+                                                                              {"readahead_min", 128U * 1024U},
+                                                                              {"readahead_max", 4U * 1024U * 1024U},
+                                                                              {"block_cache_size", 64U * 1024U * 1024U},
+                                                                              {"block_cache_block", 128U * 1024U},
+                                                                              {"hash_cache_size", 4U * 1024U * 1024U},
+                                                                              {"attr_ttl", 1000U},
+                                                                              {"attr_cache_size", 65536U},
+                                                                              {"attr_cache_bytes", 16U * 1024U * 1024U},
+                                                                              {"negative_attr_ttl", 1000U},
+                                                                              {"notify_attr_ttl", 60000U},
+                                                                              {"block_store_size", 0U},
+                                                                              {"page_cache_size", 64U * 1024U * 1024U},
+                                                                              {"page_cache_block", 128U * 1024U},
+                                                                              {"disk_cache_dir", ""},
+                                                                              {"disk_cache_size", 1024U * 1024U * 1024U},
+                                                                              {"readdir_page", 1024U},
+                                                                              {"dir_cursor_cache_size", 64U},
+                                                                              {"dir_fd_cache_size", 1024U},
+                                                                              {"watch_limit", 8192U},
+                                                                              {"lease_recall_timeout", 5000U},
+                                                                              {"lease_cache_size", 64U * 1024U * 1024U},
+                                                                              {"lease_block", 128U * 1024U},
+                                                                              {"write_back_size", 0U},
+                                                                              {"write_back_threads", 4U},
+                                                                              {"write_back_delay", 20U},
+                                                                              {"sched_workers", 64U},
+                                                                              {"sched_quantum", 128U * 1024U},
+                                                                              {"sched_user_workers", 16U},
+                                                                              {"tree_threads", 8U},
+                                                                              {"max_io_size", 1024U * 1024U},
+                                                                              {"io_engines_path", ""},
+                                                                              {"direct_io_buffers", 16U},
+                                                                              {"mmap_cache_size", 0U},
+                                                                              {"mmap_max_file", 64U * 1024U},
+                                                                              {"checksum_chunk", 4U * 1024U * 1024U},
+                                                                              {"fsync_group", 1U},
+                                                                              {"from", ""},
+                                                                              {"to", ""},
+                                                                              {"pattern", ""},
+                                                                              {"glob", ""},
+                                                                              {"regex", 0U},
+                                                                              {"algorithm", "sha256"}};
 
     std::unordered_map<std::string, OptionType> _current = _defaults;
 };
@@ -31,11 +31,23 @@ public:
     /// \return     SHA hash of \p in
     static std::string calculate(const std::string &in);
 
+    /// Calculates the hash for \p len bytes at \p data
+    /// \param data Pointer to the input bytes
+    /// \param len  Number of bytes
+    /// \return     SHA hash of the bytes
+    static std::string calculate(const char *data, size_t len);
+
     /// Append a vector of chars to the current hash
     /// \param in   Constant reference to an input vector
     /// \throws     Exception on any error
     void feedData(const std::vector<char> &in);
 
+    /// Append \p len bytes at \p data to the current hash
+    /// \param data Pointer to the input bytes
+    /// \param len  Number of bytes
+    /// \throws     Exception on any error
+    void feedData(const char *data, size_t len);
+
     /// Returns the hash, resets the hashing context
     /// \throws     Exception on any error
     std::string getHash();
@@ -0,0 +1,21 @@
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// Class to compute XXH64, a fast non-cryptographic hash
+/**
+ * Based on: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+class XXHash64 {
+public:
+    /// Calculates the hash for \p len bytes at \p data
+    /// \param data Pointer to the input bytes
+    /// \param len  Number of bytes
+    /// \param seed Seed of the hash
+    /// \return     XXH64 hash of the bytes
+    static uint64_t calculate(const char *data, size_t len, uint64_t seed = 0);
+};
+
+#endif // XXHASH_H
@@ -18,9 +18,11 @@ SHA::SHA() {
     if (!EVP_DigestInit_ex(mdctx.get(), EVP_sha256(), nullptr)) throw Exception("Can't create hashing context!");
 }
 
-void SHA::feedData(const std::vector<char> &in) {
-    if (in.empty()) return;
-    if (!EVP_DigestUpdate(mdctx.get(), in.data(), in.size())) throw Exception("Error hashing!");
+void SHA::feedData(const std::vector<char> &in) { feedData(in.data(), in.size()); }
+
+void SHA::feedData(const char *data, size_t len) {
+    if (len == 0) return;
+    if (!EVP_DigestUpdate(mdctx.get(), data, len)) throw Exception("Error hashing!");
 }
 
 std::string SHA::getHash() {
@@ -33,6 +35,8 @@ std::string SHA::getHash() {
     if (s != out.size()) throw Exception("Error hashing!");
 
     if (!EVP_MD_CTX_reset(mdctx.get())) throw Exception("Error hashing!");
+    // Reset leaves the context without a digest, make it usable for the next hash
+    if (!EVP_DigestInit_ex(mdctx.get(), EVP_sha256(), nullptr)) throw Exception("Error hashing!");
 
     return {out.begin(), out.end()};
 }
@@ -41,3 +45,9 @@ std::string SHA::calculate(const std::string &in) {
     std::vector<char> tmp(in.begin(), in.end());
     return SHA::calculate(tmp);
 }
+
+std::string SHA::calculate(const char *data, size_t len) {
+    SHA hasher;
+    hasher.feedData(data, len);
+    return hasher.getHash();
+}
@@ -0,0 +1,26 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "XXHash.h"
+
+TEST(XXHash64, KnownValues) {
+    EXPECT_EQ(XXHash64::calculate("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(XXHash64::calculate("a", 1), 0xD24EC4F1A98C6E5BULL);
+    EXPECT_EQ(XXHash64::calculate("abc", 3), 0x44BC2CF5AD770999ULL);
+}
+
+TEST(XXHash64, LengthsAndSeeds) {
+    // Every tail length after the 32 byte stripes, each must change the hash
+    std::string data;
+    for (int i = 0; i < 100; i++) data += static_cast<char>(i * 7);
+
+    uint64_t prev = 0;
+    for (size_t len = 0; len <= data.size(); len++) {
+        uint64_t h = XXHash64::calculate(data.data(), len);
+        EXPECT_NE(h, prev);
+        EXPECT_EQ(h, XXHash64::calculate(data.data(), len));
+        EXPECT_NE(h, XXHash64::calculate(data.data(), len, 1));
+        prev = h;
+    }
+}